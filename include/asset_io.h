@@ -0,0 +1,447 @@
+#ifndef ASSET_IO_H
+#define ASSET_IO_H
+
+/*
+  Serves asset requests from the asset pack (see asset_pack_format.h and
+  tools/assetpacker.c), falling back to loose files through sokol_fetch.
+
+  asset_io_send() takes the same sfetch_request_t as sfetch_send() and
+  calls the same callback with an emulated sfetch_response_t, so fetch
+  callbacks work unchanged on both paths. Packed files are read as ranges
+  of one handle that stays open; the sizes come from the table of contents,
+  so requests without a buffer get an exactly sized pool buffer which the
+  callback owns like with fetch_bind_pool_buffer(). A pack response never
+  has `dispatched` set, it is a single `fetched` or `failed` response with
+  `finished` set.
+
+  Natively the pack is opened and its table of contents read in
+  asset_io_setup(), the reads run on the job pool with positional reads.
+  On the web the whole pack is fetched with one request (after a small
+  probe for its size) and the reads copy out of it. Either way the ready
+  callback is invoked once the pack is usable or known to be missing, send
+  requests only after that. Chunked requests always go to sokol_fetch.
+
+  Built with ASSET_IO_URING on Linux, `uring` in the desc reads the pack
+  through io_uring instead (see uring_reader.h): reads are batched into
+  one submission per asset_io_dowork() and completed there, on the main
+  thread. The job pool path takes over when io_uring isn't available or
+  its queue is full.
+*/
+#include "sokol_fetch.h"
+#include "asset_pack_format.h"
+#include "buffer_pool.h"
+#include "job_pool.h"
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__EMSCRIPTEN__)
+#define ASSET_IO_FILE_HANDLE (0)
+#elif defined(_WIN32)
+#define ASSET_IO_FILE_HANDLE (1)
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#define ASSET_IO_FILE_HANDLE (1)
+#endif
+#if !defined(__EMSCRIPTEN__)
+#include <sys/stat.h>
+#endif
+#if defined(__linux__) && defined(ASSET_IO_URING)
+#include "uring_reader.h"
+#define ASSET_IO_HAS_URING (1)
+#else
+#define ASSET_IO_HAS_URING (0)
+#endif
+
+#define ASSET_IO_MAX_READS (64)
+#define ASSET_IO_MAX_USERDATA_BYTES (128)
+// Buffer size for files whose size can't be known before they are read
+// (fetched over HTTP on the web).
+#define FETCH_FALLBACK_BUFFER_SIZE (2 * 1024 * 1024)
+
+typedef struct asset_io_desc_t {
+  const char* pack_path;
+  uint32_t channel;  // of the pack fetch on the web
+  bool uring;        // read the pack through io_uring where built in
+  void (*ready_cb)(void);
+} asset_io_desc_t;
+
+typedef struct asset_io_stats_t {
+  bool pack_open;
+  bool uring;              // the pack is read through io_uring
+  uint32_t uring_batches;  // submissions that carried pack reads
+  uint32_t pack_entries;
+  uint32_t pack_reads;
+  uint32_t loose_reads;
+  uint64_t pack_bytes;
+} asset_io_stats_t;
+
+typedef struct _asset_io_read_t {
+  bool in_use;
+  bool failed;
+  const asset_pack_entry_t* entry;
+  void (*callback)(const sfetch_response_t*);
+  uint32_t channel;
+  uint8_t* buffer;
+  uint32_t buffer_size;
+  sfetch_error_t error_code;
+  uint64_t user_data[ASSET_IO_MAX_USERDATA_BYTES / sizeof(uint64_t)];
+} _asset_io_read_t;
+
+static struct {
+  asset_io_desc_t desc;
+  asset_io_stats_t stats;
+  asset_pack_header_t header;
+  asset_pack_entry_t entries[ASSET_PACK_MAX_ENTRIES];
+#if ASSET_IO_FILE_HANDLE && defined(_WIN32)
+  HANDLE file;
+#elif ASSET_IO_FILE_HANDLE
+  int fd;
+#else
+  bool probed;
+  uint8_t probe[sizeof(asset_pack_header_t)];
+  uint8_t* data;
+#endif
+  _asset_io_read_t reads[ASSET_IO_MAX_READS];
+} _asset_io;
+
+static uint32_t _fetch_file_size(const char* path) {
+#if defined(__EMSCRIPTEN__)
+  (void)path;
+  return FETCH_FALLBACK_BUFFER_SIZE;
+#else
+  struct stat st;
+  if (stat(path, &st) != 0 || st.st_size <= 0 || st.st_size > UINT32_MAX) {
+    return 0;
+  }
+  return (uint32_t)st.st_size;
+#endif
+}
+
+// Requests are sent without a buffer, when one is dispatched to the IO
+// thread the file size is looked up and an exactly sized pool buffer is
+// bound. Call this first in the fetch callback. Without a size (missing
+// file) no buffer is bound and the request fails. The callback owns the
+// buffer and gives it back with buffer_pool_free().
+static void fetch_bind_pool_buffer(const sfetch_response_t* response) {
+  if (!response->dispatched) {
+    return;
+  }
+  const uint32_t size = _fetch_file_size(response->path);
+  void* buffer = size > 0 ? buffer_pool_alloc(size) : NULL;
+  if (buffer) {
+    sfetch_bind_buffer(response->handle, buffer, size);
+  }
+}
+
+static bool _asset_io_check_toc(void) {
+  const asset_pack_header_t* header = &_asset_io.header;
+  if (header->magic != ASSET_PACK_MAGIC ||
+      header->version != ASSET_PACK_VERSION ||
+      header->num_entries > ASSET_PACK_MAX_ENTRIES ||
+      header->file_size < asset_pack_toc_size(header->num_entries)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < header->num_entries; ++i) {
+    const asset_pack_entry_t* entry = &_asset_io.entries[i];
+    if (entry->name[ASSET_PACK_NAME_SIZE - 1] != 0 ||
+        entry->offset > header->file_size ||
+        header->file_size - entry->offset < entry->size) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#if ASSET_IO_FILE_HANDLE && defined(_WIN32)
+static bool _asset_io_read_at(void* dst, uint32_t offset, uint32_t size) {
+  OVERLAPPED overlapped = {.Offset = offset};
+  DWORD num_read = 0;
+  return ReadFile(_asset_io.file, dst, size, &num_read, &overlapped) &&
+         num_read == size;
+}
+
+static bool _asset_io_open(const char* path) {
+  _asset_io.file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  return _asset_io.file != INVALID_HANDLE_VALUE;
+}
+
+static void _asset_io_close(void) {
+  if (_asset_io.file != INVALID_HANDLE_VALUE) {
+    CloseHandle(_asset_io.file);
+    _asset_io.file = INVALID_HANDLE_VALUE;
+  }
+}
+#elif ASSET_IO_FILE_HANDLE
+static bool _asset_io_read_at(void* dst, uint32_t offset, uint32_t size) {
+  uint8_t* ptr = (uint8_t*)dst;
+  while (size > 0) {
+    const ssize_t n = pread(_asset_io.fd, ptr, size, (off_t)offset);
+    if (n <= 0) {
+      return false;
+    }
+    ptr += n;
+    offset += (uint32_t)n;
+    size -= (uint32_t)n;
+  }
+  return true;
+}
+
+static bool _asset_io_open(const char* path) {
+  _asset_io.fd = open(path, O_RDONLY);
+  return _asset_io.fd >= 0;
+}
+
+static void _asset_io_close(void) {
+  if (_asset_io.fd >= 0) {
+    close(_asset_io.fd);
+    _asset_io.fd = -1;
+  }
+}
+#else
+static bool _asset_io_read_at(void* dst, uint32_t offset, uint32_t size) {
+  memcpy(dst, _asset_io.data + offset, size);
+  return true;
+}
+
+static void _asset_io_close(void) {
+  buffer_pool_free(_asset_io.data);
+  _asset_io.data = NULL;
+}
+#endif
+
+static void _asset_io_ready(bool pack_open) {
+  _asset_io.stats.pack_open = pack_open;
+  _asset_io.stats.pack_entries = pack_open ? _asset_io.header.num_entries : 0;
+  if (!pack_open) {
+    _asset_io.header.num_entries = 0;
+    _asset_io_close();
+  }
+#if ASSET_IO_HAS_URING
+  // the job pool path keeps its own handle for when the ring is full
+  _asset_io.stats.uring = pack_open && _asset_io.desc.uring &&
+                          uring_reader_setup(_asset_io.desc.pack_path);
+#endif
+  if (_asset_io.desc.ready_cb) {
+    _asset_io.desc.ready_cb();
+  }
+}
+
+#if ASSET_IO_FILE_HANDLE
+static void _asset_io_open_pack(void) {
+  if (!_asset_io_open(_asset_io.desc.pack_path)) {
+    _asset_io_ready(false);
+    return;
+  }
+  bool ok = _asset_io_read_at(&_asset_io.header, 0, sizeof(_asset_io.header)) &&
+            _asset_io.header.num_entries <= ASSET_PACK_MAX_ENTRIES &&
+            _asset_io_read_at(_asset_io.entries, sizeof(_asset_io.header),
+                              _asset_io.header.num_entries *
+                                  sizeof(asset_pack_entry_t)) &&
+            _asset_io_check_toc();
+  _asset_io_ready(ok);
+}
+#else
+static void _asset_io_pack_callback(const sfetch_response_t* response) {
+  if (response->fetched) {
+    const asset_pack_header_t* header =
+        (const asset_pack_header_t*)_asset_io.data;
+    const bool ok =
+        response->fetched_size == _asset_io.header.file_size &&
+        memcmp(header, &_asset_io.header, sizeof(*header)) == 0 &&
+        header->num_entries <= ASSET_PACK_MAX_ENTRIES;
+    if (ok) {
+      memcpy(_asset_io.entries, _asset_io.data + sizeof(*header),
+             header->num_entries * sizeof(asset_pack_entry_t));
+    }
+    _asset_io_ready(ok && _asset_io_check_toc());
+  } else if (response->failed) {
+    _asset_io_ready(false);
+  }
+}
+
+static void _asset_io_probe_callback(const sfetch_response_t* response) {
+  if (response->fetched && !_asset_io.probed) {
+    _asset_io.probed = true;
+    sfetch_cancel(response->handle);
+    memcpy(&_asset_io.header, _asset_io.probe, sizeof(_asset_io.header));
+    if (response->fetched_size < sizeof(_asset_io.header) ||
+        _asset_io.header.magic != ASSET_PACK_MAGIC ||
+        _asset_io.header.file_size <
+            asset_pack_toc_size(_asset_io.header.num_entries)) {
+      _asset_io_ready(false);
+      return;
+    }
+    _asset_io.data = (uint8_t*)buffer_pool_alloc(_asset_io.header.file_size);
+    if (!_asset_io.data) {
+      _asset_io_ready(false);
+      return;
+    }
+    sfetch_send(&(sfetch_request_t){.channel = _asset_io.desc.channel,
+                                    .path = _asset_io.desc.pack_path,
+                                    .callback = _asset_io_pack_callback,
+                                    .buffer_ptr = _asset_io.data,
+                                    .buffer_size = _asset_io.header.file_size});
+  } else if (response->failed && !_asset_io.probed) {
+    // the cancelled probe also ends up here once the header was read
+    _asset_io.probed = true;
+    _asset_io_ready(false);
+  }
+}
+
+static void _asset_io_open_pack(void) {
+  sfetch_send(&(sfetch_request_t){.channel = _asset_io.desc.channel,
+                                  .path = _asset_io.desc.pack_path,
+                                  .callback = _asset_io_probe_callback,
+                                  .buffer_ptr = _asset_io.probe,
+                                  .buffer_size = sizeof(_asset_io.probe),
+                                  .chunk_size = sizeof(_asset_io.probe)});
+}
+#endif
+
+// Opens the pack, `ready_cb` is called once it can be read from or is
+// known to be missing, which may happen before this returns.
+static void asset_io_setup(const asset_io_desc_t* desc) {
+  memset(&_asset_io, 0, sizeof(_asset_io));
+  _asset_io.desc = *desc;
+#if ASSET_IO_FILE_HANDLE && defined(_WIN32)
+  _asset_io.file = INVALID_HANDLE_VALUE;
+#elif ASSET_IO_FILE_HANDLE
+  _asset_io.fd = -1;
+#endif
+  _asset_io_open_pack();
+}
+
+// Reads still in flight keep the handle busy, call after job_pool_shutdown().
+static void asset_io_shutdown(void) {
+#if ASSET_IO_HAS_URING
+  if (_asset_io.stats.uring) {
+    uring_reader_shutdown();
+    _asset_io.stats.uring = false;
+  }
+#endif
+  _asset_io_close();
+  _asset_io.header.num_entries = 0;
+}
+
+static const asset_pack_entry_t* asset_io_find(const char* path) {
+  for (uint32_t i = 0; i < _asset_io.header.num_entries; ++i) {
+    if (strcmp(_asset_io.entries[i].name, path) == 0) {
+      return &_asset_io.entries[i];
+    }
+  }
+  return NULL;
+}
+
+// The pack's `index`th file, below asset_io_stats().pack_entries.
+static const asset_pack_entry_t* asset_io_entry(uint32_t index) {
+  return &_asset_io.entries[index];
+}
+
+// Runs on a job pool worker.
+static void _asset_io_read_job(void* data) {
+  _asset_io_read_t* read = (_asset_io_read_t*)data;
+  if (!read->failed &&
+      !_asset_io_read_at(read->buffer, read->entry->offset, read->entry->size)) {
+    read->failed = true;
+    read->error_code = SFETCH_ERROR_UNEXPECTED_EOF;
+  }
+}
+
+static void _asset_io_read_done(void* data) {
+  _asset_io_read_t* read = (_asset_io_read_t*)data;
+  if (!read->failed) {
+    ++_asset_io.stats.pack_reads;
+    _asset_io.stats.pack_bytes += read->entry->size;
+  }
+  const sfetch_response_t response = {
+      .fetched = !read->failed,
+      .finished = true,
+      .failed = read->failed,
+      .error_code = read->error_code,
+      .channel = read->channel,
+      .path = read->entry->name,
+      .user_data = read->user_data,
+      .fetched_size = read->failed ? 0 : read->entry->size,
+      .buffer_ptr = read->buffer,
+      .buffer_size = read->buffer_size};
+  read->callback(&response);
+  // after the callback, its user data lives in the slot
+  read->in_use = false;
+}
+
+#if ASSET_IO_HAS_URING
+static void _asset_io_uring_done(bool ok, void* data) {
+  _asset_io_read_t* read = (_asset_io_read_t*)data;
+  if (!ok) {
+    read->failed = true;
+    read->error_code = SFETCH_ERROR_UNEXPECTED_EOF;
+  }
+  _asset_io_read_done(read);
+}
+#endif
+
+// Submits and completes the io_uring reads, call once per frame next to
+// sfetch_dowork(). Does nothing on the other backends.
+static void asset_io_dowork(void) {
+#if ASSET_IO_HAS_URING
+  if (_asset_io.stats.uring) {
+    const uint32_t enters = uring_reader_stats().enters;
+    uring_reader_poll(false);
+    _asset_io.stats.uring_batches += uring_reader_stats().enters - enters;
+  }
+#endif
+}
+
+// Drop-in for sfetch_send(), see the top of the file.
+static void asset_io_send(const sfetch_request_t* request) {
+  const asset_pack_entry_t* entry =
+      request->chunk_size == 0 ? asset_io_find(request->path) : NULL;
+  _asset_io_read_t* read = NULL;
+  for (int i = 0; entry && i < ASSET_IO_MAX_READS; ++i) {
+    if (!_asset_io.reads[i].in_use) {
+      read = &_asset_io.reads[i];
+      break;
+    }
+  }
+  if (!read || request->user_data_size > ASSET_IO_MAX_USERDATA_BYTES) {
+    ++_asset_io.stats.loose_reads;
+    sfetch_send(request);
+    return;
+  }
+  *read = (_asset_io_read_t){.in_use = true,
+                             .entry = entry,
+                             .callback = request->callback,
+                             .channel = request->channel,
+                             .buffer = (uint8_t*)request->buffer_ptr,
+                             .buffer_size = request->buffer_size};
+  if (request->user_data_ptr) {
+    memcpy(read->user_data, request->user_data_ptr, request->user_data_size);
+  }
+  if (!read->buffer) {
+    read->buffer = (uint8_t*)buffer_pool_alloc(entry->size);
+    read->buffer_size = entry->size;
+    if (!read->buffer) {
+      read->failed = true;
+      read->error_code = SFETCH_ERROR_NO_BUFFER;
+    }
+  } else if (read->buffer_size < entry->size) {
+    read->failed = true;
+    read->error_code = SFETCH_ERROR_BUFFER_TOO_SMALL;
+  }
+#if ASSET_IO_HAS_URING
+  if (_asset_io.stats.uring && !read->failed &&
+      uring_reader_read(read->buffer, read->entry->offset, read->entry->size,
+                        _asset_io_uring_done, read)) {
+    return;
+  }
+#endif
+  job_pool_submit(_asset_io_read_job, _asset_io_read_done, read);
+}
+
+static asset_io_stats_t asset_io_stats(void) {
+  return _asset_io.stats;
+}
+
+#endif  // ASSET_IO_H
@@ -2,19 +2,32 @@
 #define _FETCH_H
 
 #include "types.h"
+#include "asset_io.h"
+#include "asset_registry.h"
+#include "buffer_pool.h"
+#include "gl_texture.h"
+#include "image_decoder.h"
+#include "load_group.h"
+#include "mipgen.h"
 #include "sokol_app.h"
 #include "stb/stb_image.h"
+#include "texcomp.h"
+#include "texture_pack.h"
+#include <stdlib.h>
 #include <string.h>
 
-static void icon_fetch_callback(const sfetch_response_t* response) {
-  if (response->fetched) {
+// Registry callback of the favicon asset.
+static void icon_fetched(asset_t* asset, void* user_data) {
+  (void)user_data;
+  if (asset->state == ASSET_STATE_FETCHED) {
     int png_width, png_height, num_channels;
     const int desired_channels = 4;
 
-    stbi_uc* pixels = stbi_load_from_memory(
-        response->buffer_ptr, (int)response->fetched_size, &png_width,
-        &png_height, &num_channels, desired_channels);
-    if (pixels) {
+    stbi_uc* pixels =
+        stbi_load_from_memory(asset->data, (int)asset->size, &png_width,
+                              &png_height, &num_channels, desired_channels);
+    // there's no window to put the icon on in headless mode
+    if (pixels && sapp_isvalid()) {
       sapp_set_icon(&(sapp_icon_desc){
           .images = {
               {.width = 32,
@@ -22,11 +35,16 @@ static void icon_fetch_callback(const sfetch_response_t* response) {
                .pixels = {.ptr = pixels,
                           .size = (size_t)(png_width * png_height * 4)}}}});
     }
+    stbi_image_free(pixels);
+    asset_registry_done(asset_registry_id(asset), pixels != NULL);
   }
 }
 
 static void image_fetch_callback(const sfetch_response_t* response) {
   image_request_data req_data = *(image_request_data*)response->user_data;
+  if (req_data.pool_buffer) {
+    fetch_bind_pool_buffer(response);
+  }
 
   if (response->fetched) {
     int img_width, img_height, num_channels;
@@ -55,181 +73,636 @@ static void image_fetch_callback(const sfetch_response_t* response) {
   } else if (response->failed) {
     req_data.fail_callback();
   }
+  if (req_data.pool_buffer && response->finished) {
+    buffer_pool_free(response->buffer_ptr);
+  }
 }
 
-static bool _load_arraytex(_arraytex_request_t* request) {
-  const int desired_channels = 4;
-  int img_widths[ARRAYTEX_COUNT], img_heights[ARRAYTEX_COUNT];
-  sg_image_data img_data;
-
-  for (int i = 0; i < ARRAYTEX_COUNT; i++) {
-    int num_channel;
-    stbi_uc* img_ptr =
-        stbi_load_from_memory(request->buffer + (i * request->buffer_offset),
-                              request->fetched_sizes[i], &img_widths[i],
-                              &img_heights[i], &num_channel, desired_channels);
-    memcpy(request->texture_buffer_ptr +
-               (i * ARRAYTEX_ARRAY_IMAGE_OFFSET * sizeof(uint32_t)),
-           img_ptr,
-           img_widths[i] * img_heights[i] * desired_channels * sizeof(stbi_uc));
-    stbi_image_free(img_ptr);
-  }
-  img_data.subimage[0][0] =
-      (sg_range){.ptr = request->texture_buffer_ptr,
-                 .size = ARRAYTEX_IMAGE_BUFFER_SIZE * sizeof(uint32_t)};
-
-  /*
-    static uint32_t pixels[3][16][16];
-    for (int layer = 0, even_odd = 0; layer < 16; layer++) {
-      for (int y = 0; y < 16; y++, even_odd++) {
-        for (int x = 0; x < 16; x++, even_odd++) {
-          if (even_odd & 1) {
-            switch (layer) {
-              case 0:
-                pixels[layer][y][x] = 0x000000FF;
-                break;
-              case 1:
-                pixels[layer][y][x] = 0x0000FF00;
-                break;
-              case 2:
-                pixels[layer][y][x] = 0x00FF0000;
-                break;
-            }
-          } else {
-            pixels[layer][y][x] = 0;
-          }
-        }
-      }
+// Runs on a job pool worker. Decodes a width x height image and fills
+// `levels` with its mip chain, less the top `dropped_mips` levels the
+// texture quality leaves out. Those are only built to filter the kept
+// ones from, in scratch memory.
+static bool _decode_chain(const asset_t* asset,
+                          int width,
+                          int height,
+                          int dropped_mips,
+                          uint8_t* const* levels,
+                          int num_mips) {
+  uint8_t* chain[MIPGEN_MAX_LEVELS];
+  uint8_t* scratch = NULL;
+  if (dropped_mips > 0) {
+    size_t scratch_size = 0;
+    for (int mip = 0; mip < dropped_mips; mip++) {
+      scratch_size += mipgen_level_size(width, height, mip);
+    }
+    // workers can't use the buffer pool
+    scratch = (uint8_t*)malloc(scratch_size);
+    if (!scratch) {
+      return false;
     }
+    chain[0] = scratch;
+    for (int mip = 1; mip < dropped_mips; mip++) {
+      chain[mip] = chain[mip - 1] + mipgen_level_size(width, height, mip - 1);
+    }
+  }
+  for (int mip = 0; mip < num_mips; mip++) {
+    chain[dropped_mips + mip] = levels[mip];
+  }
+  int img_width, img_height;
+  const bool ok =
+      image_decode_into(asset->data, asset->size, chain[0],
+                        mipgen_level_size(width, height, 0), &img_width,
+                        &img_height) &&
+      img_width == width && img_height == height;
+  if (ok) {
+    mipgen_build_chain(chain, width, height, dropped_mips + num_mips);
+  }
+  free(scratch);
+  return ok;
+}
 
-    img_data.subimage[0][0] = SG_RANGE(pixels);
-  */
+// The slots and the placeholder.
+static int _arraytex_num_layers(const _arraytex_request_t* request) {
+  return request->num_slots + 1;
+}
 
-  bool valid = img_heights[0] > 0 && img_widths[0] > 0;
+static size_t _arraytex_level_size(const _arraytex_request_t* request,
+                                   int mip) {
+  return texpack_surface_size(
+      request->format,
+      (uint32_t)mipgen_level_dim(request->layer_width, mip),
+      (uint32_t)mipgen_level_dim(request->layer_height, mip));
+}
+
+// Bytes of one layer, all mips included.
+static size_t _arraytex_chain_size(const _arraytex_request_t* request) {
+  size_t size = 0;
+  for (int mip = 0; mip < request->num_mips; mip++) {
+    size += _arraytex_level_size(request, mip);
+  }
+  return size;
+}
+
+// Bytes of all layers and mips.
+static size_t arraytex_buffer_size(const _arraytex_request_t* request) {
+  return _arraytex_num_layers(request) * _arraytex_chain_size(request);
+}
+
+// All layers of a mip level, back to back.
+static uint8_t* _arraytex_level(_arraytex_request_t* request, int mip) {
+  uint8_t* level = request->texture_buffer_ptr;
+  for (int i = 0; i < mip; i++) {
+    level += _arraytex_num_layers(request) * _arraytex_level_size(request, i);
+  }
+  return level;
+}
+
+static uint8_t* _arraytex_layer(_arraytex_request_t* request,
+                                int mip,
+                                int index) {
+  return _arraytex_level(request, mip) +
+         index * _arraytex_level_size(request, mip);
+}
+
+// Every level of a layer, and their sizes.
+static void _arraytex_layer_levels(_arraytex_request_t* request,
+                                   int index,
+                                   const uint8_t** levels,
+                                   size_t* level_sizes) {
+  for (int mip = 0; mip < request->num_mips; mip++) {
+    levels[mip] = _arraytex_layer(request, mip, index);
+    level_sizes[mip] = _arraytex_level_size(request, mip);
+  }
+}
 
-  for (int i = 1; i < ARRAYTEX_COUNT; i++) {
-    if (img_widths[i] != img_widths[0] || img_heights[i] != img_heights[0] ||
-        img_widths[i] != ARRAYTEX_IMAGE_WIDTH ||
-        img_heights[i] != ARRAYTEX_IMAGE_HEIGHT) {
-      valid = false;
+// A material's layer in the copy of the cooked pack.
+static const uint8_t* _arraytex_pack_layer(const _arraytex_request_t* request,
+                                           int mip,
+                                           int material) {
+  const uint8_t* level = request->pack_layers;
+  for (int i = 0; i < mip; i++) {
+    level += request->num_materials * _arraytex_level_size(request, i);
+  }
+  return level + material * _arraytex_level_size(request, mip);
+}
+
+// The placeholder color is one texel, or one 4x4 block of a block format,
+// repeated over every level.
+static void _fill_arraytex_layer(_arraytex_request_t* request, int index) {
+  const uint32_t color = ARRAYTEX_PLACEHOLDER_COLOR;
+  uint8_t texels[64];
+  for (int i = 0; i < 16; i++) {
+    memcpy(texels + i * 4, &color, sizeof(color));
+  }
+  uint8_t pattern[16];
+  size_t pattern_size = 8;
+  switch (request->format) {
+    case TEXPACK_FORMAT_BC1:
+      texcomp_encode_bc1_block(texels, pattern);
+      break;
+    case TEXPACK_FORMAT_BC3:
+      texcomp_encode_bc3_block(texels, pattern);
+      pattern_size = 16;
+      break;
+    case TEXPACK_FORMAT_ETC2_RGB8:
+      texcomp_encode_etc2_rgb8_block(texels, pattern);
+      break;
+    default:
+      memcpy(pattern, &color, sizeof(color));
+      pattern_size = sizeof(color);
       break;
+  }
+  for (int mip = 0; mip < request->num_mips; mip++) {
+    uint8_t* level = _arraytex_layer(request, mip, index);
+    const size_t size = _arraytex_level_size(request, mip);
+    for (size_t offset = 0; offset < size; offset += pattern_size) {
+      memcpy(level + offset, pattern, pattern_size);
     }
   }
+}
+
+// Runs on a job pool worker. Layers come from the disk cache when their
+// file was decoded before at the same quality. Otherwise images with the
+// wrong size are rejected by image_decode_into() before a decoder writes
+// to the layer, a file that fails to decode may leave it half written and
+// the layer is refilled with the placeholder.
+static bool _decode_arraytex_layer(load_group_t* group,
+                                   int member,
+                                   const asset_t* asset) {
+  (void)member;
+  const _arraytex_slot_t* ctx = (const _arraytex_slot_t*)group->desc.user_data;
+  _arraytex_request_t* request = ctx->request;
+  const int i = ctx->slot;
+  uint8_t* levels[ARRAYTEX_MIP_COUNT];
+  for (int mip = 0; mip < request->num_mips; mip++) {
+    levels[mip] = _arraytex_layer(request, mip, i);
+  }
+  const uint64_t key =
+      texture_cache_key(asset->data, asset->size, request->dropped_mips);
+  if (texture_cache_load(key, request->layer_width, request->layer_height,
+                         request->num_mips, levels)) {
+    request->slot_cache[i] = TEXTURE_CACHE_HIT;
+    return true;
+  }
+  request->slot_cache[i] =
+      texture_cache_enabled() ? TEXTURE_CACHE_MISS : TEXTURE_CACHE_OFF;
 
-  if (valid) {
-    sg_init_image(request->img_id,
-                  &(sg_image_desc){.type = SG_IMAGETYPE_ARRAY,
-                                   .width = img_widths[0],
-                                   .height = img_heights[0],
-                                   .num_slices = ARRAYTEX_COUNT,
-                                   .pixel_format = SG_PIXELFORMAT_RGBA8,
-                                   .min_filter = SG_FILTER_LINEAR,
-                                   .mag_filter = SG_FILTER_LINEAR,
-                                   .data = img_data,
-                                   .label = "arraytex-image"});
+  if (!_decode_chain(asset, ARRAYTEX_IMAGE_WIDTH, ARRAYTEX_IMAGE_HEIGHT,
+                     request->dropped_mips, levels, request->num_mips)) {
+    return false;
   }
+  texture_cache_store(key, request->layer_width, request->layer_height,
+                      request->num_mips, levels);
+  return true;
+}
 
-  return valid;
+// Whether a decoder may be writing into the buffer.
+static bool _arraytex_decoding(const _arraytex_request_t* request) {
+  for (int i = 0; i < request->num_slots; i++) {
+    if (request->slot_groups[i] && request->slot_groups[i]->decoding > 0) {
+      return true;
+    }
+  }
+  return false;
 }
 
-static void arraytex_fetch_callback(const sfetch_response_t* response) {
-  _arraytex_request_instance_t req_inst =
-      *(_arraytex_request_instance_t*)response->user_data;
-  _arraytex_request_t* request = req_inst.request;
+// Sizes the layers for the texture quality.
+static void _arraytex_init_size(_arraytex_request_t* request) {
+  request->dropped_mips = texture_quality_levels(
+      ARRAYTEX_IMAGE_WIDTH, ARRAYTEX_IMAGE_HEIGHT, ARRAYTEX_MIP_COUNT);
+  request->layer_width =
+      mipgen_level_dim(ARRAYTEX_IMAGE_WIDTH, request->dropped_mips);
+  request->layer_height =
+      mipgen_level_dim(ARRAYTEX_IMAGE_HEIGHT, request->dropped_mips);
+  request->num_mips = ARRAYTEX_MIP_COUNT - request->dropped_mips;
+}
 
-  if (response->fetched) {
-    request->fetched_sizes[req_inst.index] = response->fetched_size;
-    ++request->finished_requests;
-  } else if (response->failed) {
-    request->failed = true;
-    ++request->finished_requests;
+// Fills every layer with the placeholder color and creates the array
+// image, so the terrain can be drawn before any layer is loaded. With
+// direct GL access it's an injected texture whose layers are uploaded one
+// by one, otherwise a dynamic image. False for block formats without
+// direct GL access, sokol-gfx only creates those as immutable images.
+static bool _init_arraytex(_arraytex_request_t* request) {
+  const int num_layers = _arraytex_num_layers(request);
+  const sg_pixel_format pixel_format =
+      texture_pack_pixel_format(request->format);
+  const uint32_t gl_format = gl_compressed_format(pixel_format);
+  const uint8_t* levels[ARRAYTEX_MIP_COUNT];
+  size_t level_sizes[ARRAYTEX_MIP_COUNT];
+  _arraytex_layer_levels(request, 0, levels, level_sizes);
+  request->gl_texture = gl_make_array_texture(
+      gl_format, request->layer_width, request->layer_height, num_layers,
+      request->num_mips, level_sizes);
+  if (!request->gl_texture && request->format != TEXPACK_FORMAT_RGBA8) {
+    return false;
+  }
+  for (int i = 0; i < num_layers; i++) {
+    _fill_arraytex_layer(request, i);
   }
+  sg_init_image(request->img_id,
+                &(sg_image_desc){.type = SG_IMAGETYPE_ARRAY,
+                                 .width = request->layer_width,
+                                 .height = request->layer_height,
+                                 .num_slices = num_layers,
+                                 .num_mipmaps = request->num_mips,
+                                 .usage = request->gl_texture
+                                              ? SG_USAGE_IMMUTABLE
+                                              : SG_USAGE_DYNAMIC,
+                                 .pixel_format = pixel_format,
+                                 .min_filter = SG_FILTER_LINEAR_MIPMAP_LINEAR,
+                                 .mag_filter = SG_FILTER_LINEAR,
+                                 .gl_textures[0] = request->gl_texture,
+                                 .label = "arraytex-image"});
+  request->dirty_layers = (1u << num_layers) - 1;
+  return true;
+}
 
-  if (request->finished_requests == ARRAYTEX_COUNT) {
-    if (!request->failed) {
-      request->failed = !_load_arraytex(request);
-    }
+// Creates the buffer, the image and the residency of a request whose
+// layer size, format and materials are set. False if there's no memory
+// for the buffer or no image for the format.
+static bool _arraytex_start(_arraytex_request_t* request) {
+  request->num_slots = request->num_materials < ARRAYTEX_SLOTS
+                           ? request->num_materials
+                           : ARRAYTEX_SLOTS;
+  request->texture_buffer_ptr = (uint8_t*)malloc(arraytex_buffer_size(request));
+  if (!request->texture_buffer_ptr) {
+    return false;
+  }
+  if (!_init_arraytex(request)) {
+    free(request->texture_buffer_ptr);
+    request->texture_buffer_ptr = NULL;
+    return false;
+  }
+  texture_residency_init(&request->residency, request->num_slots,
+                         request->num_materials);
+  return true;
+}
 
-    if (request->failed) {
-      request->fail_callback();
-    } else {
-      request->success_callback();
+// Streams the materials of the cooked pack's array entry through the
+// slots like the loose files, their layers are copied instead of decoded.
+// The levels the texture quality keeps are copied out of the pack, whose
+// memory is released after its callback. False where the layers can't be
+// uploaded one by one (block formats without direct GL access), the
+// caller creates the whole image from the pack then.
+static bool arraytex_load_pack(_arraytex_request_t* request,
+                               const texture_pack_t* pack,
+                               const texpack_entry_t* entry) {
+  if (entry->format != TEXPACK_FORMAT_RGBA8 && !GL_UTIL_AVAILABLE) {
+    return false;
+  }
+  request->format = entry->format;
+  request->dropped_mips = texture_quality_levels(
+      (int)entry->width, (int)entry->height, (int)entry->num_mips);
+  request->layer_width =
+      mipgen_level_dim((int)entry->width, request->dropped_mips);
+  request->layer_height =
+      mipgen_level_dim((int)entry->height, request->dropped_mips);
+  request->num_mips = (int)entry->num_mips - request->dropped_mips;
+  request->num_materials =
+      entry->num_slices < TEXTURE_RESIDENCY_MAX_MATERIALS
+          ? (int)entry->num_slices
+          : TEXTURE_RESIDENCY_MAX_MATERIALS;
+  request->streaming = true;
+  size_t size = 0;
+  for (int mip = 0; mip < request->num_mips; mip++) {
+    size += request->num_materials * _arraytex_level_size(request, mip);
+  }
+  request->pack_layers = (uint8_t*)malloc(size);
+  if (request->pack_layers) {
+    uint8_t* dst = request->pack_layers;
+    for (int mip = 0; mip < request->num_mips; mip++) {
+      const size_t level_size =
+          request->num_materials * _arraytex_level_size(request, mip);
+      memcpy(dst,
+             pack->data + entry->mip_offsets[mip + request->dropped_mips],
+             level_size);
+      dst += level_size;
     }
   }
+  if (!request->pack_layers || !_arraytex_start(request)) {
+    free(request->pack_layers);
+    *request = (_arraytex_request_t){
+        .img_id = request->img_id,
+        .fail_callback = request->fail_callback,
+        .success_callback = request->success_callback};
+    return false;
+  }
+  return true;
 }
 
-static bool _load_cubemap(_cubemap_request_t* request) {
-  const int desired_channels = 4;
-  int img_widths[6], img_heights[6];
-  stbi_uc* pixels_ptrs[6];
-  sg_image_data img_data;
+// Starts the frame's material touches, call before arraytex_layer().
+static void arraytex_begin_frame(_arraytex_request_t* request) {
+  if (request->streaming) {
+    texture_residency_begin_frame(&request->residency);
+  }
+}
 
-  for (int i = 0; i < 6; i++) {
-    int num_channel;
-    pixels_ptrs[i] =
-        stbi_load_from_memory(request->buffer + (i * request->buffer_offset),
-                              request->fetched_sizes[i], &img_widths[i],
-                              &img_heights[i], &num_channel, desired_channels);
-    img_data.subimage[i][0].ptr = pixels_ptrs[i];
-    img_data.subimage[i][0].size =
-        img_widths[i] * img_heights[i] * desired_channels;
+// The layer to sample for `material`, which is marked as visible.
+static int arraytex_layer(_arraytex_request_t* request, int material) {
+  if (!request->streaming) {
+    return material;
+  }
+  return texture_residency_touch(&request->residency, material);
+}
+
+// Bytes the next upload sends: the changed layers, or the whole dynamic
+// image.
+static size_t _arraytex_upload_size(const _arraytex_request_t* request) {
+  if (!request->gl_texture) {
+    return arraytex_buffer_size(request);
   }
+  int num_dirty = 0;
+  for (int i = 0; i < _arraytex_num_layers(request); i++) {
+    num_dirty += (request->dirty_layers >> i) & 1;
+  }
+  return num_dirty * _arraytex_chain_size(request);
+}
 
-  bool valid = img_heights[0] > 0 && img_widths[0] > 0;
+// Upload queue readiness, waits while a decoder is writing into the
+// buffer.
+static bool _arraytex_upload_ready(void* data) {
+  return !_arraytex_decoding((const _arraytex_request_t*)data);
+}
 
-  for (int i = 1; i < 6; i++) {
-    if (img_widths[i] != img_widths[0] || img_heights[i] != img_heights[0]) {
-      valid = false;
-      break;
+// Upload queue callback, takes every layer that changed since it was
+// queued.
+static void _arraytex_upload(void* data) {
+  _arraytex_request_t* request = (_arraytex_request_t*)data;
+  if (request->gl_texture) {
+    const uint32_t gl_format =
+        gl_compressed_format(texture_pack_pixel_format(request->format));
+    for (int i = 0; i < _arraytex_num_layers(request); i++) {
+      if (!(request->dirty_layers & (1u << i))) {
+        continue;
+      }
+      const uint8_t* levels[ARRAYTEX_MIP_COUNT];
+      size_t level_sizes[ARRAYTEX_MIP_COUNT];
+      _arraytex_layer_levels(request, i, levels, level_sizes);
+      gl_update_array_layer(request->gl_texture, gl_format,
+                            request->layer_width, request->layer_height, i,
+                            request->num_mips, levels, level_sizes);
+    }
+  } else {
+    sg_image_data img_data = {0};
+    for (int mip = 0; mip < request->num_mips; mip++) {
+      img_data.subimage[0][mip] =
+          (sg_range){.ptr = _arraytex_level(request, mip),
+                     .size = _arraytex_num_layers(request) *
+                             _arraytex_level_size(request, mip)};
     }
+    sg_update_image(request->img_id, &img_data);
   }
+  request->dirty_layers = 0;
+  request->upload_queued = false;
+}
 
-  if (valid) {
-    sg_init_image(request->img_id,
-                  &(sg_image_desc){.type = SG_IMAGETYPE_CUBE,
-                                   .width = img_widths[0],
-                                   .height = img_heights[0],
-                                   .pixel_format = SG_PIXELFORMAT_RGBA8,
-                                   .wrap_u = SG_WRAP_CLAMP_TO_EDGE,
-                                   .wrap_v = SG_WRAP_CLAMP_TO_EDGE,
-                                   .wrap_w = SG_WRAP_CLAMP_TO_EDGE,
-                                   .min_filter = SG_FILTER_LINEAR,
-                                   .mag_filter = SG_FILTER_LINEAR,
-                                   .data = img_data,
-                                   .label = "cubemap-image"});
+// Queues an upload of the array texture if any layer changed since the
+// last one. Dynamic images can only be updated once per frame, so there
+// is at most one upload in the queue.
+static void arraytex_update(_arraytex_request_t* request) {
+  if (!request->texture_buffer_ptr || !request->dirty_layers ||
+      request->upload_queued) {
+    return;
   }
+  const upload_desc_t upload = {
+      .priority = UPLOAD_PRIORITY_TERRAIN,
+      .size = _arraytex_upload_size(request),
+      .upload_cb = _arraytex_upload,
+      .ready_cb = _arraytex_upload_ready,
+      .user_data = request};
+  request->upload_queued = upload_queue_submit(&upload);
+  if (!request->upload_queued && _arraytex_upload_ready(request)) {
+    _arraytex_upload(request);
+    upload_queue_account(upload.priority, upload.size);
+  }
+}
 
-  for (int i = 0; i < 6; i++) {
-    stbi_image_free(pixels_ptrs[i]);
+// Reports the first batch of materials in view, once none is loading
+// anymore.
+static void _arraytex_try_finish(_arraytex_request_t* request) {
+  if (request->finished ||
+      texture_residency_num_loading(&request->residency) > 0) {
+    return;
+  }
+  request->finished = true;
+  if (texture_residency_num_resident(&request->residency) == 0) {
+    request->fail_callback();
+  } else {
+    request->success_callback();
+  }
+}
+
+// Layers that failed to decode may be partially written, they go back to
+// the placeholder.
+static void _arraytex_layer_loaded(load_group_t* group, bool failed) {
+  const _arraytex_slot_t* ctx = (const _arraytex_slot_t*)group->desc.user_data;
+  _arraytex_request_t* request = ctx->request;
+  const int i = ctx->slot;
+  request->slot_groups[i] = NULL;
+  if (!failed) {
+    const size_t chain_size =
+        mipgen_chain_size(request->layer_width, request->layer_height);
+    texture_cache_count(request->slot_cache[i], chain_size);
+    texture_quality_count(
+        mipgen_chain_size(ARRAYTEX_IMAGE_WIDTH, ARRAYTEX_IMAGE_HEIGHT),
+        chain_size);
   }
 
-  return valid;
+  texture_residency_loaded(&request->residency, i, !failed);
+  if (failed) {
+    _fill_arraytex_layer(request, i);
+  } else {
+    ++request->loaded_layers;
+  }
+  request->dirty_layers |= 1u << i;
+  _arraytex_try_finish(request);
 }
 
-static void cubemap_fetch_callback(const sfetch_response_t* response) {
-  _cubemap_request_instance_t req_inst =
-      *(_cubemap_request_instance_t*)response->user_data;
-  _cubemap_request_t* request = req_inst.request;
+// Starts loading the materials touched this frame that aren't resident,
+// call once per frame after the touches. Each material is a group of one,
+// so slots finish independently and as many load at once as there are
+// free slots.
+static void arraytex_stream(_arraytex_request_t* request) {
+  if (!request->streaming) {
+    return;
+  }
+  int material, slot;
+  if (request->pack_layers) {
+    // copies finish right away, all of the frame's misses load at once
+    bool loaded = false;
+    while (
+        texture_residency_next_load(&request->residency, &material, &slot)) {
+      for (int mip = 0; mip < request->num_mips; mip++) {
+        memcpy(_arraytex_layer(request, mip, slot),
+               _arraytex_pack_layer(request, mip, material),
+               _arraytex_level_size(request, mip));
+      }
+      texture_residency_loaded(&request->residency, slot, true);
+      ++request->loaded_layers;
+      request->dirty_layers |= 1u << slot;
+      loaded = true;
+    }
+    if (loaded) {
+      _arraytex_try_finish(request);
+    }
+    return;
+  }
+  while (load_group_available() &&
+         texture_residency_next_load(&request->residency, &material, &slot)) {
+    request->slots[slot] = (_arraytex_slot_t){.request = request, .slot = slot};
+    request->slot_groups[slot] =
+        load_group_start(&(load_group_desc_t){
+            .assets = &request->assets[material],
+            .num_assets = 1,
+            .decode_cb = _decode_arraytex_layer,
+            .done_cb = _arraytex_layer_loaded,
+            .user_data = &request->slots[slot]});
+  }
+}
 
-  if (response->fetched) {
-    request->fetched_sizes[req_inst.index] = response->fetched_size;
-    ++request->finished_requests;
-  } else if (response->failed) {
-    request->failed = true;
-    ++request->finished_requests;
+static void arraytex_shutdown(_arraytex_request_t* request) {
+  free(request->texture_buffer_ptr);
+  request->texture_buffer_ptr = NULL;
+  free(request->pack_layers);
+  request->pack_layers = NULL;
+  gl_delete_texture(request->gl_texture);
+  request->gl_texture = 0;
+}
+
+// A face's level 0 followed by its mip chain.
+static uint8_t* _cubemap_face(const _cubemap_request_t* request, int face) {
+  return request->staging +
+         face * mipgen_chain_size(request->face_width, request->face_height);
+}
+
+static void _cubemap_face_levels(const _cubemap_request_t* request,
+                                 int face,
+                                 uint8_t** levels) {
+  levels[0] = _cubemap_face(request, face);
+  for (int mip = 1; mip < request->num_mips; mip++) {
+    levels[mip] = levels[mip - 1] + mipgen_level_size(request->face_width,
+                                                      request->face_height,
+                                                      mip - 1);
+  }
+}
+
+// Runs on a job pool worker, see _decode_arraytex_layer().
+static bool _decode_cubemap_face(load_group_t* group,
+                                 int face,
+                                 const asset_t* asset) {
+  _cubemap_request_t* request = (_cubemap_request_t*)group->desc.user_data;
+  uint8_t* levels[MIPGEN_MAX_LEVELS];
+  _cubemap_face_levels(request, face, levels);
+  const uint64_t key =
+      texture_cache_key(asset->data, asset->size, request->dropped_mips);
+  if (texture_cache_load(key, request->face_width, request->face_height,
+                         request->num_mips, levels)) {
+    request->face_cache[face] = TEXTURE_CACHE_HIT;
+    return true;
+  }
+  request->face_cache[face] =
+      texture_cache_enabled() ? TEXTURE_CACHE_MISS : TEXTURE_CACHE_OFF;
+
+  if (!_decode_chain(asset, request->source_width, request->source_height,
+                     request->dropped_mips, levels, request->num_mips)) {
+    return false;
   }
+  texture_cache_store(key, request->face_width, request->face_height,
+                      request->num_mips, levels);
+  return true;
+}
 
-  if (request->finished_requests == 6) {
-    if (!request->failed) {
-      request->failed = !_load_cubemap(request);
+static void _load_cubemap(_cubemap_request_t* request) {
+  sg_image_data img_data = {0};
+  for (int i = 0; i < 6; i++) {
+    uint8_t* levels[MIPGEN_MAX_LEVELS];
+    _cubemap_face_levels(request, i, levels);
+    for (int mip = 0; mip < request->num_mips; mip++) {
+      img_data.subimage[i][mip].ptr = levels[mip];
+      img_data.subimage[i][mip].size = mipgen_level_size(
+          request->face_width, request->face_height, mip);
     }
+  }
+  sg_init_image(request->img_id,
+                &(sg_image_desc){.type = SG_IMAGETYPE_CUBE,
+                                 .width = request->face_width,
+                                 .height = request->face_height,
+                                 .num_mipmaps = request->num_mips,
+                                 .pixel_format = SG_PIXELFORMAT_RGBA8,
+                                 .wrap_u = SG_WRAP_CLAMP_TO_EDGE,
+                                 .wrap_v = SG_WRAP_CLAMP_TO_EDGE,
+                                 .wrap_w = SG_WRAP_CLAMP_TO_EDGE,
+                                 .min_filter = SG_FILTER_LINEAR_MIPMAP_LINEAR,
+                                 .mag_filter = SG_FILTER_LINEAR,
+                                 .data = img_data,
+                                 .label = "cubemap-image"});
+}
 
-    if (request->failed) {
-      request->fail_callback();
-    } else {
-      request->success_callback();
+// Upload queue callback, creates the image and releases the staging.
+static void _cubemap_upload(void* data) {
+  _cubemap_request_t* request = (_cubemap_request_t*)data;
+  _load_cubemap(request);
+  buffer_pool_free(request->staging);
+  request->staging = NULL;
+  request->success_callback();
+}
+
+// Queues the image's upload once all faces are fetched and decoded.
+static void _cubemap_loaded(load_group_t* group, bool failed) {
+  _cubemap_request_t* request = (_cubemap_request_t*)group->desc.user_data;
+  if (failed) {
+    buffer_pool_free(request->staging);
+    request->staging = NULL;
+    request->fail_callback();
+    return;
+  }
+  const size_t chain_size =
+      mipgen_chain_size(request->face_width, request->face_height);
+  for (int i = 0; i < 6; i++) {
+    texture_cache_count(request->face_cache[i], chain_size);
+  }
+  texture_quality_count(
+      6 * mipgen_chain_size(request->source_width, request->source_height),
+      6 * chain_size);
+  const upload_desc_t upload = {.priority = request->upload_priority,
+                                .size = 6 * chain_size,
+                                .upload_cb = _cubemap_upload,
+                                .user_data = request};
+  if (!upload_queue_submit(&upload)) {
+    _cubemap_upload(request);
+    upload_queue_account(upload.priority, upload.size);
+  }
+}
+
+// Sizes the staging buffer from the first face's header and the texture
+// quality, all other faces must match it.
+static bool _cubemap_check_face(load_group_t* group,
+                                int face,
+                                const asset_t* asset) {
+  (void)face;
+  _cubemap_request_t* request = (_cubemap_request_t*)group->desc.user_data;
+  int img_width, img_height;
+  if (!image_decode_info(asset->data, asset->size, &img_width, &img_height)) {
+    return false;
+  }
+  if (!request->staging) {
+    request->source_width = img_width;
+    request->source_height = img_height;
+    request->dropped_mips = texture_quality_levels(
+        img_width, img_height, mipgen_num_levels(img_width, img_height));
+    request->face_width = mipgen_level_dim(img_width, request->dropped_mips);
+    request->face_height = mipgen_level_dim(img_height, request->dropped_mips);
+    request->num_mips =
+        mipgen_num_levels(request->face_width, request->face_height);
+    if (request->num_mips > SG_MAX_MIPMAPS) {
+      request->num_mips = SG_MAX_MIPMAPS;
     }
+    request->staging = (uint8_t*)buffer_pool_alloc(
+        6 * mipgen_chain_size(request->face_width, request->face_height));
+    return request->staging != NULL;
   }
+  return img_width == request->source_width &&
+         img_height == request->source_height;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,45 @@
+#ifndef ASSET_PACK_FORMAT_H
+#define ASSET_PACK_FORMAT_H
+
+/*
+  File format of the asset pack, an archive of the runtime's files written
+  by the assetpacker tool and read by asset_io.h.
+
+  Layout:
+    asset_pack_header_t
+    asset_pack_entry_t[num_entries]   the table of contents
+    file data, each file 16-byte aligned
+
+  Files are stored unmodified under their base name, which is the path the
+  runtime requests them by, optionally behind their manifest's prefix. All
+  offsets are relative to the start of the file, everything is little
+  endian.
+*/
+#include <stdint.h>
+
+#define ASSET_PACK_MAGIC (0x50415848)  // 'HXAP'
+#define ASSET_PACK_VERSION (1)
+#define ASSET_PACK_NAME_SIZE (64)
+#define ASSET_PACK_MAX_ENTRIES (64)
+#define ASSET_PACK_ALIGN (16)
+
+typedef struct asset_pack_header_t {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_entries;
+  uint32_t file_size;
+} asset_pack_header_t;
+
+typedef struct asset_pack_entry_t {
+  char name[ASSET_PACK_NAME_SIZE];
+  uint32_t offset;
+  uint32_t size;
+} asset_pack_entry_t;
+
+// Bytes of the header and table of contents.
+static uint32_t asset_pack_toc_size(uint32_t num_entries) {
+  return (uint32_t)(sizeof(asset_pack_header_t) +
+                    num_entries * sizeof(asset_pack_entry_t));
+}
+
+#endif  // ASSET_PACK_FORMAT_H
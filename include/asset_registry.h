@@ -0,0 +1,349 @@
+#ifndef ASSET_REGISTRY_H
+#define ASSET_REGISTRY_H
+
+/*
+  Runtime registry of the app's asset files, driven by the
+  data/..._assets.yml manifests.
+
+  Manifests are fetched first, each one registers its cook surface's files
+  as assets with the manifest's priority, named by the manifest's prefix
+  and the file name. Every asset has a state and
+  timestamps for when it was requested, sent, fetched and done.
+
+  Priorities map to sfetch channels, and a priority class is only sent
+  once every higher priority asset has been fetched: terrain layers go
+  first, then the skybox faces, then decorative files like the favicon.
+
+  asset_registry_fetch() calls back once the file is in memory (state
+  FETCHED) or failed (state FAILED). After a FETCHED callback the consumer
+  owns the data until it calls asset_registry_done(), which frees it and
+  records whether the asset made it.
+
+  Requests are queued and sent from asset_registry_dowork() or when a
+  fetch finishes, at most ASSET_REGISTRY_MAX_IN_FLIGHT at a time so bulk
+  loads keep every lane busy without running out of sfetch requests.
+  Main thread only, callbacks run from sfetch_dowork() or
+  job_pool_dowork().
+*/
+#include "sokol_fetch.h"
+#include "sokol_time.h"
+#include "asset_io.h"
+#include "asset_yml.h"
+#include "buffer_pool.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define ASSET_REGISTRY_MAX_ASSETS (64)
+#define ASSET_REGISTRY_MAX_MANIFESTS (8)
+#define ASSET_REGISTRY_NAME_SIZE (64)
+// sfetch_setup() needs at least this many max_requests
+#define ASSET_REGISTRY_MAX_IN_FLIGHT (32)
+
+typedef enum asset_priority {
+  ASSET_PRIORITY_TERRAIN,
+  ASSET_PRIORITY_SKYBOX,
+  ASSET_PRIORITY_DECORATIVE,
+  ASSET_PRIORITY_NUM
+} asset_priority;
+
+typedef enum asset_state {
+  ASSET_STATE_NONE,     // registered, not requested
+  ASSET_STATE_QUEUED,   // waiting for higher priorities
+  ASSET_STATE_FETCHING,
+  ASSET_STATE_FETCHED,  // data in memory, owned by the consumer
+  ASSET_STATE_READY,
+  ASSET_STATE_FAILED,
+} asset_state;
+
+struct asset_t;
+typedef void (*asset_fetched_cb_t)(struct asset_t* asset, void* user_data);
+
+typedef struct asset_t {
+  char name[ASSET_REGISTRY_NAME_SIZE];
+  asset_priority priority;
+  asset_state state;
+  uint8_t* data;
+  uint32_t size;
+  // stm ticks, 0 until reached
+  uint64_t queued_time;
+  uint64_t sent_time;
+  uint64_t fetched_time;
+  uint64_t done_time;
+  asset_fetched_cb_t fetched_cb;
+  void* user_data;
+} asset_t;
+
+typedef struct asset_manifest_t {
+  char name[ASSET_YML_MAX_STR];  // of the cook surface
+  char type[ASSET_YML_MAX_STR];
+  asset_priority priority;
+  int num_assets;
+  int assets[ASSET_YML_MAX_FILES];  // in cook order
+} asset_manifest_t;
+
+static struct {
+  int num_assets;
+  asset_t assets[ASSET_REGISTRY_MAX_ASSETS];
+  int num_manifests;
+  asset_manifest_t manifests[ASSET_REGISTRY_MAX_MANIFESTS];
+  int pending_manifests;
+  void (*manifests_cb)(void);
+} _asset_registry;
+
+static const char* asset_priority_name(asset_priority priority) {
+  switch (priority) {
+    case ASSET_PRIORITY_TERRAIN:
+      return "terrain";
+    case ASSET_PRIORITY_SKYBOX:
+      return "skybox";
+    default:
+      return "decorative";
+  }
+}
+
+static const char* asset_state_name(asset_state state) {
+  switch (state) {
+    case ASSET_STATE_QUEUED:
+      return "queued";
+    case ASSET_STATE_FETCHING:
+      return "fetching";
+    case ASSET_STATE_FETCHED:
+      return "decoding";
+    case ASSET_STATE_READY:
+      return "ready";
+    case ASSET_STATE_FAILED:
+      return "failed";
+    default:
+      return "-";
+  }
+}
+
+// One sfetch channel per priority, sfetch_setup() needs at least
+// ASSET_PRIORITY_NUM channels.
+static uint32_t asset_priority_channel(asset_priority priority) {
+  return (uint32_t)priority;
+}
+
+static asset_priority _asset_registry_parse_priority(const char* str) {
+  for (int i = 0; i < ASSET_PRIORITY_NUM; ++i) {
+    if (strcmp(str, asset_priority_name((asset_priority)i)) == 0) {
+      return (asset_priority)i;
+    }
+  }
+  return ASSET_PRIORITY_DECORATIVE;
+}
+
+static asset_t* asset_registry_get(int id) {
+  return &_asset_registry.assets[id];
+}
+
+static int asset_registry_id(const asset_t* asset) {
+  return (int)(asset - _asset_registry.assets);
+}
+
+static int asset_registry_num_assets(void) {
+  return _asset_registry.num_assets;
+}
+
+// Registers the file `name` and returns its id, or -1 when the registry is
+// full. Names that are already registered keep their id and the higher of
+// both priorities.
+static int asset_registry_add(const char* name, asset_priority priority) {
+  for (int i = 0; i < _asset_registry.num_assets; ++i) {
+    asset_t* asset = &_asset_registry.assets[i];
+    if (strcmp(asset->name, name) == 0) {
+      if (priority < asset->priority) {
+        asset->priority = priority;
+      }
+      return i;
+    }
+  }
+  if (_asset_registry.num_assets == ASSET_REGISTRY_MAX_ASSETS ||
+      strlen(name) >= ASSET_REGISTRY_NAME_SIZE) {
+    return -1;
+  }
+  const int id = _asset_registry.num_assets++;
+  asset_t* asset = &_asset_registry.assets[id];
+  memset(asset, 0, sizeof(*asset));
+  strcpy(asset->name, name);
+  asset->priority = priority;
+  return id;
+}
+
+static void _asset_registry_dispatch(void);
+
+static void _asset_registry_fetch_callback(const sfetch_response_t* response) {
+  fetch_bind_pool_buffer(response);
+  if (!response->fetched && !response->failed) {
+    return;
+  }
+  asset_t* asset = asset_registry_get(*(int*)response->user_data);
+  asset->fetched_time = stm_now();
+  if (response->fetched) {
+    asset->state = ASSET_STATE_FETCHED;
+    asset->data = (uint8_t*)response->buffer_ptr;
+    asset->size = response->fetched_size;
+  } else {
+    buffer_pool_free(response->buffer_ptr);
+    asset->state = ASSET_STATE_FAILED;
+    asset->done_time = asset->fetched_time;
+  }
+  asset->fetched_cb(asset, asset->user_data);
+  _asset_registry_dispatch();
+}
+
+// Highest priority that may be sent: none of the higher ones is still
+// waiting for its file.
+static asset_priority _asset_registry_open_priority(void) {
+  asset_priority open = ASSET_PRIORITY_DECORATIVE;
+  for (int i = 0; i < _asset_registry.num_assets; ++i) {
+    const asset_t* asset = &_asset_registry.assets[i];
+    if ((asset->state == ASSET_STATE_QUEUED ||
+         asset->state == ASSET_STATE_FETCHING) &&
+        asset->priority < open) {
+      open = asset->priority;
+    }
+  }
+  return open;
+}
+
+static void _asset_registry_dispatch(void) {
+  const asset_priority open = _asset_registry_open_priority();
+  int in_flight = 0;
+  for (int i = 0; i < _asset_registry.num_assets; ++i) {
+    in_flight += _asset_registry.assets[i].state == ASSET_STATE_FETCHING;
+  }
+  for (int i = 0; i < _asset_registry.num_assets &&
+                  in_flight < ASSET_REGISTRY_MAX_IN_FLIGHT;
+       ++i) {
+    asset_t* asset = &_asset_registry.assets[i];
+    if (asset->state != ASSET_STATE_QUEUED || asset->priority > open) {
+      continue;
+    }
+    ++in_flight;
+    asset->state = ASSET_STATE_FETCHING;
+    asset->sent_time = stm_now();
+    asset_io_send(&(sfetch_request_t){
+        .channel = asset_priority_channel(asset->priority),
+        .path = asset->name,
+        .callback = _asset_registry_fetch_callback,
+        .user_data_ptr = &i,
+        .user_data_size = sizeof(i)});
+  }
+}
+
+// Queues the asset's file, `fetched_cb` is called once with the asset in
+// the FETCHED or FAILED state.
+static void asset_registry_fetch(int id,
+                                 asset_fetched_cb_t fetched_cb,
+                                 void* user_data) {
+  asset_t* asset = asset_registry_get(id);
+  asset->state = ASSET_STATE_QUEUED;
+  asset->data = NULL;
+  asset->size = 0;
+  asset->queued_time = stm_now();
+  asset->sent_time = asset->fetched_time = asset->done_time = 0;
+  asset->fetched_cb = fetched_cb;
+  asset->user_data = user_data;
+}
+
+// Sends the queued assets whose priority is open. Call once per frame
+// next to sfetch_dowork(), so everything requested during a frame is
+// ordered by priority and not by call order.
+static void asset_registry_dowork(void) {
+  _asset_registry_dispatch();
+}
+
+// Releases a FETCHED asset's data once it's consumed.
+static void asset_registry_done(int id, bool ok) {
+  asset_t* asset = asset_registry_get(id);
+  buffer_pool_free(asset->data);
+  asset->data = NULL;
+  asset->state = ok ? ASSET_STATE_READY : ASSET_STATE_FAILED;
+  asset->done_time = stm_now();
+}
+
+static int asset_registry_num_manifests(void) {
+  return _asset_registry.num_manifests;
+}
+
+static const asset_manifest_t* asset_registry_manifest(int index) {
+  return &_asset_registry.manifests[index];
+}
+
+// Manifest whose cook surface is called `name`.
+static const asset_manifest_t* asset_registry_find_manifest(const char* name) {
+  for (int i = 0; i < _asset_registry.num_manifests; ++i) {
+    if (strcmp(_asset_registry.manifests[i].name, name) == 0) {
+      return &_asset_registry.manifests[i];
+    }
+  }
+  return NULL;
+}
+
+static bool _asset_registry_add_manifest(asset_manifest_t* manifest,
+                                         const asset_t* file) {
+  static asset_yml_t yml;
+  if (!asset_yml_parse(&yml, (const char*)file->data, file->size,
+                       file->name)) {
+    return false;
+  }
+  snprintf(manifest->name, sizeof(manifest->name), "%s", yml.cook_name);
+  snprintf(manifest->type, sizeof(manifest->type), "%s", yml.cook_type);
+  manifest->priority = _asset_registry_parse_priority(yml.priority);
+  for (int i = 0; i < yml.num_cook_files; ++i) {
+    char name[ASSET_REGISTRY_NAME_SIZE];
+    if (snprintf(name, sizeof(name), "%s%s", yml.prefix, yml.cook_files[i]) >=
+        (int)sizeof(name)) {
+      return false;
+    }
+    const int id = asset_registry_add(name, manifest->priority);
+    if (id < 0) {
+      return false;
+    }
+    manifest->assets[manifest->num_assets++] = id;
+  }
+  return true;
+}
+
+// `user_data` is the manifest's slot, they keep the order they were
+// requested in.
+static void _asset_registry_manifest_fetched(asset_t* asset, void* user_data) {
+  asset_manifest_t* manifest = (asset_manifest_t*)user_data;
+  if (asset && asset->state == ASSET_STATE_FETCHED) {
+    const bool ok = _asset_registry_add_manifest(manifest, asset);
+    if (!ok) {
+      memset(manifest, 0, sizeof(*manifest));
+    }
+    asset_registry_done(asset_registry_id(asset), ok);
+  }
+  if (--_asset_registry.pending_manifests == 0) {
+    _asset_registry.manifests_cb();
+  }
+}
+
+// Fetches and parses the manifests, `loaded_cb` is called once all of them
+// are registered. Missing manifests are marked FAILED and stay empty.
+static void asset_registry_load_manifests(const char** paths,
+                                          int count,
+                                          void (*loaded_cb)(void)) {
+  _asset_registry.manifests_cb = loaded_cb;
+  _asset_registry.pending_manifests = 1;
+  for (int i = 0; i < count &&
+                  _asset_registry.num_manifests < ASSET_REGISTRY_MAX_MANIFESTS;
+       ++i) {
+    // manifests gate everything else, they go first
+    const int id = asset_registry_add(paths[i], ASSET_PRIORITY_TERRAIN);
+    if (id >= 0) {
+      asset_manifest_t* manifest =
+          &_asset_registry.manifests[_asset_registry.num_manifests++];
+      memset(manifest, 0, sizeof(*manifest));
+      ++_asset_registry.pending_manifests;
+      asset_registry_fetch(id, _asset_registry_manifest_fetched, manifest);
+    }
+  }
+  // the extra count keeps callbacks during the loop from finishing early
+  _asset_registry_manifest_fetched(NULL, NULL);
+}
+
+#endif  // ASSET_REGISTRY_H
@@ -0,0 +1,189 @@
+#ifndef ASSET_YML_H
+#define ASSET_YML_H
+
+/*
+  Reader for the data/..._assets.yml files, shared by the asset tools and
+  the runtime asset registry. Only understands the subset of YAML they
+  use: top level sections, `key: value` pairs and `- item` lists one level
+  below them, quoted or plain scalars and # comments.
+
+    options:            src_dir, relative to the .yml file, the load
+                        priority (terrain, skybox or decorative) and an
+                        optional prefix for the files' runtime names, to
+                        tell apart sets with the same file names
+    files:              deployed as loose files by fipsutil_copy
+    cook:               surface built from the files, cooked offline by
+                        the texture cooker and loaded by the runtime
+      name: 'arraytex'
+      type: 'array'     2d, cube or array
+      preview: 64       optional, also cook a small RGBA8 copy of at most
+                        this many texels into the preview pack
+      files:            one per face/slice, cubemaps in +X -X +Y -Y +Z -Z
+        - 'grass.png'
+*/
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ASSET_YML_MAX_FILES (32)
+#define ASSET_YML_MAX_STR (256)
+
+typedef struct asset_yml_t {
+  char src_dir[ASSET_YML_MAX_STR];
+  char priority[ASSET_YML_MAX_STR];
+  char prefix[ASSET_YML_MAX_STR];
+  int num_files;
+  char files[ASSET_YML_MAX_FILES][ASSET_YML_MAX_STR];
+  char cook_name[ASSET_YML_MAX_STR];
+  char cook_type[ASSET_YML_MAX_STR];
+  int cook_preview;
+  int num_cook_files;
+  char cook_files[ASSET_YML_MAX_FILES][ASSET_YML_MAX_STR];
+} asset_yml_t;
+
+static char* _asset_yml_trim(char* str) {
+  while (*str == ' ' || *str == '\t') {
+    ++str;
+  }
+  size_t len = strlen(str);
+  while (len > 0 && (str[len - 1] == ' ' || str[len - 1] == '\t' ||
+                     str[len - 1] == '\r' || str[len - 1] == '\n')) {
+    str[--len] = 0;
+  }
+  return str;
+}
+
+static void _asset_yml_scalar(char* dst, const char* src) {
+  char* value = _asset_yml_trim((char*)src);
+  size_t len = strlen(value);
+  if (len >= 2 && (value[0] == '\'' || value[0] == '"') &&
+      value[len - 1] == value[0]) {
+    ++value;
+    len -= 2;
+  }
+  if (len >= ASSET_YML_MAX_STR) {
+    len = ASSET_YML_MAX_STR - 1;
+  }
+  memcpy(dst, value, len);
+  dst[len] = 0;
+}
+
+static bool _asset_yml_push(char (*list)[ASSET_YML_MAX_STR],
+                            int* count,
+                            const char* value) {
+  if (*count == ASSET_YML_MAX_FILES) {
+    return false;
+  }
+  _asset_yml_scalar(list[(*count)++], value);
+  return true;
+}
+
+// Parses `size` bytes of yml text, `name` is only used for error messages.
+static bool asset_yml_parse(asset_yml_t* yml,
+                            const char* text,
+                            size_t size,
+                            const char* name) {
+  memset(yml, 0, sizeof(*yml));
+  char section[64] = {0};
+  char key[64] = {0};
+  char line[1024];
+  bool ok = true;
+  size_t pos = 0;
+  while (ok && pos < size) {
+    size_t len = 0;
+    while (pos < size && text[pos] != '\n') {
+      if (len < sizeof(line) - 1) {
+        line[len++] = text[pos];
+      }
+      ++pos;
+    }
+    ++pos;
+    line[len] = 0;
+    const bool indented = line[0] == ' ' || line[0] == '\t';
+    char* str = _asset_yml_trim(line);
+    if (str[0] == 0 || str[0] == '#' || strcmp(str, "---") == 0) {
+      continue;
+    }
+    if (str[0] == '-') {
+      // list item of the current section or key
+      if (strcmp(section, "files") == 0) {
+        ok = _asset_yml_push(yml->files, &yml->num_files, str + 1);
+      } else if (strcmp(section, "cook") == 0 && strcmp(key, "files") == 0) {
+        ok = _asset_yml_push(yml->cook_files, &yml->num_cook_files, str + 1);
+      }
+      if (!ok) {
+        fprintf(stderr, "%s: more than %d files\n", name, ASSET_YML_MAX_FILES);
+      }
+      continue;
+    }
+    char* colon = strchr(str, ':');
+    if (!colon) {
+      fprintf(stderr, "%s: can't parse '%s'\n", name, str);
+      ok = false;
+      break;
+    }
+    *colon = 0;
+    const char* value = colon + 1;
+    if (!indented) {
+      _asset_yml_scalar(section, str);
+      key[0] = 0;
+      continue;
+    }
+    _asset_yml_scalar(key, str);
+    if (strcmp(section, "options") == 0 && strcmp(key, "src_dir") == 0) {
+      _asset_yml_scalar(yml->src_dir, value);
+    } else if (strcmp(section, "options") == 0 &&
+               strcmp(key, "priority") == 0) {
+      _asset_yml_scalar(yml->priority, value);
+    } else if (strcmp(section, "options") == 0 && strcmp(key, "prefix") == 0) {
+      _asset_yml_scalar(yml->prefix, value);
+    } else if (strcmp(section, "cook") == 0 && strcmp(key, "name") == 0) {
+      _asset_yml_scalar(yml->cook_name, value);
+    } else if (strcmp(section, "cook") == 0 && strcmp(key, "type") == 0) {
+      _asset_yml_scalar(yml->cook_type, value);
+    } else if (strcmp(section, "cook") == 0 && strcmp(key, "preview") == 0) {
+      char preview[ASSET_YML_MAX_STR];
+      _asset_yml_scalar(preview, value);
+      yml->cook_preview = atoi(preview);
+    }
+  }
+  return ok;
+}
+
+static bool asset_yml_load(asset_yml_t* yml, const char* path) {
+  memset(yml, 0, sizeof(*yml));
+  FILE* fp = fopen(path, "rb");
+  if (!fp) {
+    fprintf(stderr, "%s: can't open\n", path);
+    return false;
+  }
+  static char text[64 * 1024];
+  const size_t size = fread(text, 1, sizeof(text), fp);
+  const bool complete = feof(fp) != 0;
+  fclose(fp);
+  if (!complete) {
+    fprintf(stderr, "%s: larger than %d bytes\n", path, (int)sizeof(text));
+    return false;
+  }
+  return asset_yml_parse(yml, text, size, path);
+}
+
+// Path of a source file, relative to the .yml's directory like src_dir.
+static void asset_yml_source_path(char* dst,
+                                  size_t dst_size,
+                                  const char* yml_path,
+                                  const asset_yml_t* yml,
+                                  const char* file) {
+  const char* slash = strrchr(yml_path, '/');
+#if defined(_WIN32)
+  const char* backslash = strrchr(yml_path, '\\');
+  if (backslash && (!slash || backslash > slash)) {
+    slash = backslash;
+  }
+#endif
+  const int dir_len = slash ? (int)(slash - yml_path) + 1 : 0;
+  snprintf(dst, dst_size, "%.*s%s%s", dir_len, yml_path, yml->src_dir, file);
+}
+
+#endif  // ASSET_YML_H
@@ -0,0 +1,119 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+/*
+  Recycling pool for the transient buffers of asset loading: fetched files
+  waiting to be decoded and the staging memory of decoded images.
+
+  Buffers are allocated with exactly the requested size. Released buffers
+  are kept in a small free list and handed out again to requests that fit
+  without wasting more than a quarter of the buffer, everything else gets a
+  fresh allocation. buffer_pool_trim() returns the cached buffers to the
+  system once loading is over.
+
+  Not thread safe, only call from the main thread (fetch callbacks and job
+  pool done callbacks run there). Workers may read and write a buffer they
+  were given, but never allocate or free.
+*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define BUFFER_POOL_MAX_FREE (16)
+// keeps the payload 16-byte aligned for the SSE2 paths
+#define BUFFER_POOL_HEADER_SIZE (16)
+
+typedef struct buffer_pool_stats_t {
+  size_t live_bytes;    // handed out and not yet returned
+  size_t peak_bytes;    // high water mark of live_bytes
+  size_t cached_bytes;  // returned and kept for reuse
+  uint32_t hits;        // allocations served from the free list
+  uint32_t misses;      // allocations that went to malloc
+} buffer_pool_stats_t;
+
+static struct {
+  uint8_t* free[BUFFER_POOL_MAX_FREE];
+  int num_free;
+  buffer_pool_stats_t stats;
+} _buffer_pool;
+
+static size_t _buffer_pool_capacity(const uint8_t* block) {
+  return *(const size_t*)block;
+}
+
+static void _buffer_pool_remove_free(int index) {
+  _buffer_pool.stats.cached_bytes -=
+      _buffer_pool_capacity(_buffer_pool.free[index]);
+  _buffer_pool.free[index] = _buffer_pool.free[--_buffer_pool.num_free];
+}
+
+// Returns a buffer of at least `size` bytes, or NULL if out of memory.
+static void* buffer_pool_alloc(size_t size) {
+  int best = -1;
+  for (int i = 0; i < _buffer_pool.num_free; ++i) {
+    const size_t capacity = _buffer_pool_capacity(_buffer_pool.free[i]);
+    if (capacity >= size && capacity - size <= capacity / 4 &&
+        (best < 0 ||
+         capacity < _buffer_pool_capacity(_buffer_pool.free[best]))) {
+      best = i;
+    }
+  }
+  uint8_t* block;
+  if (best >= 0) {
+    block = _buffer_pool.free[best];
+    _buffer_pool_remove_free(best);
+    ++_buffer_pool.stats.hits;
+  } else {
+    block = (uint8_t*)malloc(BUFFER_POOL_HEADER_SIZE + size);
+    if (!block) {
+      return NULL;
+    }
+    *(size_t*)block = size;
+    ++_buffer_pool.stats.misses;
+  }
+  _buffer_pool.stats.live_bytes += _buffer_pool_capacity(block);
+  if (_buffer_pool.stats.live_bytes > _buffer_pool.stats.peak_bytes) {
+    _buffer_pool.stats.peak_bytes = _buffer_pool.stats.live_bytes;
+  }
+  return block + BUFFER_POOL_HEADER_SIZE;
+}
+
+// Gives a buffer back to the pool, NULL is ignored. When the free list is
+// full the smallest cached buffer is released to make room.
+static void buffer_pool_free(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  uint8_t* block = (uint8_t*)ptr - BUFFER_POOL_HEADER_SIZE;
+  _buffer_pool.stats.live_bytes -= _buffer_pool_capacity(block);
+  if (_buffer_pool.num_free == BUFFER_POOL_MAX_FREE) {
+    int smallest = 0;
+    for (int i = 1; i < _buffer_pool.num_free; ++i) {
+      if (_buffer_pool_capacity(_buffer_pool.free[i]) <
+          _buffer_pool_capacity(_buffer_pool.free[smallest])) {
+        smallest = i;
+      }
+    }
+    uint8_t* victim = _buffer_pool.free[smallest];
+    _buffer_pool_remove_free(smallest);
+    free(victim);
+  }
+  _buffer_pool.free[_buffer_pool.num_free++] = block;
+  _buffer_pool.stats.cached_bytes += _buffer_pool_capacity(block);
+}
+
+// Releases all cached buffers, live buffers are not affected.
+static void buffer_pool_trim(void) {
+  for (int i = 0; i < _buffer_pool.num_free; ++i) {
+    free(_buffer_pool.free[i]);
+  }
+  _buffer_pool.num_free = 0;
+  _buffer_pool.stats.cached_bytes = 0;
+}
+
+static buffer_pool_stats_t buffer_pool_stats(void) {
+  return _buffer_pool.stats;
+}
+
+#endif  // BUFFER_POOL_H
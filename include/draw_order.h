@@ -0,0 +1,136 @@
+#ifndef DRAW_ORDER_H
+#define DRAW_ORDER_H
+
+#include "HandmadeMath/HandmadeMath.h"
+#include <stdint.h>
+#include <string.h>
+
+/*
+  Per-frame visibility and front-to-back ordering of instances.
+
+  Instances are culled against the view frustum as bounding spheres, then
+  sorted by view depth with a two-pass LSD radix sort on a 16-bit quantized
+  key. The caller owns all arrays; `scratch_keys` and `scratch_indices` must
+  hold `count` elements each, like `keys` and `indices`.
+*/
+typedef struct draw_order_t {
+  uint16_t* keys;
+  uint16_t* scratch_keys;
+  uint32_t* indices;
+  uint32_t* scratch_indices;
+  int capacity;
+} draw_order_t;
+
+typedef struct draw_order_frustum_t {
+  hmm_vec4 planes[6];
+} draw_order_frustum_t;
+
+static draw_order_frustum_t draw_order_frustum(hmm_mat4 viewproj) {
+  // Gribb/Hartmann plane extraction, HMM matrices are column-major
+  hmm_vec4 rows[4];
+  for (int i = 0; i < 4; ++i) {
+    rows[i] = HMM_Vec4(viewproj.Elements[0][i], viewproj.Elements[1][i],
+                       viewproj.Elements[2][i], viewproj.Elements[3][i]);
+  }
+  draw_order_frustum_t frustum;
+  frustum.planes[0] = HMM_AddVec4(rows[3], rows[0]);
+  frustum.planes[1] = HMM_SubtractVec4(rows[3], rows[0]);
+  frustum.planes[2] = HMM_AddVec4(rows[3], rows[1]);
+  frustum.planes[3] = HMM_SubtractVec4(rows[3], rows[1]);
+  frustum.planes[4] = HMM_AddVec4(rows[3], rows[2]);
+  frustum.planes[5] = HMM_SubtractVec4(rows[3], rows[2]);
+  for (int i = 0; i < 6; ++i) {
+    hmm_vec4 p = frustum.planes[i];
+    float len = HMM_LengthVec3(p.XYZ);
+    frustum.planes[i] = HMM_DivideVec4f(p, len);
+  }
+  return frustum;
+}
+
+static bool draw_order_sphere_visible(const draw_order_frustum_t* frustum,
+                                      hmm_vec3 center,
+                                      float radius) {
+  for (int i = 0; i < 6; ++i) {
+    hmm_vec4 p = frustum->planes[i];
+    if (HMM_DotVec3(p.XYZ, center) + p.W < -radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void _draw_order_radix_pass(const uint16_t* keys_in,
+                                   const uint32_t* indices_in,
+                                   uint16_t* keys_out,
+                                   uint32_t* indices_out,
+                                   int count,
+                                   int shift) {
+  uint32_t offsets[256] = {0};
+  for (int i = 0; i < count; ++i) {
+    ++offsets[(keys_in[i] >> shift) & 0xFF];
+  }
+  uint32_t sum = 0;
+  for (int i = 0; i < 256; ++i) {
+    uint32_t c = offsets[i];
+    offsets[i] = sum;
+    sum += c;
+  }
+  for (int i = 0; i < count; ++i) {
+    uint32_t dst = offsets[(keys_in[i] >> shift) & 0xFF]++;
+    keys_out[dst] = keys_in[i];
+    indices_out[dst] = indices_in[i];
+  }
+}
+
+// Culls `positions` against `viewproj` and writes the indices of visible
+// instances to order->indices, nearest first when `sort` is set and in
+// original order otherwise. Returns the number of visible instances.
+static int draw_order_build(draw_order_t* order,
+                            const hmm_vec3* positions,
+                            int count,
+                            float radius,
+                            hmm_mat4 viewproj,
+                            hmm_vec3 eye,
+                            hmm_vec3 forward,
+                            bool sort) {
+  const draw_order_frustum_t frustum = draw_order_frustum(viewproj);
+  if (count > order->capacity) {
+    count = order->capacity;
+  }
+
+  // depths are stashed in scratch_indices as raw float bits until quantized
+  float* depths = (float*)order->scratch_indices;
+  float min_depth = 0.0f, max_depth = 0.0f;
+  int visible = 0;
+  for (int i = 0; i < count; ++i) {
+    if (!draw_order_sphere_visible(&frustum, positions[i], radius)) {
+      continue;
+    }
+    float depth = HMM_DotVec3(HMM_SubtractVec3(positions[i], eye), forward);
+    if (visible == 0 || depth < min_depth) {
+      min_depth = depth;
+    }
+    if (visible == 0 || depth > max_depth) {
+      max_depth = depth;
+    }
+    order->indices[visible] = (uint32_t)i;
+    depths[visible] = depth;
+    ++visible;
+  }
+  if (!sort || visible < 2) {
+    return visible;
+  }
+
+  const float range = max_depth - min_depth;
+  const float scale = range > 0.0f ? 65535.0f / range : 0.0f;
+  for (int i = 0; i < visible; ++i) {
+    order->keys[i] = (uint16_t)((depths[i] - min_depth) * scale);
+  }
+  _draw_order_radix_pass(order->keys, order->indices, order->scratch_keys,
+                         order->scratch_indices, visible, 0);
+  _draw_order_radix_pass(order->scratch_keys, order->scratch_indices,
+                         order->keys, order->indices, visible, 8);
+  return visible;
+}
+
+#endif  // DRAW_ORDER_H
@@ -0,0 +1,141 @@
+#ifndef GL_TEXTURE_H
+#define GL_TEXTURE_H
+
+/*
+  Array textures whose layers can be uploaded one at a time, which
+  sg_update_image() can't: it takes every layer of every mip, and only
+  once per frame.
+
+  The texture is created here and handed to sokol-gfx as an injected
+  texture (sg_image_desc.gl_textures[0], SG_USAGE_IMMUTABLE without data),
+  sokol binds it like any other image but never writes to or deletes it.
+  The GL texture binding is restored after every call, so sokol's state
+  cache stays valid. Only where gl_util.h has direct GL access, elsewhere
+  gl_make_array_texture() returns 0 and the caller falls back to dynamic
+  images.
+*/
+#include <stddef.h>
+#include <stdint.h>
+#include "gl_util.h"
+#include "sokol_gfx.h"
+
+// The GL compressed internal format of a sokol block format, 0 for
+// anything else, which gl_make_array_texture() takes as RGBA8.
+static uint32_t gl_compressed_format(sg_pixel_format format) {
+  switch (format) {
+    case SG_PIXELFORMAT_BC1_RGBA:
+      return 0x83F1;  // GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+    case SG_PIXELFORMAT_BC3_RGBA:
+      return 0x83F3;  // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+    case SG_PIXELFORMAT_ETC2_RGB8:
+      return 0x9274;  // GL_COMPRESSED_RGB8_ETC2
+    default:
+      return 0;
+  }
+}
+
+// Creates a `num_layers` x `width` x `height` texture with `num_mips`
+// levels of undefined contents and linear mipmap filtering.
+// `compressed_format` is a GL compressed internal format, or 0 for RGBA8,
+// `level_sizes` are the bytes of one layer at each level.
+static uint32_t gl_make_array_texture(uint32_t compressed_format,
+                                      int width,
+                                      int height,
+                                      int num_layers,
+                                      int num_mips,
+                                      const size_t* level_sizes) {
+#if GL_UTIL_AVAILABLE
+  while (glGetError() != GL_NO_ERROR) {
+  }
+  GLint bound = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &bound);
+  GLuint texture = 0;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  for (int mip = 0; mip < num_mips; ++mip) {
+    const int w = width >> mip > 0 ? width >> mip : 1;
+    const int h = height >> mip > 0 ? height >> mip : 1;
+    if (compressed_format) {
+      glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, mip, compressed_format, w,
+                             h, num_layers, 0,
+                             (GLsizei)(level_sizes[mip] * num_layers), NULL);
+    } else {
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, mip, GL_RGBA8, w, h, num_layers, 0,
+                   GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+  }
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, num_mips - 1);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                  num_mips > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, (GLuint)bound);
+  if (glGetError() != GL_NO_ERROR) {
+    glDeleteTextures(1, &texture);
+    return 0;
+  }
+  return texture;
+#else
+  (void)compressed_format;
+  (void)width;
+  (void)height;
+  (void)num_layers;
+  (void)num_mips;
+  (void)level_sizes;
+  return 0;
+#endif
+}
+
+// Uploads every level of `layer`, `levels` and `level_sizes` per level as
+// for gl_make_array_texture().
+static void gl_update_array_layer(uint32_t texture,
+                                  uint32_t compressed_format,
+                                  int width,
+                                  int height,
+                                  int layer,
+                                  int num_mips,
+                                  const uint8_t* const* levels,
+                                  const size_t* level_sizes) {
+#if GL_UTIL_AVAILABLE
+  GLint bound = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &bound);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  for (int mip = 0; mip < num_mips; ++mip) {
+    const int w = width >> mip > 0 ? width >> mip : 1;
+    const int h = height >> mip > 0 ? height >> mip : 1;
+    if (compressed_format) {
+      glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, mip, 0, 0, layer, w, h,
+                                1, compressed_format,
+                                (GLsizei)level_sizes[mip], levels[mip]);
+    } else {
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, mip, 0, 0, layer, w, h, 1, GL_RGBA,
+                      GL_UNSIGNED_BYTE, levels[mip]);
+    }
+  }
+  glBindTexture(GL_TEXTURE_2D_ARRAY, (GLuint)bound);
+#else
+  (void)texture;
+  (void)compressed_format;
+  (void)width;
+  (void)height;
+  (void)layer;
+  (void)num_mips;
+  (void)levels;
+  (void)level_sizes;
+#endif
+}
+
+// Call after sg_destroy_image()/sg_uninit_image() of the image using it.
+static void gl_delete_texture(uint32_t texture) {
+#if GL_UTIL_AVAILABLE
+  GLuint name = texture;
+  if (name) {
+    glDeleteTextures(1, &name);
+  }
+#else
+  (void)texture;
+#endif
+}
+
+#endif  // GL_TEXTURE_H
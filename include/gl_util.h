@@ -0,0 +1,42 @@
+#ifndef GL_UTIL_H
+#define GL_UTIL_H
+
+/*
+  Direct GL access for the few debug/profiling features that sokol-gfx
+  doesn't expose (readback, timer queries). Only available when the
+  GLCORE33 backend is used on a platform where GL entry points can be
+  linked directly; everything else compiles these features out and
+  checks GL_UTIL_AVAILABLE at runtime.
+*/
+#if defined(SOKOL_GLCORE33) && defined(__linux__)
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#define GL_UTIL_AVAILABLE (1)
+#elif defined(SOKOL_GLCORE33) && defined(__APPLE__)
+#include <OpenGL/gl3.h>
+#define GL_UTIL_AVAILABLE (1)
+#else
+#define GL_UTIL_AVAILABLE (0)
+#endif
+
+#include <stdbool.h>
+
+// Reads back RGBA8 pixels from the framebuffer of the currently active
+// sokol-gfx pass. Must be called between sg_begin_*pass() and sg_end_pass().
+static bool gl_read_pixels_rgba8(int x, int y, int w, int h, void* dst) {
+#if GL_UTIL_AVAILABLE
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, dst);
+  return glGetError() == GL_NO_ERROR;
+#else
+  (void)x;
+  (void)y;
+  (void)w;
+  (void)h;
+  (void)dst;
+  return false;
+#endif
+}
+
+#endif  // GL_UTIL_H
@@ -0,0 +1,120 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+/*
+  Per-section GPU timings via GL_TIME_ELAPSED queries, next to the CPU time
+  spent submitting the same section.
+
+  Each section owns GPU_TIMER_LATENCY queries used round-robin, so a query
+  result is only read back GPU_TIMER_LATENCY - 1 frames after it was
+  issued, by which point it's normally available without stalling. Only
+  supported on the GLCORE33 backend (see gl_util.h); elsewhere only the
+  CPU times are measured.
+*/
+#include "sokol_gfx.h"
+#include "sokol_time.h"
+#include "gl_util.h"
+
+#define GPU_TIMER_LATENCY (4)
+
+typedef enum gpu_timer_section {
+  GPU_TIMER_TERRAIN,
+  GPU_TIMER_SKYBOX,
+  GPU_TIMER_UI,
+  GPU_TIMER_NUM
+} gpu_timer_section;
+
+typedef struct gpu_timer_t {
+  bool supported;
+  int slot;
+  uint64_t cpu_start[GPU_TIMER_NUM];
+  float cpu_ms[GPU_TIMER_NUM];
+  float gpu_ms[GPU_TIMER_NUM];
+  // readbacks that had to wait for the GPU
+  uint32_t stalls;
+#if GL_UTIL_AVAILABLE
+  GLuint queries[GPU_TIMER_LATENCY][GPU_TIMER_NUM];
+  bool issued[GPU_TIMER_LATENCY][GPU_TIMER_NUM];
+#endif
+} gpu_timer_t;
+
+static const char* gpu_timer_section_name(gpu_timer_section section) {
+  switch (section) {
+    case GPU_TIMER_TERRAIN:
+      return "Terrain";
+    case GPU_TIMER_SKYBOX:
+      return "Skybox";
+    case GPU_TIMER_UI:
+      return "UI";
+    default:
+      return "?";
+  }
+}
+
+// Call after sg_setup().
+static void gpu_timer_init(gpu_timer_t* timer) {
+  *timer = (gpu_timer_t){0};
+#if GL_UTIL_AVAILABLE
+  timer->supported = sg_query_backend() == SG_BACKEND_GLCORE33;
+  if (timer->supported) {
+    glGenQueries(GPU_TIMER_LATENCY * GPU_TIMER_NUM, &timer->queries[0][0]);
+  }
+#endif
+}
+
+static void gpu_timer_shutdown(gpu_timer_t* timer) {
+#if GL_UTIL_AVAILABLE
+  if (timer->supported) {
+    glDeleteQueries(GPU_TIMER_LATENCY * GPU_TIMER_NUM, &timer->queries[0][0]);
+  }
+#endif
+  timer->supported = false;
+}
+
+// Advances to the next query slot and collects the results that were
+// issued GPU_TIMER_LATENCY - 1 frames ago from it.
+static void gpu_timer_begin_frame(gpu_timer_t* timer) {
+  timer->slot = (timer->slot + 1) % GPU_TIMER_LATENCY;
+#if GL_UTIL_AVAILABLE
+  if (!timer->supported) {
+    return;
+  }
+  for (int i = 0; i < GPU_TIMER_NUM; ++i) {
+    if (!timer->issued[timer->slot][i]) {
+      continue;
+    }
+    const GLuint query = timer->queries[timer->slot][i];
+    GLint available = 0;
+    glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+      ++timer->stalls;
+    }
+    GLuint64 elapsed_ns = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed_ns);
+    timer->gpu_ms[i] = (float)((double)elapsed_ns / 1000000.0);
+    timer->issued[timer->slot][i] = false;
+  }
+#endif
+}
+
+// Sections must not overlap, GL_TIME_ELAPSED queries can't be nested.
+static void gpu_timer_begin(gpu_timer_t* timer, gpu_timer_section section) {
+  timer->cpu_start[section] = stm_now();
+#if GL_UTIL_AVAILABLE
+  if (timer->supported) {
+    glBeginQuery(GL_TIME_ELAPSED, timer->queries[timer->slot][section]);
+  }
+#endif
+}
+
+static void gpu_timer_end(gpu_timer_t* timer, gpu_timer_section section) {
+#if GL_UTIL_AVAILABLE
+  if (timer->supported) {
+    glEndQuery(GL_TIME_ELAPSED);
+    timer->issued[timer->slot][section] = true;
+  }
+#endif
+  timer->cpu_ms[section] = (float)stm_ms(stm_since(timer->cpu_start[section]));
+}
+
+#endif  // GPU_TIMER_H
@@ -0,0 +1,406 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+/*
+  Headless benchmark mode.
+
+  Instead of handing control to sokol_app, headless_run() creates an EGL
+  context without a window (EGL_MESA_platform_surfaceless, falling back to
+  a pbuffer), and drives the app's init/frame/cleanup callbacks itself for
+  a fixed number of frames. The app renders into an offscreen pass of a
+  fixed size (see headless_begin_pass()), which can be dumped to PNG files,
+  and per-frame CPU timings are written to a CSV file.
+
+  Only available with the GLCORE33 backend on Linux, works with Mesa's
+  llvmpipe software rasterizer on build machines without a display.
+*/
+#include "sokol_gfx.h"
+#include "sokol_time.h"
+#include "gl_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(SOKOL_GLCORE33) && defined(__linux__)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#define HEADLESS_AVAILABLE (1)
+#else
+#define HEADLESS_AVAILABLE (0)
+#endif
+
+#define HEADLESS_COLOR_FORMAT (SG_PIXELFORMAT_RGBA8)
+#define HEADLESS_DEPTH_FORMAT (SG_PIXELFORMAT_DEPTH_STENCIL)
+
+typedef void (*headless_csv_cb_t)(FILE* csv, bool header);
+
+typedef struct headless_desc_t {
+  int width;
+  int height;
+  int num_frames;
+  const char* png_dir;   // dump frames as PNG into this directory
+  int png_interval;      // dump every n-th frame (0: only the last frame)
+  const char* csv_path;  // per-frame timings
+  void (*init_cb)(void);
+  void (*frame_cb)(void);
+  void (*cleanup_cb)(void);
+  headless_csv_cb_t csv_cb;  // appends app-specific columns to each row
+} headless_desc_t;
+
+static struct {
+  bool enabled;
+  headless_desc_t desc;
+  int frame_index;
+  sg_image color_img;
+  sg_image depth_img;
+  sg_pass pass;
+  uint8_t* pixels;
+#if HEADLESS_AVAILABLE
+  EGLDisplay display;
+  EGLContext context;
+  EGLSurface surface;
+#endif
+} _headless;
+
+static bool headless_enabled(void) {
+  return _headless.enabled;
+}
+
+static int headless_width(void) {
+  return _headless.desc.width;
+}
+
+static int headless_height(void) {
+  return _headless.desc.height;
+}
+
+static sg_context_desc headless_sgcontext(void) {
+  return (sg_context_desc){.color_format = HEADLESS_COLOR_FORMAT,
+                           .depth_format = HEADLESS_DEPTH_FORMAT,
+                           .sample_count = 1};
+}
+
+// Parses --headless and its options, returns false if the app should run
+// normally through sokol_app.
+static bool headless_parse_args(int argc, char* argv[], headless_desc_t* desc) {
+  bool headless = false;
+  desc->width = 1280;
+  desc->height = 768;
+  desc->num_frames = 300;
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (strcmp(arg, "--headless") == 0) {
+      headless = true;
+    } else if (strncmp(arg, "--frames=", 9) == 0) {
+      desc->num_frames = atoi(arg + 9);
+    } else if (strncmp(arg, "--size=", 7) == 0) {
+      sscanf(arg + 7, "%dx%d", &desc->width, &desc->height);
+    } else if (strncmp(arg, "--png-dir=", 10) == 0) {
+      desc->png_dir = arg + 10;
+    } else if (strncmp(arg, "--png-every=", 12) == 0) {
+      desc->png_interval = atoi(arg + 12);
+    } else if (strncmp(arg, "--csv=", 6) == 0) {
+      desc->csv_path = arg + 6;
+    }
+  }
+  return headless;
+}
+
+/*  ====  PNG OUTPUT  ==== */
+static uint32_t _headless_crc32(uint32_t crc, const uint8_t* data, size_t len) {
+  static uint32_t table[256];
+  if (table[1] == 0) {
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      table[n] = c;
+    }
+  }
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static void _headless_put_u32be(uint8_t* dst, uint32_t v) {
+  dst[0] = (uint8_t)(v >> 24);
+  dst[1] = (uint8_t)(v >> 16);
+  dst[2] = (uint8_t)(v >> 8);
+  dst[3] = (uint8_t)v;
+}
+
+static void _headless_write_chunk(FILE* fp,
+                                  const char* type,
+                                  const uint8_t* data,
+                                  uint32_t len) {
+  uint8_t buf[8];
+  _headless_put_u32be(buf, len);
+  memcpy(buf + 4, type, 4);
+  fwrite(buf, 1, 8, fp);
+  if (len > 0) {
+    fwrite(data, 1, len, fp);
+  }
+  uint32_t crc = _headless_crc32(0, (const uint8_t*)type, 4);
+  crc = _headless_crc32(crc, data, len);
+  _headless_put_u32be(buf, crc);
+  fwrite(buf, 1, 4, fp);
+}
+
+// Writes bottom-up RGBA8 pixels (as read back from GL) as a PNG file, using
+// uncompressed deflate blocks; the frame dumps are for inspection only.
+static bool _headless_write_png(const char* path,
+                                int w,
+                                int h,
+                                const uint8_t* pixels) {
+  FILE* fp = fopen(path, "wb");
+  if (!fp) {
+    return false;
+  }
+  static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A,
+                                       '\n'};
+  fwrite(signature, 1, 8, fp);
+
+  uint8_t ihdr[13];
+  _headless_put_u32be(ihdr, (uint32_t)w);
+  _headless_put_u32be(ihdr + 4, (uint32_t)h);
+  ihdr[8] = 8;  // bit depth
+  ihdr[9] = 6;  // RGBA
+  ihdr[10] = ihdr[11] = ihdr[12] = 0;
+  _headless_write_chunk(fp, "IHDR", ihdr, sizeof(ihdr));
+
+  // raw scanlines with a 'none' filter byte, flipped to top-down
+  const size_t row_size = (size_t)w * 4 + 1;
+  const size_t raw_size = row_size * (size_t)h;
+  const size_t num_blocks = (raw_size + 0xFFFE) / 0xFFFF;
+  const size_t zlib_size = 2 + raw_size + num_blocks * 5 + 4;
+  uint8_t* raw = (uint8_t*)malloc(raw_size);
+  uint8_t* zlib = (uint8_t*)malloc(zlib_size);
+  for (int y = 0; y < h; y++) {
+    uint8_t* row = raw + (size_t)y * row_size;
+    row[0] = 0;
+    memcpy(row + 1, pixels + (size_t)(h - 1 - y) * (size_t)w * 4,
+           (size_t)w * 4);
+  }
+
+  uint32_t a = 1, b = 0;
+  for (size_t i = 0; i < raw_size; i++) {
+    a = (a + raw[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  uint8_t* dst = zlib;
+  *dst++ = 0x78;
+  *dst++ = 0x01;
+  for (size_t pos = 0; pos < raw_size; pos += 0xFFFF) {
+    const size_t len = (raw_size - pos) < 0xFFFF ? (raw_size - pos) : 0xFFFF;
+    *dst++ = (pos + len == raw_size) ? 1 : 0;
+    *dst++ = (uint8_t)len;
+    *dst++ = (uint8_t)(len >> 8);
+    *dst++ = (uint8_t)~len;
+    *dst++ = (uint8_t)(~len >> 8);
+    memcpy(dst, raw + pos, len);
+    dst += len;
+  }
+  _headless_put_u32be(dst, (b << 16) | a);
+  _headless_write_chunk(fp, "IDAT", zlib, (uint32_t)zlib_size);
+  _headless_write_chunk(fp, "IEND", NULL, 0);
+
+  free(zlib);
+  free(raw);
+  fclose(fp);
+  return true;
+}
+
+/*  ====  CONTEXT  ==== */
+#if HEADLESS_AVAILABLE
+static bool _headless_create_context(int width, int height) {
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+          "eglGetPlatformDisplayEXT");
+  _headless.display = EGL_NO_DISPLAY;
+  if (get_platform_display) {
+    _headless.display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                             EGL_DEFAULT_DISPLAY, NULL);
+  }
+  if (_headless.display == EGL_NO_DISPLAY) {
+    _headless.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+  EGLint major, minor;
+  if (!eglInitialize(_headless.display, &major, &minor) ||
+      !eglBindAPI(EGL_OPENGL_API)) {
+    return false;
+  }
+
+  EGLint config_attrs[] = {EGL_SURFACE_TYPE,    EGL_PBUFFER_BIT,
+                           EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                           EGL_RED_SIZE,        8,
+                           EGL_GREEN_SIZE,      8,
+                           EGL_BLUE_SIZE,       8,
+                           EGL_ALPHA_SIZE,      8,
+                           EGL_NONE};
+  EGLConfig config;
+  EGLint num_configs = 0;
+  eglChooseConfig(_headless.display, config_attrs, &config, 1, &num_configs);
+  if (num_configs == 0) {
+    // the surfaceless platform may not advertise pbuffer configs
+    config_attrs[1] = EGL_DONT_CARE;
+    eglChooseConfig(_headless.display, config_attrs, &config, 1,
+                    &num_configs);
+  }
+  if (num_configs == 0) {
+    return false;
+  }
+
+  const EGLint context_attrs[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                  3,
+                                  EGL_CONTEXT_MINOR_VERSION,
+                                  3,
+                                  EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                  EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                  EGL_NONE};
+  _headless.context = eglCreateContext(_headless.display, config,
+                                       EGL_NO_CONTEXT, context_attrs);
+  if (_headless.context == EGL_NO_CONTEXT) {
+    return false;
+  }
+
+  _headless.surface = EGL_NO_SURFACE;
+  const char* extensions = eglQueryString(_headless.display, EGL_EXTENSIONS);
+  if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context")) {
+    const EGLint pbuffer_attrs[] = {EGL_WIDTH, width, EGL_HEIGHT, height,
+                                    EGL_NONE};
+    _headless.surface =
+        eglCreatePbufferSurface(_headless.display, config, pbuffer_attrs);
+    if (_headless.surface == EGL_NO_SURFACE) {
+      return false;
+    }
+  }
+  return eglMakeCurrent(_headless.display, _headless.surface,
+                        _headless.surface, _headless.context);
+}
+
+static void _headless_destroy_context(void) {
+  eglMakeCurrent(_headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                 EGL_NO_CONTEXT);
+  if (_headless.surface != EGL_NO_SURFACE) {
+    eglDestroySurface(_headless.display, _headless.surface);
+  }
+  eglDestroyContext(_headless.display, _headless.context);
+  eglTerminate(_headless.display);
+}
+#endif
+
+/*  ====  RENDERING  ==== */
+
+// Creates the offscreen render target, call after sg_setup().
+static void headless_setup_pass(void) {
+  sg_image_desc img_desc = {.render_target = true,
+                            .width = _headless.desc.width,
+                            .height = _headless.desc.height,
+                            .pixel_format = HEADLESS_COLOR_FORMAT,
+                            .sample_count = 1,
+                            .label = "headless-color"};
+  _headless.color_img = sg_make_image(&img_desc);
+  img_desc.pixel_format = HEADLESS_DEPTH_FORMAT;
+  img_desc.label = "headless-depth";
+  _headless.depth_img = sg_make_image(&img_desc);
+  _headless.pass = sg_make_pass(&(sg_pass_desc){
+      .color_attachments[0].image = _headless.color_img,
+      .depth_stencil_attachment.image = _headless.depth_img,
+      .label = "headless-pass"});
+}
+
+// Replaces sg_begin_default_pass() in headless mode.
+static void headless_begin_pass(const sg_pass_action* pass_action) {
+  sg_begin_pass(_headless.pass, pass_action);
+}
+
+// Call at the end of the frame's pass, before sg_end_pass(), to dump the
+// frame if it was requested.
+static void headless_capture(void) {
+  const headless_desc_t* desc = &_headless.desc;
+  if (!desc->png_dir) {
+    return;
+  }
+  const bool last = _headless.frame_index == desc->num_frames - 1;
+  const bool interval = desc->png_interval > 0 &&
+                        (_headless.frame_index % desc->png_interval) == 0;
+  if (!last && !interval) {
+    return;
+  }
+  if (!_headless.pixels) {
+    _headless.pixels = (uint8_t*)malloc((size_t)(desc->width * desc->height * 4));
+  }
+  if (gl_read_pixels_rgba8(0, 0, desc->width, desc->height,
+                           _headless.pixels)) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/frame_%05d.png", desc->png_dir,
+             _headless.frame_index);
+    if (!_headless_write_png(path, desc->width, desc->height,
+                             _headless.pixels)) {
+      fprintf(stderr, "headless: failed to write '%s'\n", path);
+    }
+  }
+}
+
+// Runs the app without a window, returns the process exit code.
+static int headless_run(const headless_desc_t* desc) {
+#if HEADLESS_AVAILABLE
+  _headless.enabled = true;
+  _headless.desc = *desc;
+  if (!_headless_create_context(desc->width, desc->height)) {
+    fprintf(stderr, "headless: failed to create an EGL context\n");
+    return 1;
+  }
+
+  FILE* csv = NULL;
+  if (desc->csv_path) {
+    csv = fopen(desc->csv_path, "w");
+    if (!csv) {
+      fprintf(stderr, "headless: failed to open '%s'\n", desc->csv_path);
+    }
+  }
+  if (csv) {
+    fputs("frame,frame_ms,finish_ms", csv);
+    if (desc->csv_cb) {
+      desc->csv_cb(csv, true);
+    }
+    fputc('\n', csv);
+  }
+
+  desc->init_cb();
+  for (_headless.frame_index = 0; _headless.frame_index < desc->num_frames;
+       _headless.frame_index++) {
+    const uint64_t start = stm_now();
+    desc->frame_cb();
+    const uint64_t frame_time = stm_since(start);
+    // keep the GPU from queueing up frames, so timings stay per-frame
+    glFinish();
+    const uint64_t finish_time = stm_diff(stm_now(), start + frame_time);
+    if (csv) {
+      fprintf(csv, "%d,%.4f,%.4f", _headless.frame_index, stm_ms(frame_time),
+              stm_ms(finish_time));
+      if (desc->csv_cb) {
+        desc->csv_cb(csv, false);
+      }
+      fputc('\n', csv);
+    }
+  }
+  desc->cleanup_cb();
+
+  if (csv) {
+    fclose(csv);
+  }
+  free(_headless.pixels);
+  _headless_destroy_context();
+  return 0;
+#else
+  (void)desc;
+  fprintf(stderr, "headless: only supported with GLCORE33 on Linux\n");
+  return 1;
+#endif
+}
+
+#endif  // HEADLESS_H
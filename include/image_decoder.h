@@ -0,0 +1,206 @@
+#ifndef IMAGE_DECODER_H
+#define IMAGE_DECODER_H
+
+/*
+  Pluggable RGBA8 image decoders for the loose texture files.
+
+  Each decoder probes a file's magic bytes and decodes it straight into
+  caller memory of exactly width * height * 4 bytes, like
+  stbi_load_into_from_memory(). image_decode_into() tries the decoders
+  that claim a file in table order and falls through to the next one when
+  a decoder fails, stb_image comes last and takes anything.
+
+  Built with IMAGE_DECODER_TURBO, JPEGs go through libjpeg-turbo (SIMD
+  IDCT, upsampling and color conversion straight to RGBA) and PNGs through
+  libpng's simplified API (SIMD filters, and whatever inflate the zlib it
+  links has, zlib-ng's compat build being the fast one). Without it
+  stb_image decodes everything, with its own SSE2/NEON JPEG paths.
+
+  All decoders are safe to call from job pool workers.
+*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "stb/stb_image.h"
+#include "stb/stb_image_into.h"
+
+#if defined(IMAGE_DECODER_TURBO)
+#include <setjmp.h>
+#include <stdio.h>
+#include <jpeglib.h>
+#include <png.h>
+#endif
+
+typedef struct image_decoder_t {
+  const char* name;
+  // whether the decoder takes the file, from its first bytes
+  bool (*probe)(const uint8_t* data, size_t size);
+  // decodes as RGBA8 into `dst`, fails if the image isn't `dst_size` bytes
+  bool (*decode_into)(const uint8_t* data,
+                      size_t size,
+                      void* dst,
+                      size_t dst_size,
+                      int* width,
+                      int* height);
+} image_decoder_t;
+
+static bool _image_is_jpeg(const uint8_t* data, size_t size) {
+  return size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+}
+
+static bool _image_is_png(const uint8_t* data, size_t size) {
+  static const uint8_t magic[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  return size >= sizeof(magic) && memcmp(data, magic, sizeof(magic)) == 0;
+}
+
+static bool _image_any(const uint8_t* data, size_t size) {
+  (void)data;
+  (void)size;
+  return true;
+}
+
+static bool _image_stb_decode_into(const uint8_t* data,
+                                   size_t size,
+                                   void* dst,
+                                   size_t dst_size,
+                                   int* width,
+                                   int* height) {
+  int num_channels;
+  return stbi_load_into_from_memory(data, (int)size, dst, dst_size, width,
+                                    height, &num_channels, 4) != 0;
+}
+
+#if defined(IMAGE_DECODER_TURBO)
+typedef struct _image_jpeg_error_t {
+  struct jpeg_error_mgr mgr;
+  jmp_buf jump;
+} _image_jpeg_error_t;
+
+static void _image_jpeg_error_exit(j_common_ptr cinfo) {
+  longjmp(((_image_jpeg_error_t*)cinfo->err)->jump, 1);
+}
+
+// corrupt data warnings would go to stderr, a failed decode falls back to
+// stb_image anyway
+static void _image_jpeg_output_message(j_common_ptr cinfo) {
+  (void)cinfo;
+}
+
+static bool _image_jpeg_decode_into(const uint8_t* data,
+                                    size_t size,
+                                    void* dst,
+                                    size_t dst_size,
+                                    int* width,
+                                    int* height) {
+  struct jpeg_decompress_struct cinfo;
+  _image_jpeg_error_t error;
+  cinfo.err = jpeg_std_error(&error.mgr);
+  error.mgr.error_exit = _image_jpeg_error_exit;
+  error.mgr.output_message = _image_jpeg_output_message;
+  if (setjmp(error.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo, data, (unsigned long)size);
+  jpeg_read_header(&cinfo, TRUE);
+  cinfo.out_color_space = JCS_EXT_RGBA;
+  jpeg_start_decompress(&cinfo);
+  *width = (int)cinfo.output_width;
+  *height = (int)cinfo.output_height;
+  const size_t stride = (size_t)cinfo.output_width * 4;
+  if (stride * cinfo.output_height != dst_size) {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+  uint8_t* pixels = (uint8_t*)dst;
+  while (cinfo.output_scanline < cinfo.output_height) {
+    // as many rows as the decoder produces per call
+    JSAMPROW rows[16];
+    const int num_rows = cinfo.rec_outbuf_height < 16
+                             ? cinfo.rec_outbuf_height
+                             : 16;
+    for (int i = 0; i < num_rows; ++i) {
+      const JDIMENSION row = cinfo.output_scanline + (JDIMENSION)i;
+      rows[i] = pixels + (row < cinfo.output_height ? row : 0) * stride;
+    }
+    jpeg_read_scanlines(&cinfo, rows, (JDIMENSION)num_rows);
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  return true;
+}
+
+static bool _image_png_decode_into(const uint8_t* data,
+                                   size_t size,
+                                   void* dst,
+                                   size_t dst_size,
+                                   int* width,
+                                   int* height) {
+  png_image image;
+  memset(&image, 0, sizeof(image));
+  image.version = PNG_IMAGE_VERSION;
+  if (!png_image_begin_read_from_memory(&image, data, size)) {
+    return false;
+  }
+  image.format = PNG_FORMAT_RGBA;
+  *width = (int)image.width;
+  *height = (int)image.height;
+  if (PNG_IMAGE_SIZE(image) != dst_size) {
+    png_image_free(&image);
+    return false;
+  }
+  // frees the image's state either way
+  return png_image_finish_read(&image, NULL, dst, 0, NULL) != 0;
+}
+#endif
+
+// In order of preference.
+static const image_decoder_t image_decoders[] = {
+#if defined(IMAGE_DECODER_TURBO)
+    {"libjpeg-turbo", _image_is_jpeg, _image_jpeg_decode_into},
+    {"libpng", _image_is_png, _image_png_decode_into},
+#endif
+    {"stb_image", _image_any, _image_stb_decode_into},
+};
+
+#define IMAGE_NUM_DECODERS \
+  ((int)(sizeof(image_decoders) / sizeof(image_decoders[0])))
+
+// The size of the image in `data`, from its header.
+static bool image_decode_info(const uint8_t* data,
+                              size_t size,
+                              int* width,
+                              int* height) {
+  int num_channels;
+  return stbi_info_from_memory(data, (int)size, width, height,
+                               &num_channels) &&
+         *width > 0 && *height > 0;
+}
+
+// Decodes `data` as RGBA8 into `dst`, which must hold exactly the image.
+static bool image_decode_into(const uint8_t* data,
+                              size_t size,
+                              void* dst,
+                              size_t dst_size,
+                              int* width,
+                              int* height) {
+  // wrong sizes are rejected before any decoder runs, a decoder failing
+  // means it can't handle the file and the next one gets a try
+  if (!image_decode_info(data, size, width, height) ||
+      (size_t)*width * (size_t)*height * 4 != dst_size) {
+    return false;
+  }
+  for (int i = 0; i < IMAGE_NUM_DECODERS; ++i) {
+    const image_decoder_t* decoder = &image_decoders[i];
+    if (decoder->probe(data, size) &&
+        decoder->decode_into(data, size, dst, dst_size, width, height)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+#endif  // IMAGE_DECODER_H
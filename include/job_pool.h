@@ -0,0 +1,291 @@
+#ifndef JOB_POOL_H
+#define JOB_POOL_H
+
+/*
+  Minimal worker thread pool for CPU-heavy load-time work (image decoding).
+
+  Works like sokol_fetch: job_pool_submit() queues a job whose `func` runs
+  on a worker thread, and its `done` callback is later invoked on the main
+  thread from job_pool_dowork(), which should be called once per frame
+  next to sfetch_dowork(). Jobs only communicate through their `data`
+  pointer, which must stay valid until `done` was called.
+
+  Without thread support (Emscripten without pthreads) jobs run inline in
+  job_pool_submit(), `done` is still deferred to job_pool_dowork().
+*/
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define JOB_POOL_THREADS (1)
+#elif defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define JOB_POOL_THREADS (0)
+#else
+#include <pthread.h>
+#include <unistd.h>
+#define JOB_POOL_THREADS (1)
+#endif
+
+#define JOB_POOL_MAX_THREADS (16)
+#define JOB_POOL_MAX_JOBS (256)
+
+typedef void (*job_func_t)(void* data);
+
+typedef struct job_pool_desc_t {
+  int num_threads;  // 0: one per core, minus the main thread
+} job_pool_desc_t;
+
+typedef struct _job_t {
+  job_func_t func;
+  job_func_t done;
+  void* data;
+} _job_t;
+
+typedef struct _job_queue_t {
+  _job_t jobs[JOB_POOL_MAX_JOBS];
+  int head;
+  int count;
+} _job_queue_t;
+
+static struct {
+  bool valid;
+  bool quit;
+  int num_threads;
+  // submitted jobs whose `done` wasn't called yet, main thread only
+  int in_flight;
+  _job_queue_t pending;
+  _job_queue_t completed;
+#if JOB_POOL_THREADS && defined(_WIN32)
+  HANDLE threads[JOB_POOL_MAX_THREADS];
+  CRITICAL_SECTION lock;
+  CONDITION_VARIABLE wake;
+#elif JOB_POOL_THREADS
+  pthread_t threads[JOB_POOL_MAX_THREADS];
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+#endif
+} _job_pool;
+
+static bool _job_queue_push(_job_queue_t* queue, _job_t job) {
+  if (queue->count == JOB_POOL_MAX_JOBS) {
+    return false;
+  }
+  queue->jobs[(queue->head + queue->count) % JOB_POOL_MAX_JOBS] = job;
+  ++queue->count;
+  return true;
+}
+
+static bool _job_queue_pop(_job_queue_t* queue, _job_t* job) {
+  if (queue->count == 0) {
+    return false;
+  }
+  *job = queue->jobs[queue->head];
+  queue->head = (queue->head + 1) % JOB_POOL_MAX_JOBS;
+  --queue->count;
+  return true;
+}
+
+#if JOB_POOL_THREADS && defined(_WIN32)
+#define _job_pool_lock() EnterCriticalSection(&_job_pool.lock)
+#define _job_pool_unlock() LeaveCriticalSection(&_job_pool.lock)
+#define _job_pool_wait() \
+  SleepConditionVariableCS(&_job_pool.wake, &_job_pool.lock, INFINITE)
+#define _job_pool_signal() WakeConditionVariable(&_job_pool.wake)
+#define _job_pool_broadcast() WakeAllConditionVariable(&_job_pool.wake)
+#elif JOB_POOL_THREADS
+#define _job_pool_lock() pthread_mutex_lock(&_job_pool.lock)
+#define _job_pool_unlock() pthread_mutex_unlock(&_job_pool.lock)
+#define _job_pool_wait() pthread_cond_wait(&_job_pool.wake, &_job_pool.lock)
+#define _job_pool_signal() pthread_cond_signal(&_job_pool.wake)
+#define _job_pool_broadcast() pthread_cond_broadcast(&_job_pool.wake)
+#else
+#define _job_pool_lock()
+#define _job_pool_unlock()
+#endif
+
+#if JOB_POOL_THREADS
+static void _job_pool_worker(void) {
+  for (;;) {
+    _job_t job;
+    _job_pool_lock();
+    while (!_job_pool.quit && !_job_queue_pop(&_job_pool.pending, &job)) {
+      _job_pool_wait();
+    }
+    if (_job_pool.quit) {
+      _job_pool_unlock();
+      return;
+    }
+    _job_pool_unlock();
+
+    job.func(job.data);
+
+    _job_pool_lock();
+    // can't overflow, in_flight is capped at JOB_POOL_MAX_JOBS
+    _job_queue_push(&_job_pool.completed, job);
+    _job_pool_unlock();
+  }
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI _job_pool_thread(LPVOID arg) {
+  (void)arg;
+  _job_pool_worker();
+  return 0;
+}
+#else
+static void* _job_pool_thread(void* arg) {
+  (void)arg;
+  _job_pool_worker();
+  return NULL;
+}
+#endif
+#endif  // JOB_POOL_THREADS
+
+static int _job_pool_num_cores(void) {
+#if defined(_WIN32)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (int)info.dwNumberOfProcessors;
+#elif JOB_POOL_THREADS
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+#else
+  return 1;
+#endif
+}
+
+static void job_pool_setup(const job_pool_desc_t* desc) {
+  _job_pool.valid = true;
+  _job_pool.quit = false;
+#if JOB_POOL_THREADS
+  int n = desc->num_threads;
+  if (n <= 0) {
+    n = _job_pool_num_cores() - 1;
+  }
+  if (n < 1) {
+    n = 1;
+  }
+  if (n > JOB_POOL_MAX_THREADS) {
+    n = JOB_POOL_MAX_THREADS;
+  }
+  _job_pool.num_threads = n;
+#if defined(_WIN32)
+  InitializeCriticalSection(&_job_pool.lock);
+  InitializeConditionVariable(&_job_pool.wake);
+  for (int i = 0; i < n; ++i) {
+    _job_pool.threads[i] =
+        CreateThread(NULL, 0, _job_pool_thread, NULL, 0, NULL);
+  }
+#else
+  pthread_mutex_init(&_job_pool.lock, NULL);
+  pthread_cond_init(&_job_pool.wake, NULL);
+  for (int i = 0; i < n; ++i) {
+    pthread_create(&_job_pool.threads[i], NULL, _job_pool_thread, NULL);
+  }
+#endif
+#else
+  (void)desc;
+  _job_pool.num_threads = 0;
+#endif
+}
+
+static void job_pool_shutdown(void) {
+  if (!_job_pool.valid) {
+    return;
+  }
+#if JOB_POOL_THREADS
+  _job_pool_lock();
+  _job_pool.quit = true;
+  _job_pool_broadcast();
+  _job_pool_unlock();
+  for (int i = 0; i < _job_pool.num_threads; ++i) {
+#if defined(_WIN32)
+    WaitForSingleObject(_job_pool.threads[i], INFINITE);
+    CloseHandle(_job_pool.threads[i]);
+#else
+    pthread_join(_job_pool.threads[i], NULL);
+#endif
+  }
+#if defined(_WIN32)
+  DeleteCriticalSection(&_job_pool.lock);
+#else
+  pthread_cond_destroy(&_job_pool.wake);
+  pthread_mutex_destroy(&_job_pool.lock);
+#endif
+#endif
+  _job_pool.valid = false;
+}
+
+static int job_pool_num_threads(void) {
+  return _job_pool.num_threads;
+}
+
+static void _job_pool_yield(void) {
+#if JOB_POOL_THREADS && defined(_WIN32)
+  Sleep(0);
+#elif JOB_POOL_THREADS
+  usleep(100);
+#endif
+}
+
+// Invokes the `done` callbacks of all finished jobs.
+static void job_pool_dowork(void) {
+  for (;;) {
+    _job_t job;
+    _job_pool_lock();
+    bool have_job = _job_queue_pop(&_job_pool.completed, &job);
+    _job_pool_unlock();
+    if (!have_job) {
+      break;
+    }
+    --_job_pool.in_flight;
+    if (job.done) {
+      job.done(job.data);
+    }
+  }
+}
+
+// Queues `func(data)` on a worker thread, `done(data)` is called from
+// job_pool_dowork() on the calling thread once it has finished. `done` may
+// be NULL.
+static void job_pool_submit(job_func_t func, job_func_t done, void* data) {
+  while (_job_pool.in_flight >= JOB_POOL_MAX_JOBS) {
+    job_pool_dowork();
+    _job_pool_yield();
+  }
+  ++_job_pool.in_flight;
+
+  _job_t job = {.func = func, .done = done, .data = data};
+  _job_pool_lock();
+  bool queued = _job_pool.num_threads > 0 &&
+                _job_queue_push(&_job_pool.pending, job);
+#if JOB_POOL_THREADS
+  if (queued) {
+    _job_pool_signal();
+  }
+#endif
+  _job_pool_unlock();
+  if (!queued) {
+    // no worker threads, run it right here
+    func(data);
+    _job_pool_lock();
+    _job_queue_push(&_job_pool.completed, job);
+    _job_pool_unlock();
+  }
+}
+
+// Blocks until all submitted jobs finished and their `done` callbacks ran,
+// for command line tools that don't have a frame loop.
+static void job_pool_wait_all(void) {
+  for (;;) {
+    job_pool_dowork();
+    if (_job_pool.in_flight == 0) {
+      break;
+    }
+    _job_pool_yield();
+  }
+}
+
+#endif  // JOB_POOL_H
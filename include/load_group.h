@@ -0,0 +1,148 @@
+#ifndef LOAD_GROUP_H
+#define LOAD_GROUP_H
+
+/*
+  Batch loads of registry assets that complete together, such as the faces
+  of a cubemap.
+
+  The files of a group's members are fetched through the asset registry,
+  all at once, so they spread over every fetch lane of their priority. Each
+  file is decoded on the job pool as soon as it arrives, and the group's
+  `done_cb` fans in once every member is decoded or failed.
+
+  Any number of groups up to LOAD_GROUP_MAX_GROUPS may be in flight, each
+  with up to LOAD_GROUP_MAX_MEMBERS members. An asset may only be a member
+  of one group at a time. All callbacks except `decode_cb` run on the main
+  thread, the group is released after `done_cb` returns.
+*/
+#include "asset_registry.h"
+#include "job_pool.h"
+
+#define LOAD_GROUP_MAX_GROUPS (32)
+#define LOAD_GROUP_MAX_MEMBERS (32)
+
+struct load_group_t;
+
+typedef struct load_group_desc_t {
+  const int* assets;  // registry ids, one per member
+  int num_assets;
+  // optional, a member's file arrived, false rejects it without decoding
+  bool (*check_cb)(struct load_group_t* group,
+                   int member,
+                   const asset_t* asset);
+  // runs on a worker, decodes the member's file, true on success
+  bool (*decode_cb)(struct load_group_t* group,
+                    int member,
+                    const asset_t* asset);
+  // optional, the member is decoded or failed and its file released
+  void (*member_done_cb)(struct load_group_t* group, int member, bool ok);
+  // every member is done, `failed` if any of them failed
+  void (*done_cb)(struct load_group_t* group, bool failed);
+  void* user_data;
+} load_group_desc_t;
+
+typedef struct _load_group_member_t {
+  struct load_group_t* group;
+  int index;
+  int asset;
+  bool decoded;
+} _load_group_member_t;
+
+typedef struct load_group_t {
+  bool in_use;
+  load_group_desc_t desc;
+  _load_group_member_t members[LOAD_GROUP_MAX_MEMBERS];
+  int num_done;
+  // members on the job pool, their decoders may be writing
+  int decoding;
+  bool failed;
+} load_group_t;
+
+static struct {
+  load_group_t groups[LOAD_GROUP_MAX_GROUPS];
+} _load_group;
+
+static void _load_group_member_done(_load_group_member_t* member, bool ok) {
+  load_group_t* group = member->group;
+  // failed fetches are already done
+  if (asset_registry_get(member->asset)->state == ASSET_STATE_FETCHED) {
+    asset_registry_done(member->asset, ok);
+  }
+  group->failed |= !ok;
+  if (group->desc.member_done_cb) {
+    group->desc.member_done_cb(group, member->index, ok);
+  }
+  if (++group->num_done == group->desc.num_assets) {
+    group->desc.done_cb(group, group->failed);
+    group->in_use = false;
+  }
+}
+
+// Runs on a job pool worker.
+static void _load_group_decode(void* data) {
+  _load_group_member_t* member = (_load_group_member_t*)data;
+  load_group_t* group = member->group;
+  member->decoded = group->desc.decode_cb(group, member->index,
+                                          asset_registry_get(member->asset));
+}
+
+static void _load_group_decoded(void* data) {
+  _load_group_member_t* member = (_load_group_member_t*)data;
+  --member->group->decoding;
+  _load_group_member_done(member, member->decoded);
+}
+
+// Registry callback of a member's file, `user_data` is the member.
+static void _load_group_fetched(asset_t* asset, void* user_data) {
+  _load_group_member_t* member = (_load_group_member_t*)user_data;
+  load_group_t* group = member->group;
+  if (asset->state == ASSET_STATE_FETCHED &&
+      (!group->desc.check_cb ||
+       group->desc.check_cb(group, member->index, asset))) {
+    ++group->decoding;
+    job_pool_submit(_load_group_decode, _load_group_decoded, member);
+    return;
+  }
+  _load_group_member_done(member, false);
+}
+
+// Whether load_group_start() has a free group.
+static bool load_group_available(void) {
+  for (int i = 0; i < LOAD_GROUP_MAX_GROUPS; ++i) {
+    if (!_load_group.groups[i].in_use) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Queues the files of all members, returns NULL if no group is free or
+// the member count is out of range.
+static load_group_t* load_group_start(const load_group_desc_t* desc) {
+  if (desc->num_assets < 1 || desc->num_assets > LOAD_GROUP_MAX_MEMBERS) {
+    return NULL;
+  }
+  load_group_t* group = NULL;
+  for (int i = 0; i < LOAD_GROUP_MAX_GROUPS; ++i) {
+    if (!_load_group.groups[i].in_use) {
+      group = &_load_group.groups[i];
+      break;
+    }
+  }
+  if (!group) {
+    return NULL;
+  }
+  *group = (load_group_t){.in_use = true, .desc = *desc};
+  for (int i = 0; i < desc->num_assets; ++i) {
+    group->members[i] = (_load_group_member_t){
+        .group = group, .index = i, .asset = desc->assets[i]};
+  }
+  // all members are queued before any of them can complete
+  for (int i = 0; i < desc->num_assets; ++i) {
+    asset_registry_fetch(desc->assets[i], _load_group_fetched,
+                         &group->members[i]);
+  }
+  return group;
+}
+
+#endif  // LOAD_GROUP_H
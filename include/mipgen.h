@@ -0,0 +1,134 @@
+#ifndef MIPGEN_H
+#define MIPGEN_H
+
+/*
+  Box-filtered mip chain generation for RGBA8 images.
+
+  Each level averages 2x2 texels of the previous one, odd sizes clamp the
+  last row/column. With SSE2 four destination texels are filtered at once,
+  with exactly the same rounding as the scalar path. Used offline by the
+  texture cooker and at load time on the decode workers, plain C without
+  sokol dependencies.
+*/
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIPGEN_SSE2 (1)
+#else
+#define MIPGEN_SSE2 (0)
+#endif
+
+#define MIPGEN_MAX_LEVELS (16)
+
+static int mipgen_num_levels(int width, int height) {
+  int levels = 1;
+  while ((width > 1 || height > 1) && levels < MIPGEN_MAX_LEVELS) {
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+    ++levels;
+  }
+  return levels;
+}
+
+static int mipgen_level_dim(int dim, int level) {
+  dim >>= level;
+  return dim > 0 ? dim : 1;
+}
+
+static size_t mipgen_level_size(int width, int height, int level) {
+  return (size_t)mipgen_level_dim(width, level) *
+         (size_t)mipgen_level_dim(height, level) * 4;
+}
+
+// Bytes of the whole chain of a width x height image.
+static size_t mipgen_chain_size(int width, int height) {
+  size_t size = 0;
+  for (int i = 0; i < mipgen_num_levels(width, height); ++i) {
+    size += mipgen_level_size(width, height, i);
+  }
+  return size;
+}
+
+#if MIPGEN_SSE2
+// Two destination texels from four source texels of both rows, as 16-bit
+// channel sums.
+static __m128i _mipgen_sum2(const uint8_t* row0, const uint8_t* row1) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i a = _mm_loadu_si128((const __m128i*)row0);
+  const __m128i b = _mm_loadu_si128((const __m128i*)row1);
+  const __m128i lo =
+      _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+  const __m128i hi =
+      _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+  // add the horizontally adjacent texels, one destination texel per half
+  const __m128i lo_sum = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+  const __m128i hi_sum = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+  return _mm_unpacklo_epi64(lo_sum, hi_sum);
+}
+
+// Destination texels [0, n) of a row where every texel has two source
+// columns, n must be a multiple of 4.
+static void _mipgen_row_sse2(const uint8_t* row0,
+                             const uint8_t* row1,
+                             uint8_t* dst,
+                             int n) {
+  const __m128i round = _mm_set1_epi16(2);
+  for (int x = 0; x < n; x += 4) {
+    const __m128i s0 = _mipgen_sum2(row0 + x * 8, row1 + x * 8);
+    const __m128i s1 = _mipgen_sum2(row0 + x * 8 + 16, row1 + x * 8 + 16);
+    const __m128i a0 = _mm_srli_epi16(_mm_add_epi16(s0, round), 2);
+    const __m128i a1 = _mm_srli_epi16(_mm_add_epi16(s1, round), 2);
+    _mm_storeu_si128((__m128i*)(dst + x * 4), _mm_packus_epi16(a0, a1));
+  }
+}
+#endif
+
+// Downsamples `src` (src_w x src_h) into the next level `dst`.
+static void mipgen_downsample(const uint8_t* src,
+                              int src_w,
+                              int src_h,
+                              uint8_t* dst) {
+  const int dst_w = src_w > 1 ? src_w / 2 : 1;
+  const int dst_h = src_h > 1 ? src_h / 2 : 1;
+  for (int y = 0; y < dst_h; ++y) {
+    const int y0 = y * 2;
+    const int y1 = y0 + 1 < src_h ? y0 + 1 : y0;
+    const uint8_t* row0 = src + (size_t)y0 * src_w * 4;
+    const uint8_t* row1 = src + (size_t)y1 * src_w * 4;
+    uint8_t* dst_row = dst + (size_t)y * dst_w * 4;
+    int x = 0;
+#if MIPGEN_SSE2
+    if (src_w > 1) {
+      x = dst_w & ~3;
+      _mipgen_row_sse2(row0, row1, dst_row, x);
+    }
+#endif
+    for (; x < dst_w; ++x) {
+      const int x0 = x * 2;
+      const int x1 = x0 + 1 < src_w ? x0 + 1 : x0;
+      for (int c = 0; c < 4; ++c) {
+        const int sum = row0[x0 * 4 + c] + row0[x1 * 4 + c] +
+                        row1[x0 * 4 + c] + row1[x1 * 4 + c];
+        dst_row[x * 4 + c] = (uint8_t)((sum + 2) >> 2);
+      }
+    }
+  }
+}
+
+// Fills levels 1..num_levels-1, `levels[0]` holds the source image and
+// every `levels[i]` must have room for mipgen_level_size(width, height, i).
+// The levels don't need to be contiguous.
+static void mipgen_build_chain(uint8_t** levels,
+                               int width,
+                               int height,
+                               int num_levels) {
+  for (int i = 1; i < num_levels; ++i) {
+    mipgen_downsample(levels[i - 1], mipgen_level_dim(width, i - 1),
+                      mipgen_level_dim(height, i - 1), levels[i]);
+  }
+}
+
+#endif  // MIPGEN_H
@@ -0,0 +1,91 @@
+#ifndef OVERDRAW_H
+#define OVERDRAW_H
+
+#include "sokol_gfx.h"
+#include "gl_util.h"
+#include <stdlib.h>
+
+/*
+  Overdraw measurement: geometry is drawn with an additive pipeline that
+  adds 1/255 to the red channel for every fragment passing the depth test,
+  into a small offscreen target which is read back on the CPU. The overdraw
+  factor is the number of shaded fragments divided by the number of covered
+  pixels (1.0 means every pixel was shaded exactly once).
+
+  Pipelines drawing into the overdraw pass must use OVERDRAW_COLOR_FORMAT,
+  OVERDRAW_DEPTH_FORMAT and a sample count of 1.
+*/
+#define OVERDRAW_COLOR_FORMAT (SG_PIXELFORMAT_RGBA8)
+#define OVERDRAW_DEPTH_FORMAT (SG_PIXELFORMAT_DEPTH)
+
+typedef struct overdraw_t {
+  int width;
+  int height;
+  sg_image color_img;
+  sg_image depth_img;
+  sg_pass pass;
+  uint8_t* pixels;
+} overdraw_t;
+
+static void overdraw_init(overdraw_t* od, int width, int height) {
+  sg_image_desc img_desc = {.render_target = true,
+                            .width = width,
+                            .height = height,
+                            .pixel_format = OVERDRAW_COLOR_FORMAT,
+                            .sample_count = 1,
+                            .min_filter = SG_FILTER_NEAREST,
+                            .mag_filter = SG_FILTER_NEAREST,
+                            .label = "overdraw-color"};
+  od->width = width;
+  od->height = height;
+  od->color_img = sg_make_image(&img_desc);
+  img_desc.pixel_format = OVERDRAW_DEPTH_FORMAT;
+  img_desc.label = "overdraw-depth";
+  od->depth_img = sg_make_image(&img_desc);
+  od->pass = sg_make_pass(&(sg_pass_desc){
+      .color_attachments[0].image = od->color_img,
+      .depth_stencil_attachment.image = od->depth_img,
+      .label = "overdraw-pass"});
+  od->pixels = (uint8_t*)malloc((size_t)(width * height * 4));
+}
+
+static void overdraw_shutdown(overdraw_t* od) {
+  if (od->pixels) {
+    sg_destroy_pass(od->pass);
+    sg_destroy_image(od->depth_img);
+    sg_destroy_image(od->color_img);
+    free(od->pixels);
+    od->pixels = NULL;
+  }
+}
+
+static void overdraw_begin(overdraw_t* od) {
+  sg_begin_pass(od->pass,
+                &(sg_pass_action){.colors[0] = {.action = SG_ACTION_CLEAR,
+                                                .value = {0.0f, 0.0f, 0.0f,
+                                                          0.0f}},
+                                  .depth = {.action = SG_ACTION_CLEAR,
+                                            .value = 1.0f}});
+}
+
+// Ends the overdraw pass and returns the measured overdraw factor, or a
+// negative value if the backend can't read back render targets.
+static float overdraw_end(overdraw_t* od) {
+  bool read = gl_read_pixels_rgba8(0, 0, od->width, od->height, od->pixels);
+  sg_end_pass();
+  if (!read) {
+    return -1.0f;
+  }
+
+  uint64_t fragments = 0;
+  uint64_t covered = 0;
+  const int num_pixels = od->width * od->height;
+  for (int i = 0; i < num_pixels; ++i) {
+    uint8_t count = od->pixels[i * 4];
+    fragments += count;
+    covered += count > 0;
+  }
+  return covered > 0 ? (float)((double)fragments / (double)covered) : 0.0f;
+}
+
+#endif  // OVERDRAW_H
@@ -0,0 +1,409 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+/*
+  Disk cache of linked GL program binaries, so later launches skip the
+  GLSL compile and link in sg_make_shader().
+
+  sokol-gfx doesn't let the application hand it a program, so the cache
+  sits between its GL backend and the driver: the implementation is
+  compiled into the sokol library's translation unit, where it wraps the
+  handful of GL calls sokol uses to build programs. Shader compiles are
+  deferred until link time. The link first looks for a binary keyed by
+  the XXH64 of both shader sources and the driver's vendor, renderer and
+  version strings, and loads it with glProgramBinary(). When there's none
+  or the driver rejects it (a driver update), the deferred shaders are
+  compiled and linked as usual and the result is written back with
+  glGetProgramBinary(). Entries remember how long their compile and link
+  took, a hit counts that minus the load as time saved.
+
+  Only with the GLCORE33 backend on Linux and macOS (see gl_util.h), and
+  only if the driver supports at least one binary format, everywhere else
+  program_cache_setup() returns false and sokol compiles as usual. Main
+  thread only, like sokol-gfx.
+
+  Define PROGRAM_CACHE_IMPL in the sokol implementation file before
+  sokol_gfx.h, the rest of the app only calls the public functions.
+*/
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct program_cache_stats_t {
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t rejected;   // binaries the driver didn't take anymore
+  double compile_ms;   // compiling and linking the misses
+  double saved_ms;     // compile time of the hits, less loading them
+} program_cache_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Turns the cache on with entries in `dir`, call after sg_setup().
+bool program_cache_setup(const char* dir);
+bool program_cache_enabled(void);
+program_cache_stats_t program_cache_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(PROGRAM_CACHE_IMPL)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gl_util.h"
+#include "sokol_time.h"
+
+#if GL_UTIL_AVAILABLE
+#include <sys/stat.h>
+#include <unistd.h>
+#include "xxhash64.h"
+#define PROGRAM_CACHE_GL (1)
+#else
+#define PROGRAM_CACHE_GL (0)
+#endif
+
+#define PROGRAM_CACHE_MAGIC (0x42505848)  // 'HXPB'
+#define PROGRAM_CACHE_VERSION (1)
+#define PROGRAM_CACHE_MAX_SHADERS (32)
+#define PROGRAM_CACHE_MAX_PROGRAMS (16)
+#define PROGRAM_CACHE_PATH_SIZE (256)
+
+typedef struct _program_cache_header_t {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t format;
+  uint32_t size;
+  uint64_t compile_ticks;  // stm ticks of the compile and link
+} _program_cache_header_t;
+
+#if PROGRAM_CACHE_GL
+typedef struct {
+  GLuint shader;
+  uint64_t source_hash;
+  bool deferred;  // compile postponed to the link
+} _program_cache_shader_t;
+
+typedef struct {
+  GLuint program;
+  GLuint shaders[2];
+  int num_shaders;
+} _program_cache_program_t;
+#endif
+
+static struct {
+  bool enabled;
+  char dir[PROGRAM_CACHE_PATH_SIZE];
+  uint64_t driver_hash;
+#if PROGRAM_CACHE_GL
+  _program_cache_shader_t shaders[PROGRAM_CACHE_MAX_SHADERS];
+  _program_cache_program_t programs[PROGRAM_CACHE_MAX_PROGRAMS];
+#endif
+  program_cache_stats_t stats;
+} _program_cache;
+
+bool program_cache_enabled(void) {
+  return _program_cache.enabled;
+}
+
+program_cache_stats_t program_cache_stats(void) {
+  return _program_cache.stats;
+}
+
+#if PROGRAM_CACHE_GL
+static uint64_t _program_cache_string_hash(uint64_t hash, const char* str) {
+  return xxh64_merge(hash, str ? xxh64(str, strlen(str)) : 0);
+}
+
+bool program_cache_setup(const char* dir) {
+  memset(&_program_cache, 0, sizeof(_program_cache));
+  GLint num_formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+  if (glGetError() != GL_NO_ERROR || num_formats < 1 ||
+      strlen(dir) + 32 >= PROGRAM_CACHE_PATH_SIZE) {
+    return false;
+  }
+  strcpy(_program_cache.dir, dir);
+  mkdir(dir, 0755);
+  struct stat st;
+  if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+    return false;
+  }
+  uint64_t hash = 0;
+  hash = _program_cache_string_hash(hash, (const char*)glGetString(GL_VENDOR));
+  hash =
+      _program_cache_string_hash(hash, (const char*)glGetString(GL_RENDERER));
+  hash = _program_cache_string_hash(hash, (const char*)glGetString(GL_VERSION));
+  _program_cache.driver_hash = hash;
+  _program_cache.enabled = true;
+  return true;
+}
+
+static _program_cache_shader_t* _program_cache_find_shader(GLuint shader) {
+  for (int i = 0; i < PROGRAM_CACHE_MAX_SHADERS; ++i) {
+    if (_program_cache.shaders[i].shader == shader) {
+      return &_program_cache.shaders[i];
+    }
+  }
+  return NULL;
+}
+
+// The shader's entry, reusing the one of a deleted shader with the same
+// name or a free one.
+static _program_cache_shader_t* _program_cache_add_shader(GLuint shader) {
+  _program_cache_shader_t* entry = _program_cache_find_shader(shader);
+  if (!entry) {
+    entry = _program_cache_find_shader(0);
+  }
+  if (entry) {
+    memset(entry, 0, sizeof(*entry));
+    entry->shader = shader;
+  }
+  return entry;
+}
+
+static _program_cache_program_t* _program_cache_find_program(GLuint program) {
+  for (int i = 0; i < PROGRAM_CACHE_MAX_PROGRAMS; ++i) {
+    if (_program_cache.programs[i].program == program) {
+      return &_program_cache.programs[i];
+    }
+  }
+  return NULL;
+}
+
+static void _program_cache_path(char* path, size_t size, uint64_t key) {
+  snprintf(path, size, "%s/%016llx.hxpb", _program_cache.dir,
+           (unsigned long long)key);
+}
+
+// Links `program` from the entry for `key`, false on a miss or when the
+// driver rejects the binary.
+static bool _program_cache_load(GLuint program, uint64_t key) {
+  char path[PROGRAM_CACHE_PATH_SIZE];
+  _program_cache_path(path, sizeof(path), key);
+  FILE* fp = fopen(path, "rb");
+  if (!fp) {
+    return false;
+  }
+  const uint64_t start = stm_now();
+  _program_cache_header_t header;
+  void* binary = NULL;
+  bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+            header.magic == PROGRAM_CACHE_MAGIC &&
+            header.version == PROGRAM_CACHE_VERSION && header.key == key &&
+            header.size > 0 && (binary = malloc(header.size)) != NULL &&
+            fread(binary, header.size, 1, fp) == 1;
+  fclose(fp);
+  if (ok) {
+    glProgramBinary(program, (GLenum)header.format, binary,
+                    (GLsizei)header.size);
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    ok = status == GL_TRUE;
+    if (ok) {
+      const uint64_t load_ticks = stm_since(start);
+      ++_program_cache.stats.hits;
+      if (header.compile_ticks > load_ticks) {
+        _program_cache.stats.saved_ms +=
+            stm_ms(header.compile_ticks - load_ticks);
+      }
+    } else {
+      ++_program_cache.stats.rejected;
+    }
+  }
+  free(binary);
+  return ok;
+}
+
+// Writes the linked `program` as the entry for `key`. Failures only cost
+// the next launch a compile.
+static void _program_cache_store(GLuint program,
+                                 uint64_t key,
+                                 uint64_t compile_ticks) {
+  GLint size = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+  void* binary = size > 0 ? malloc((size_t)size) : NULL;
+  if (!binary) {
+    return;
+  }
+  _program_cache_header_t header = {.magic = PROGRAM_CACHE_MAGIC,
+                                    .version = PROGRAM_CACHE_VERSION,
+                                    .key = key,
+                                    .compile_ticks = compile_ticks};
+  GLsizei length = 0;
+  GLenum format = 0;
+  glGetProgramBinary(program, size, &length, &format, binary);
+  header.format = format;
+  header.size = (uint32_t)length;
+  char path[PROGRAM_CACHE_PATH_SIZE];
+  char tmp_path[PROGRAM_CACHE_PATH_SIZE + 32];
+  _program_cache_path(path, sizeof(path), key);
+  // other launches may be writing the same entry, this process only one
+  // at a time
+  snprintf(tmp_path, sizeof(tmp_path), "%s.%lu.tmp", path,
+           (unsigned long)getpid());
+  FILE* fp = fopen(tmp_path, "wb");
+  bool ok = fp && length > 0 && glGetError() == GL_NO_ERROR;
+  if (fp) {
+    ok = ok && fwrite(&header, sizeof(header), 1, fp) == 1 &&
+         fwrite(binary, (size_t)length, 1, fp) == 1;
+    ok = fclose(fp) == 0 && ok;
+    ok = ok && rename(tmp_path, path) == 0;
+    if (!ok) {
+      remove(tmp_path);
+    }
+  }
+  free(binary);
+}
+
+/*  ====  GL CALLS MADE BY SOKOL-GFX  ==== */
+static void _program_cache_glShaderSource(GLuint shader,
+                                          GLsizei count,
+                                          const GLchar* const* string,
+                                          const GLint* length) {
+  glShaderSource(shader, count, string, length);
+  _program_cache_shader_t* entry =
+      _program_cache.enabled ? _program_cache_add_shader(shader) : NULL;
+  if (entry) {
+    uint64_t hash = 0;
+    for (GLsizei i = 0; i < count; ++i) {
+      const size_t size =
+          length && length[i] >= 0 ? (size_t)length[i] : strlen(string[i]);
+      hash = xxh64_merge(hash, xxh64(string[i], size));
+    }
+    entry->source_hash = hash;
+  }
+}
+
+static void _program_cache_glCompileShader(GLuint shader) {
+  _program_cache_shader_t* entry =
+      _program_cache.enabled ? _program_cache_find_shader(shader) : NULL;
+  if (entry) {
+    entry->deferred = true;
+  } else {
+    glCompileShader(shader);
+  }
+}
+
+// A deferred shader reports a successful compile, a broken one fails the
+// link instead.
+static void _program_cache_glGetShaderiv(GLuint shader,
+                                         GLenum pname,
+                                         GLint* params) {
+  const _program_cache_shader_t* entry = _program_cache_find_shader(shader);
+  if (shader != 0 && entry && entry->deferred) {
+    *params = pname == GL_COMPILE_STATUS ? GL_TRUE : 0;
+    return;
+  }
+  glGetShaderiv(shader, pname, params);
+}
+
+static void _program_cache_glAttachShader(GLuint program, GLuint shader) {
+  glAttachShader(program, shader);
+  if (!_program_cache.enabled) {
+    return;
+  }
+  _program_cache_program_t* entry = _program_cache_find_program(program);
+  if (!entry) {
+    entry = _program_cache_find_program(0);
+    if (entry) {
+      memset(entry, 0, sizeof(*entry));
+      entry->program = program;
+    }
+  }
+  if (entry && entry->num_shaders < 2) {
+    entry->shaders[entry->num_shaders++] = shader;
+  }
+}
+
+// Compiles the program's deferred shaders, their logs go to stderr since
+// sokol already took the compile as successful.
+static void _program_cache_compile(const _program_cache_program_t* program) {
+  for (int i = 0; i < program->num_shaders; ++i) {
+    _program_cache_shader_t* entry =
+        _program_cache_find_shader(program->shaders[i]);
+    if (!entry || !entry->deferred) {
+      continue;
+    }
+    entry->deferred = false;
+    glCompileShader(entry->shader);
+    GLint status = GL_FALSE;
+    glGetShaderiv(entry->shader, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE) {
+      char log[1024];
+      glGetShaderInfoLog(entry->shader, (GLsizei)sizeof(log), NULL, log);
+      fprintf(stderr, "program cache: shader compile failed: %s\n", log);
+    }
+  }
+}
+
+// Frees the entries of a linked program and its shaders, sokol deletes
+// the shaders right after the link.
+static void _program_cache_release(_program_cache_program_t* program) {
+  for (int i = 0; i < program->num_shaders; ++i) {
+    _program_cache_shader_t* shader =
+        _program_cache_find_shader(program->shaders[i]);
+    if (shader) {
+      memset(shader, 0, sizeof(*shader));
+    }
+  }
+  memset(program, 0, sizeof(*program));
+}
+
+static void _program_cache_glLinkProgram(GLuint program) {
+  _program_cache_program_t* entry =
+      _program_cache.enabled ? _program_cache_find_program(program) : NULL;
+  if (!entry) {
+    glLinkProgram(program);
+    return;
+  }
+  // programs with untracked shaders link without the cache
+  bool cacheable = entry->num_shaders == 2;
+  uint64_t key = _program_cache.driver_hash;
+  for (int i = 0; cacheable && i < entry->num_shaders; ++i) {
+    const _program_cache_shader_t* shader =
+        _program_cache_find_shader(entry->shaders[i]);
+    cacheable = shader != NULL;
+    key = xxh64_merge(key, shader ? shader->source_hash : 0);
+  }
+  if (cacheable && _program_cache_load(program, key)) {
+    // the deferred shaders are never compiled
+    _program_cache_release(entry);
+    return;
+  }
+  const uint64_t start = stm_now();
+  _program_cache_compile(entry);
+  if (cacheable) {
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+  glLinkProgram(program);
+  if (cacheable) {
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    const uint64_t compile_ticks = stm_since(start);
+    ++_program_cache.stats.misses;
+    _program_cache.stats.compile_ms += stm_ms(compile_ticks);
+    if (status == GL_TRUE) {
+      _program_cache_store(program, key, compile_ticks);
+    }
+  }
+  _program_cache_release(entry);
+}
+
+#define glShaderSource _program_cache_glShaderSource
+#define glCompileShader _program_cache_glCompileShader
+#define glGetShaderiv _program_cache_glGetShaderiv
+#define glAttachShader _program_cache_glAttachShader
+#define glLinkProgram _program_cache_glLinkProgram
+#else
+bool program_cache_setup(const char* dir) {
+  (void)dir;
+  return false;
+}
+#endif  // PROGRAM_CACHE_GL
+#endif  // PROGRAM_CACHE_IMPL
+
+#endif  // PROGRAM_CACHE_H
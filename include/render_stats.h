@@ -0,0 +1,219 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+/*
+  Lightweight per-frame render statistics collected through the sokol-gfx
+  trace hooks (SOKOL_TRACE_HOOKS is enabled in the sokol-memtrack library).
+
+  Any hooks installed before render_stats_install() (e.g. the cdbgui
+  inspector) keep working, calls are forwarded to them. Counters are
+  accumulated until sg_commit() and then published as the last frame's
+  stats. Triangle counts assume triangle-list pipelines, which is all this
+  app uses.
+*/
+#include "sokol_gfx.h"
+#include <string.h>
+
+typedef struct render_stats_counters_t {
+  uint32_t passes;
+  uint32_t draws;
+  uint32_t instances;
+  uint64_t triangles;
+  uint32_t pipelines;
+  uint32_t bindings;
+  uint32_t uniforms;
+  uint32_t buffer_updates;
+  uint32_t image_updates;
+  uint64_t upload_bytes;
+} render_stats_counters_t;
+
+static struct {
+  bool installed;
+  sg_trace_hooks prev;
+  render_stats_counters_t frame;
+  render_stats_counters_t last;
+} _render_stats;
+
+static uint64_t _render_stats_image_data_size(const sg_image_data* data) {
+  uint64_t size = 0;
+  for (int face = 0; face < 6; ++face) {
+    for (int mip = 0; mip < SG_MAX_MIPMAPS; ++mip) {
+      size += data->subimage[face][mip].size;
+    }
+  }
+  return size;
+}
+
+static void _render_stats_make_buffer(const sg_buffer_desc* desc,
+                                      sg_buffer result,
+                                      void* user_data) {
+  (void)user_data;
+  _render_stats.frame.upload_bytes += desc->data.size;
+  if (_render_stats.prev.make_buffer) {
+    _render_stats.prev.make_buffer(desc, result, _render_stats.prev.user_data);
+  }
+}
+
+static void _render_stats_make_image(const sg_image_desc* desc,
+                                     sg_image result,
+                                     void* user_data) {
+  (void)user_data;
+  _render_stats.frame.upload_bytes += _render_stats_image_data_size(&desc->data);
+  if (_render_stats.prev.make_image) {
+    _render_stats.prev.make_image(desc, result, _render_stats.prev.user_data);
+  }
+}
+
+static void _render_stats_init_image(sg_image img,
+                                     const sg_image_desc* desc,
+                                     void* user_data) {
+  (void)user_data;
+  _render_stats.frame.upload_bytes += _render_stats_image_data_size(&desc->data);
+  if (_render_stats.prev.init_image) {
+    _render_stats.prev.init_image(img, desc, _render_stats.prev.user_data);
+  }
+}
+
+static void _render_stats_update_buffer(sg_buffer buf,
+                                        const sg_range* data,
+                                        void* user_data) {
+  (void)user_data;
+  ++_render_stats.frame.buffer_updates;
+  _render_stats.frame.upload_bytes += data->size;
+  if (_render_stats.prev.update_buffer) {
+    _render_stats.prev.update_buffer(buf, data, _render_stats.prev.user_data);
+  }
+}
+
+static void _render_stats_append_buffer(sg_buffer buf,
+                                        const sg_range* data,
+                                        int result,
+                                        void* user_data) {
+  (void)user_data;
+  ++_render_stats.frame.buffer_updates;
+  _render_stats.frame.upload_bytes += data->size;
+  if (_render_stats.prev.append_buffer) {
+    _render_stats.prev.append_buffer(buf, data, result,
+                                     _render_stats.prev.user_data);
+  }
+}
+
+static void _render_stats_update_image(sg_image img,
+                                       const sg_image_data* data,
+                                       void* user_data) {
+  (void)user_data;
+  ++_render_stats.frame.image_updates;
+  _render_stats.frame.upload_bytes += _render_stats_image_data_size(data);
+  if (_render_stats.prev.update_image) {
+    _render_stats.prev.update_image(img, data, _render_stats.prev.user_data);
+  }
+}
+
+static void _render_stats_begin_default_pass(const sg_pass_action* pass_action,
+                                             int width,
+                                             int height,
+                                             void* user_data) {
+  (void)user_data;
+  ++_render_stats.frame.passes;
+  if (_render_stats.prev.begin_default_pass) {
+    _render_stats.prev.begin_default_pass(pass_action, width, height,
+                                          _render_stats.prev.user_data);
+  }
+}
+
+static void _render_stats_begin_pass(sg_pass pass,
+                                     const sg_pass_action* pass_action,
+                                     void* user_data) {
+  (void)user_data;
+  ++_render_stats.frame.passes;
+  if (_render_stats.prev.begin_pass) {
+    _render_stats.prev.begin_pass(pass, pass_action,
+                                  _render_stats.prev.user_data);
+  }
+}
+
+static void _render_stats_apply_pipeline(sg_pipeline pip, void* user_data) {
+  (void)user_data;
+  ++_render_stats.frame.pipelines;
+  if (_render_stats.prev.apply_pipeline) {
+    _render_stats.prev.apply_pipeline(pip, _render_stats.prev.user_data);
+  }
+}
+
+static void _render_stats_apply_bindings(const sg_bindings* bindings,
+                                         void* user_data) {
+  (void)user_data;
+  ++_render_stats.frame.bindings;
+  if (_render_stats.prev.apply_bindings) {
+    _render_stats.prev.apply_bindings(bindings, _render_stats.prev.user_data);
+  }
+}
+
+static void _render_stats_apply_uniforms(sg_shader_stage stage,
+                                         int ub_index,
+                                         const sg_range* data,
+                                         void* user_data) {
+  (void)user_data;
+  ++_render_stats.frame.uniforms;
+  if (_render_stats.prev.apply_uniforms) {
+    _render_stats.prev.apply_uniforms(stage, ub_index, data,
+                                      _render_stats.prev.user_data);
+  }
+}
+
+static void _render_stats_draw(int base_element,
+                               int num_elements,
+                               int num_instances,
+                               void* user_data) {
+  (void)user_data;
+  ++_render_stats.frame.draws;
+  _render_stats.frame.instances += (uint32_t)num_instances;
+  _render_stats.frame.triangles +=
+      (uint64_t)(num_elements / 3) * (uint64_t)num_instances;
+  if (_render_stats.prev.draw) {
+    _render_stats.prev.draw(base_element, num_elements, num_instances,
+                            _render_stats.prev.user_data);
+  }
+}
+
+static void _render_stats_commit(void* user_data) {
+  (void)user_data;
+  _render_stats.last = _render_stats.frame;
+  memset(&_render_stats.frame, 0, sizeof(_render_stats.frame));
+  if (_render_stats.prev.commit) {
+    _render_stats.prev.commit(_render_stats.prev.user_data);
+  }
+}
+
+// Call after sg_setup() and after any other trace hooks are installed.
+static void render_stats_install(void) {
+  if (_render_stats.installed) {
+    return;
+  }
+  // hooks we don't count stay installed as they are, including user_data,
+  // our own hooks only use the global state
+  sg_trace_hooks hooks = sg_install_trace_hooks(&(sg_trace_hooks){0});
+  _render_stats.prev = hooks;
+  hooks.make_buffer = _render_stats_make_buffer;
+  hooks.make_image = _render_stats_make_image;
+  hooks.init_image = _render_stats_init_image;
+  hooks.update_buffer = _render_stats_update_buffer;
+  hooks.append_buffer = _render_stats_append_buffer;
+  hooks.update_image = _render_stats_update_image;
+  hooks.begin_default_pass = _render_stats_begin_default_pass;
+  hooks.begin_pass = _render_stats_begin_pass;
+  hooks.apply_pipeline = _render_stats_apply_pipeline;
+  hooks.apply_bindings = _render_stats_apply_bindings;
+  hooks.apply_uniforms = _render_stats_apply_uniforms;
+  hooks.draw = _render_stats_draw;
+  hooks.commit = _render_stats_commit;
+  sg_install_trace_hooks(&hooks);
+  _render_stats.installed = true;
+}
+
+// Stats of the last committed frame.
+static render_stats_counters_t render_stats_last(void) {
+  return _render_stats.last;
+}
+
+#endif  // RENDER_STATS_H
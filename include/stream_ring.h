@@ -0,0 +1,89 @@
+#ifndef STREAM_RING_H
+#define STREAM_RING_H
+
+#include "sokol_gfx.h"
+
+/*
+  Triple-buffered ring for per-frame streaming vertex data.
+
+  Each frame owns one SG_USAGE_STREAM buffer of `frame_size` bytes, and all
+  of that frame's data is sub-allocated from it with sg_append_buffer(). The
+  returned offsets go into sg_bindings.vertex_buffer_offsets[]. Rotating
+  through STREAM_RING_NUM_FRAMES buffers means the CPU never writes into a
+  buffer the GPU may still be reading from the previous two frames.
+*/
+#define STREAM_RING_NUM_FRAMES (3)
+
+typedef struct stream_ring_desc_t {
+  int frame_size;
+  const char* label;
+} stream_ring_desc_t;
+
+typedef struct stream_ring_t {
+  sg_buffer buffers[STREAM_RING_NUM_FRAMES];
+  int frame_size;
+  int current;
+  int frame_used;
+  // stats, used to size the ring
+  uint32_t frame_bytes;
+  uint32_t peak_frame_bytes;
+  uint64_t total_bytes;
+  uint32_t wraps;        // times the ring came back to its first buffer
+  uint32_t full_frames;  // frames that used more than 3/4 of their buffer
+  uint32_t overflows;
+} stream_ring_t;
+
+static void stream_ring_init(stream_ring_t* ring,
+                             const stream_ring_desc_t* desc) {
+  *ring = (stream_ring_t){.frame_size = desc->frame_size,
+                          .current = STREAM_RING_NUM_FRAMES - 1};
+  for (int i = 0; i < STREAM_RING_NUM_FRAMES; ++i) {
+    ring->buffers[i] =
+        sg_make_buffer(&(sg_buffer_desc){.size = (size_t)desc->frame_size,
+                                         .usage = SG_USAGE_STREAM,
+                                         .label = desc->label});
+  }
+}
+
+static void stream_ring_shutdown(stream_ring_t* ring) {
+  for (int i = 0; i < STREAM_RING_NUM_FRAMES; ++i) {
+    sg_destroy_buffer(ring->buffers[i]);
+  }
+}
+
+// Call once per frame before the first stream_ring_push().
+static void stream_ring_begin_frame(stream_ring_t* ring) {
+  if (ring->frame_used * 4 > ring->frame_size * 3) {
+    ++ring->full_frames;
+  }
+  ring->current = (ring->current + 1) % STREAM_RING_NUM_FRAMES;
+  if (ring->current == 0) {
+    ++ring->wraps;
+  }
+  ring->frame_used = 0;
+  ring->frame_bytes = 0;
+}
+
+static sg_buffer stream_ring_buffer(const stream_ring_t* ring) {
+  return ring->buffers[ring->current];
+}
+
+// Appends data to the current frame's buffer, returns the byte offset to
+// bind it at, or -1 if the frame's slice of the ring is full.
+static int stream_ring_push(stream_ring_t* ring, sg_range data) {
+  const int size = (int)((data.size + 3) & ~(size_t)3);
+  if (ring->frame_used + size > ring->frame_size) {
+    ++ring->overflows;
+    return -1;
+  }
+  const int offset = sg_append_buffer(stream_ring_buffer(ring), &data);
+  ring->frame_used = offset + size;
+  ring->frame_bytes += (uint32_t)data.size;
+  ring->total_bytes += data.size;
+  if (ring->frame_bytes > ring->peak_frame_bytes) {
+    ring->peak_frame_bytes = ring->frame_bytes;
+  }
+  return offset;
+}
+
+#endif  // STREAM_RING_H
@@ -0,0 +1,528 @@
+#ifndef TEXCOMP_H
+#define TEXCOMP_H
+
+/*
+  CPU block compression of RGBA8 images into the texture pack's block
+  formats (see texture_pack_format.h), used offline by the texture cooker.
+
+  BC1/BC3 colors: endpoints along the principal axis of the block's
+  colors, one least-squares refinement of the endpoints, and an SSE2 index
+  search that handles four texels at once. BC3 alpha: min/max endpoints,
+  eight-value mode. ETC2 RGB8: plain ETC1 blocks (which every ETC2 decoder
+  reads as such), trying both sub-block orientations in differential and
+  individual mode with every intensity table.
+
+  texcomp_encode_rows() compresses a range of block rows, so an image can
+  be split across job pool workers.
+*/
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "texture_pack_format.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXCOMP_SSE2 (1)
+#else
+#define TEXCOMP_SSE2 (0)
+#endif
+
+// Texels of one block in row-major order, edges replicate the last
+// row/column for images that aren't a multiple of 4.
+static void _texcomp_fetch_block(const uint8_t* src,
+                                 int width,
+                                 int height,
+                                 int bx,
+                                 int by,
+                                 uint8_t block[64]) {
+  for (int y = 0; y < 4; ++y) {
+    const int sy = by * 4 + y < height ? by * 4 + y : height - 1;
+    for (int x = 0; x < 4; ++x) {
+      const int sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+      memcpy(&block[(y * 4 + x) * 4], &src[((size_t)sy * width + sx) * 4], 4);
+    }
+  }
+}
+
+static int _texcomp_clamp(int v, int lo, int hi) {
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+//== BC1 / BC3 ==============================================================
+
+static uint16_t _texcomp_to_565(const float c[3]) {
+  const int r = _texcomp_clamp((int)(c[0] * (31.0f / 255.0f) + 0.5f), 0, 31);
+  const int g = _texcomp_clamp((int)(c[1] * (63.0f / 255.0f) + 0.5f), 0, 63);
+  const int b = _texcomp_clamp((int)(c[2] * (31.0f / 255.0f) + 0.5f), 0, 31);
+  return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void _texcomp_from_565(uint16_t c, int rgb[3]) {
+  const int r = (c >> 11) & 31;
+  const int g = (c >> 5) & 63;
+  const int b = c & 31;
+  rgb[0] = (r << 3) | (r >> 2);
+  rgb[1] = (g << 2) | (g >> 4);
+  rgb[2] = (b << 3) | (b >> 2);
+}
+
+static void _texcomp_bc1_palette(uint16_t c0, uint16_t c1, int palette[4][3]) {
+  _texcomp_from_565(c0, palette[0]);
+  _texcomp_from_565(c1, palette[1]);
+  for (int i = 0; i < 3; ++i) {
+    palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+    palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+  }
+}
+
+// Picks the nearest palette entry for every texel, returns the summed
+// squared error.
+static uint32_t _texcomp_bc1_indices(const uint8_t block[64],
+                                     const int palette[4][3],
+                                     uint8_t indices[16]) {
+  uint32_t total = 0;
+#if TEXCOMP_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  __m128i pal[4];
+  for (int i = 0; i < 4; ++i) {
+    pal[i] = _mm_setr_epi16((short)palette[i][0], (short)palette[i][1],
+                            (short)palette[i][2], 0, (short)palette[i][0],
+                            (short)palette[i][1], (short)palette[i][2], 0);
+  }
+  // alpha doesn't take part in the distance
+  const __m128i rgb_mask = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+  for (int t = 0; t < 16; t += 4) {
+    const __m128i texels = _mm_loadu_si128((const __m128i*)&block[t * 4]);
+    const __m128i lo = _mm_and_si128(_mm_unpacklo_epi8(texels, zero), rgb_mask);
+    const __m128i hi = _mm_and_si128(_mm_unpackhi_epi8(texels, zero), rgb_mask);
+    __m128i best = _mm_set1_epi32(0x7fffffff);
+    __m128i best_index = zero;
+    for (int i = 0; i < 4; ++i) {
+      const __m128i dlo = _mm_sub_epi16(lo, pal[i]);
+      const __m128i dhi = _mm_sub_epi16(hi, pal[i]);
+      // (r^2 + g^2, b^2) pairs for two texels per register
+      const __m128 sqlo = _mm_castsi128_ps(_mm_madd_epi16(dlo, dlo));
+      const __m128 sqhi = _mm_castsi128_ps(_mm_madd_epi16(dhi, dhi));
+      const __m128i dist = _mm_add_epi32(
+          _mm_castps_si128(_mm_shuffle_ps(sqlo, sqhi, _MM_SHUFFLE(2, 0, 2, 0))),
+          _mm_castps_si128(_mm_shuffle_ps(sqlo, sqhi, _MM_SHUFFLE(3, 1, 3, 1))));
+      const __m128i closer = _mm_cmplt_epi32(dist, best);
+      best = _mm_or_si128(_mm_and_si128(closer, dist),
+                          _mm_andnot_si128(closer, best));
+      best_index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(i)),
+                                _mm_andnot_si128(closer, best_index));
+    }
+    int32_t dists[4], idx[4];
+    _mm_storeu_si128((__m128i*)dists, best);
+    _mm_storeu_si128((__m128i*)idx, best_index);
+    for (int k = 0; k < 4; ++k) {
+      indices[t + k] = (uint8_t)idx[k];
+      total += (uint32_t)dists[k];
+    }
+  }
+#else
+  for (int t = 0; t < 16; ++t) {
+    uint32_t best = 0xffffffff;
+    for (int i = 0; i < 4; ++i) {
+      const int dr = block[t * 4 + 0] - palette[i][0];
+      const int dg = block[t * 4 + 1] - palette[i][1];
+      const int db = block[t * 4 + 2] - palette[i][2];
+      const uint32_t dist = (uint32_t)(dr * dr + dg * dg + db * db);
+      if (dist < best) {
+        best = dist;
+        indices[t] = (uint8_t)i;
+      }
+    }
+    total += best;
+  }
+#endif
+  return total;
+}
+
+// Endpoints at the extremes of the colors projected on their principal
+// axis (power iteration on the covariance matrix).
+static void _texcomp_bc1_pca_endpoints(const uint8_t block[64],
+                                       float e0[3],
+                                       float e1[3]) {
+  float mean[3] = {0};
+  for (int t = 0; t < 16; ++t) {
+    for (int i = 0; i < 3; ++i) {
+      mean[i] += block[t * 4 + i];
+    }
+  }
+  for (int i = 0; i < 3; ++i) {
+    mean[i] /= 16.0f;
+  }
+  float cov[6] = {0};  // rr rg rb gg gb bb
+  for (int t = 0; t < 16; ++t) {
+    const float r = block[t * 4 + 0] - mean[0];
+    const float g = block[t * 4 + 1] - mean[1];
+    const float b = block[t * 4 + 2] - mean[2];
+    cov[0] += r * r;
+    cov[1] += r * g;
+    cov[2] += r * b;
+    cov[3] += g * g;
+    cov[4] += g * b;
+    cov[5] += b * b;
+  }
+  float axis[3] = {1.0f, 1.0f, 1.0f};
+  for (int iter = 0; iter < 8; ++iter) {
+    const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+    const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+    const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+    float len = x * x + y * y + z * z;
+    if (len < 1e-8f) {
+      break;
+    }
+    len = 1.0f / sqrtf(len);
+    axis[0] = x * len;
+    axis[1] = y * len;
+    axis[2] = z * len;
+  }
+  float min_t = 0.0f, max_t = 0.0f;
+  for (int t = 0; t < 16; ++t) {
+    const float proj = (block[t * 4 + 0] - mean[0]) * axis[0] +
+                       (block[t * 4 + 1] - mean[1]) * axis[1] +
+                       (block[t * 4 + 2] - mean[2]) * axis[2];
+    min_t = proj < min_t ? proj : min_t;
+    max_t = proj > max_t ? proj : max_t;
+  }
+  for (int i = 0; i < 3; ++i) {
+    e0[i] = mean[i] + axis[i] * max_t;
+    e1[i] = mean[i] + axis[i] * min_t;
+  }
+}
+
+// Least-squares endpoints for the given indices, false if the indices
+// don't determine them (all texels use the same weight).
+static bool _texcomp_bc1_refine(const uint8_t block[64],
+                                const uint8_t indices[16],
+                                float e0[3],
+                                float e1[3]) {
+  static const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+  float aa = 0, bb = 0, ab = 0;
+  float ax[3] = {0}, bx[3] = {0};
+  for (int t = 0; t < 16; ++t) {
+    const float a = weights[indices[t]];
+    const float b = 1.0f - a;
+    aa += a * a;
+    bb += b * b;
+    ab += a * b;
+    for (int i = 0; i < 3; ++i) {
+      ax[i] += a * block[t * 4 + i];
+      bx[i] += b * block[t * 4 + i];
+    }
+  }
+  const float det = aa * bb - ab * ab;
+  if (det < 1e-6f) {
+    return false;
+  }
+  const float inv = 1.0f / det;
+  for (int i = 0; i < 3; ++i) {
+    e0[i] = (ax[i] * bb - bx[i] * ab) * inv;
+    e1[i] = (bx[i] * aa - ax[i] * ab) * inv;
+  }
+  return true;
+}
+
+// Quantizes the endpoints and writes the color block in four-color mode.
+static uint32_t _texcomp_bc1_emit(const uint8_t block[64],
+                                  const float e0[3],
+                                  const float e1[3],
+                                  uint8_t out[8],
+                                  uint8_t indices[16]) {
+  uint16_t c0 = _texcomp_to_565(e0);
+  uint16_t c1 = _texcomp_to_565(e1);
+  if (c0 < c1) {
+    const uint16_t tmp = c0;
+    c0 = c1;
+    c1 = tmp;
+  }
+  int palette[4][3];
+  _texcomp_bc1_palette(c0, c1, palette);
+  if (c0 == c1) {
+    // three-color mode, index 0 is the only one that's equal to c0. With
+    // every entry at c0 the ties pick index 0 and the error is the real one.
+    for (int i = 1; i < 4; ++i) {
+      memcpy(palette[i], palette[0], sizeof(palette[0]));
+    }
+  }
+  const uint32_t error = _texcomp_bc1_indices(block, palette, indices);
+  uint32_t bits = 0;
+  for (int t = 0; t < 16; ++t) {
+    bits |= (uint32_t)indices[t] << (t * 2);
+  }
+  out[0] = (uint8_t)c0;
+  out[1] = (uint8_t)(c0 >> 8);
+  out[2] = (uint8_t)c1;
+  out[3] = (uint8_t)(c1 >> 8);
+  out[4] = (uint8_t)bits;
+  out[5] = (uint8_t)(bits >> 8);
+  out[6] = (uint8_t)(bits >> 16);
+  out[7] = (uint8_t)(bits >> 24);
+  return error;
+}
+
+static void texcomp_encode_bc1_block(const uint8_t block[64], uint8_t out[8]) {
+  float e0[3], e1[3];
+  uint8_t indices[16];
+  _texcomp_bc1_pca_endpoints(block, e0, e1);
+  const uint32_t error = _texcomp_bc1_emit(block, e0, e1, out, indices);
+  if (error > 0 && _texcomp_bc1_refine(block, indices, e0, e1)) {
+    uint8_t refined[8];
+    if (_texcomp_bc1_emit(block, e0, e1, refined, indices) < error) {
+      memcpy(out, refined, 8);
+    }
+  }
+}
+
+static void _texcomp_encode_bc3_alpha(const uint8_t block[64],
+                                      uint8_t out[8]) {
+  int a0 = 0, a1 = 255;
+  for (int t = 0; t < 16; ++t) {
+    const int a = block[t * 4 + 3];
+    a0 = a > a0 ? a : a0;
+    a1 = a < a1 ? a : a1;
+  }
+  out[0] = (uint8_t)a0;
+  out[1] = (uint8_t)a1;
+  uint64_t bits = 0;
+  if (a0 > a1) {
+    // eight-value mode: index 0 = a0, 1 = a1, 2..7 interpolate a0 -> a1
+    int palette[8];
+    palette[0] = a0;
+    palette[1] = a1;
+    for (int i = 1; i < 7; ++i) {
+      palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+    }
+    for (int t = 0; t < 16; ++t) {
+      const int a = block[t * 4 + 3];
+      int best = 0, best_dist = 256;
+      for (int i = 0; i < 8; ++i) {
+        const int dist = a > palette[i] ? a - palette[i] : palette[i] - a;
+        if (dist < best_dist) {
+          best_dist = dist;
+          best = i;
+        }
+      }
+      bits |= (uint64_t)best << (t * 3);
+    }
+  }
+  for (int i = 0; i < 6; ++i) {
+    out[2 + i] = (uint8_t)(bits >> (i * 8));
+  }
+}
+
+static void texcomp_encode_bc3_block(const uint8_t block[64], uint8_t out[16]) {
+  _texcomp_encode_bc3_alpha(block, out);
+  texcomp_encode_bc1_block(block, out + 8);
+}
+
+//== ETC1 / ETC2 RGB8 ======================================================
+
+static const int _texcomp_etc_tables[8][2] = {
+    {2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183},
+};
+
+// Texel indices (row-major) of the two sub-blocks: side by side 2x4 halves
+// without flip, top/bottom 4x2 halves with flip.
+static void _texcomp_etc_subblocks(bool flip, int sub[2][8]) {
+  int n[2] = {0, 0};
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 4; ++x) {
+      const int half = flip ? (y >= 2) : (x >= 2);
+      sub[half][n[half]++] = y * 4 + x;
+    }
+  }
+}
+
+// Best intensity table and modifiers for a sub-block around `base`.
+static uint32_t _texcomp_etc_fit(const uint8_t block[64],
+                                 const int texels[8],
+                                 const int base[3],
+                                 int* table_out,
+                                 uint8_t modifiers[8]) {
+  uint32_t best_error = 0xffffffff;
+  for (int table = 0; table < 8; ++table) {
+    const int mods[4] = {_texcomp_etc_tables[table][0],
+                         _texcomp_etc_tables[table][1],
+                         -_texcomp_etc_tables[table][0],
+                         -_texcomp_etc_tables[table][1]};
+    uint32_t error = 0;
+    uint8_t picked[8];
+    for (int t = 0; t < 8; ++t) {
+      const uint8_t* texel = &block[texels[t] * 4];
+      uint32_t best = 0xffffffff;
+      for (int m = 0; m < 4; ++m) {
+        uint32_t dist = 0;
+        for (int i = 0; i < 3; ++i) {
+          const int d = _texcomp_clamp(base[i] + mods[m], 0, 255) - texel[i];
+          dist += (uint32_t)(d * d);
+        }
+        if (dist < best) {
+          best = dist;
+          picked[t] = (uint8_t)m;
+        }
+      }
+      error += best;
+      if (error >= best_error) {
+        break;
+      }
+    }
+    if (error < best_error) {
+      best_error = error;
+      *table_out = table;
+      memcpy(modifiers, picked, 8);
+    }
+  }
+  return best_error;
+}
+
+static void _texcomp_etc_average(const uint8_t block[64],
+                                 const int texels[8],
+                                 float avg[3]) {
+  avg[0] = avg[1] = avg[2] = 0.0f;
+  for (int t = 0; t < 8; ++t) {
+    for (int i = 0; i < 3; ++i) {
+      avg[i] += block[texels[t] * 4 + i];
+    }
+  }
+  for (int i = 0; i < 3; ++i) {
+    avg[i] /= 8.0f;
+  }
+}
+
+typedef struct _texcomp_etc_mode_t {
+  uint32_t error;
+  bool diff;
+  int colors[2][3];  // quantized, 4 or 5 bits
+  int tables[2];
+  uint8_t modifiers[2][8];
+} _texcomp_etc_mode_t;
+
+static void _texcomp_etc_try(const uint8_t block[64],
+                             const int sub[2][8],
+                             bool diff,
+                             _texcomp_etc_mode_t* mode) {
+  const int bits = diff ? 5 : 4;
+  const int max = (1 << bits) - 1;
+  mode->diff = diff;
+  mode->error = 0;
+  for (int s = 0; s < 2; ++s) {
+    float avg[3];
+    _texcomp_etc_average(block, sub[s], avg);
+    for (int i = 0; i < 3; ++i) {
+      mode->colors[s][i] =
+          _texcomp_clamp((int)(avg[i] * max / 255.0f + 0.5f), 0, max);
+    }
+  }
+  if (diff) {
+    // the second color is stored as a 3-bit signed delta
+    for (int i = 0; i < 3; ++i) {
+      const int d = mode->colors[1][i] - mode->colors[0][i];
+      if (d < -4 || d > 3) {
+        mode->error = 0xffffffff;
+        return;
+      }
+    }
+  }
+  for (int s = 0; s < 2; ++s) {
+    int base[3];
+    for (int i = 0; i < 3; ++i) {
+      const int c = mode->colors[s][i];
+      base[i] = diff ? (c << 3) | (c >> 2) : (c << 4) | c;
+    }
+    mode->error += _texcomp_etc_fit(block, sub[s], base, &mode->tables[s],
+                                    mode->modifiers[s]);
+  }
+}
+
+static void texcomp_encode_etc2_rgb8_block(const uint8_t block[64],
+                                           uint8_t out[8]) {
+  _texcomp_etc_mode_t best = {.error = 0xffffffff};
+  bool best_flip = false;
+  for (int flip = 0; flip < 2; ++flip) {
+    int sub[2][8];
+    _texcomp_etc_subblocks(flip, sub);
+    for (int diff = 1; diff >= 0; --diff) {
+      _texcomp_etc_mode_t mode;
+      _texcomp_etc_try(block, sub, diff, &mode);
+      if (mode.error < best.error) {
+        best = mode;
+        best_flip = flip;
+      }
+    }
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (best.diff) {
+      const int d = best.colors[1][i] - best.colors[0][i];
+      out[i] = (uint8_t)((best.colors[0][i] << 3) | (d & 7));
+    } else {
+      out[i] = (uint8_t)((best.colors[0][i] << 4) | best.colors[1][i]);
+    }
+  }
+  out[3] = (uint8_t)((best.tables[0] << 5) | (best.tables[1] << 2) |
+                     (best.diff << 1) | best_flip);
+  // modifiers 0 = +small, 1 = +large, 2 = -small, 3 = -large are the
+  // (msb, lsb) pairs of the pixel indices, texels are numbered column-major
+  int sub[2][8];
+  _texcomp_etc_subblocks(best_flip, sub);
+  uint32_t msb = 0, lsb = 0;
+  for (int s = 0; s < 2; ++s) {
+    for (int t = 0; t < 8; ++t) {
+      const int texel = sub[s][t];
+      const int bit = (texel % 4) * 4 + texel / 4;
+      const int value = best.modifiers[s][t];
+      msb |= (uint32_t)(value >> 1) << bit;
+      lsb |= (uint32_t)(value & 1) << bit;
+    }
+  }
+  out[4] = (uint8_t)(msb >> 8);
+  out[5] = (uint8_t)msb;
+  out[6] = (uint8_t)(lsb >> 8);
+  out[7] = (uint8_t)lsb;
+}
+
+//== images =================================================================
+
+static int texcomp_block_rows(int height) {
+  return (height + 3) / 4;
+}
+
+// Compresses block rows [row_begin, row_end) of a width x height RGBA8
+// image into `dst`, which holds texpack_surface_size() bytes for the whole
+// image.
+static void texcomp_encode_rows(uint32_t format,
+                                const uint8_t* src,
+                                int width,
+                                int height,
+                                uint8_t* dst,
+                                int row_begin,
+                                int row_end) {
+  const int blocks_x = (width + 3) / 4;
+  const int block_size = format == TEXPACK_FORMAT_BC3 ? 16 : 8;
+  uint8_t block[64];
+  for (int by = row_begin; by < row_end; ++by) {
+    for (int bx = 0; bx < blocks_x; ++bx) {
+      _texcomp_fetch_block(src, width, height, bx, by, block);
+      uint8_t* out = dst + ((size_t)by * blocks_x + bx) * block_size;
+      switch (format) {
+        case TEXPACK_FORMAT_BC1:
+          texcomp_encode_bc1_block(block, out);
+          break;
+        case TEXPACK_FORMAT_BC3:
+          texcomp_encode_bc3_block(block, out);
+          break;
+        case TEXPACK_FORMAT_ETC2_RGB8:
+          texcomp_encode_etc2_rgb8_block(block, out);
+          break;
+        default:
+          break;
+      }
+    }
+  }
+}
+
+#endif  // TEXCOMP_H
@@ -0,0 +1,307 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+/*
+  Disk cache of decoded RGBA8 surfaces for the loose image files, so the
+  second launch skips stb_image and the mip chain build.
+
+  Entries are keyed by a 64 bit xxHash (XXH64) of the source file's bytes
+  and live as one file per surface in the cache directory: a small header
+  followed by every mip level, back to back. A lookup memory maps the
+  entry and copies its levels into the caller's surface, a header that
+  doesn't match the wanted size or mip count, or levels that don't match
+  the header's checksum, count as a miss. Entries are written under a
+  temporary name unique to the process and the write, then renamed, so
+  concurrent writers of any number of launches and crashed launches never
+  leave a torn entry behind.
+
+  texture_cache_load() and texture_cache_store() are safe to call from job
+  pool workers, the stats are counted on the main thread with
+  texture_cache_count(). Without a file system (the web) or before
+  texture_cache_setup() the cache is off and every lookup misses.
+*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "xxhash64.h"
+
+#if defined(__EMSCRIPTEN__)
+#define TEXTURE_CACHE_FILES (0)
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <direct.h>
+#define TEXTURE_CACHE_FILES (1)
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TEXTURE_CACHE_FILES (1)
+#endif
+
+#define TEXTURE_CACHE_MAGIC (0x43445848)  // 'HXDC'
+#define TEXTURE_CACHE_VERSION (2)
+#define TEXTURE_CACHE_MAX_LEVELS (16)
+#define TEXTURE_CACHE_PATH_SIZE (256)
+
+typedef enum texture_cache_result {
+  TEXTURE_CACHE_OFF,
+  TEXTURE_CACHE_HIT,
+  TEXTURE_CACHE_MISS,
+} texture_cache_result;
+
+typedef struct texture_cache_stats_t {
+  uint32_t hits;
+  uint32_t misses;
+  uint64_t hit_bytes;  // surface bytes served from the cache
+} texture_cache_stats_t;
+
+typedef struct _texture_cache_header_t {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t width;
+  uint32_t height;
+  uint32_t num_mips;
+  uint32_t data_size;  // of all levels
+  uint64_t checksum;   // see _texture_cache_checksum()
+} _texture_cache_header_t;
+
+static struct {
+  bool enabled;
+  char dir[TEXTURE_CACHE_PATH_SIZE];
+  // entries this process started writing, for the temporary names
+#if defined(_WIN32)
+  volatile LONG num_writes;
+#else
+  unsigned long num_writes;
+#endif
+  texture_cache_stats_t stats;
+} _texture_cache;
+
+// Key of the surface decoded from `data` without its top `dropped_mips`
+// levels, each size of a file gets its own entry.
+static uint64_t texture_cache_key(const void* data,
+                                  size_t size,
+                                  int dropped_mips) {
+  const uint64_t hash = xxh64(data, size);
+  return dropped_mips > 0 ? xxh64_merge(hash, (uint64_t)dropped_mips) : hash;
+}
+
+static size_t _texture_cache_level_size(int width, int height, int mip) {
+  const int w = width >> mip;
+  const int h = height >> mip;
+  return (size_t)(w > 0 ? w : 1) * (size_t)(h > 0 ? h : 1) * 4;
+}
+
+// The levels' hashes merged in order, they don't have to be contiguous.
+static uint64_t _texture_cache_checksum(int width,
+                                        int height,
+                                        int num_mips,
+                                        const uint8_t* const* levels) {
+  uint64_t checksum = 0;
+  for (int mip = 0; mip < num_mips; ++mip) {
+    const size_t level_size = _texture_cache_level_size(width, height, mip);
+    checksum =
+        xxh64_merge(checksum, xxh64(levels[mip], level_size));
+  }
+  return checksum;
+}
+
+static void _texture_cache_path(char* path, size_t size, uint64_t key) {
+  snprintf(path, size, "%s/%016llx.hxdc", _texture_cache.dir,
+           (unsigned long long)key);
+}
+
+// `path` with the process id and the number of the write, unique among
+// the writers of all launches sharing the cache directory.
+static void _texture_cache_tmp_path(char* tmp_path,
+                                    size_t size,
+                                    const char* path) {
+#if defined(_WIN32)
+  const unsigned long pid = (unsigned long)GetCurrentProcessId();
+  const unsigned long write =
+      (unsigned long)InterlockedIncrement(&_texture_cache.num_writes);
+#elif TEXTURE_CACHE_FILES
+  const unsigned long pid = (unsigned long)getpid();
+  const unsigned long write =
+      __atomic_add_fetch(&_texture_cache.num_writes, 1, __ATOMIC_RELAXED);
+#else
+  const unsigned long pid = 0;
+  const unsigned long write = 0;
+#endif
+  snprintf(tmp_path, size, "%s.%lu.%lu.tmp", path, pid, write);
+}
+
+// Creates `dir` if needed and turns the cache on.
+static bool texture_cache_setup(const char* dir) {
+  memset(&_texture_cache, 0, sizeof(_texture_cache));
+#if TEXTURE_CACHE_FILES
+  if (strlen(dir) + 32 >= TEXTURE_CACHE_PATH_SIZE) {
+    return false;
+  }
+  strcpy(_texture_cache.dir, dir);
+#if defined(_WIN32)
+  _mkdir(dir);
+  const DWORD attributes = GetFileAttributesA(dir);
+  _texture_cache.enabled = attributes != INVALID_FILE_ATTRIBUTES &&
+                           (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+  mkdir(dir, 0755);
+  struct stat st;
+  _texture_cache.enabled = stat(dir, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+#else
+  (void)dir;
+#endif
+  return _texture_cache.enabled;
+}
+
+static bool texture_cache_enabled(void) {
+  return _texture_cache.enabled;
+}
+
+// Copies the cached surface `key` into `levels`, false on a miss.
+static bool texture_cache_load(uint64_t key,
+                               int width,
+                               int height,
+                               int num_mips,
+                               uint8_t* const* levels) {
+  if (!_texture_cache.enabled || num_mips > TEXTURE_CACHE_MAX_LEVELS) {
+    return false;
+  }
+  size_t data_size = 0;
+  for (int mip = 0; mip < num_mips; ++mip) {
+    data_size += _texture_cache_level_size(width, height, mip);
+  }
+  const size_t file_size = sizeof(_texture_cache_header_t) + data_size;
+  char path[TEXTURE_CACHE_PATH_SIZE];
+  _texture_cache_path(path, sizeof(path), key);
+
+  const uint8_t* data = NULL;
+#if defined(_WIN32)
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER size;
+  HANDLE mapping = NULL;
+  if (GetFileSizeEx(file, &size) && (size_t)size.QuadPart == file_size) {
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  }
+  if (mapping) {
+    data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+  }
+  CloseHandle(file);
+#elif TEXTURE_CACHE_FILES
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size == file_size) {
+    void* mapped = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    data = mapped != MAP_FAILED ? (const uint8_t*)mapped : NULL;
+  }
+  // the mapping stays valid without the descriptor
+  close(fd);
+#endif
+  if (!data) {
+    return false;
+  }
+  _texture_cache_header_t header;
+  memcpy(&header, data, sizeof(header));
+  bool hit = header.magic == TEXTURE_CACHE_MAGIC &&
+             header.version == TEXTURE_CACHE_VERSION && header.key == key &&
+             header.width == (uint32_t)width &&
+             header.height == (uint32_t)height &&
+             header.num_mips == (uint32_t)num_mips &&
+             header.data_size == data_size;
+  const uint8_t* src_levels[TEXTURE_CACHE_MAX_LEVELS];
+  const uint8_t* src = data + sizeof(header);
+  for (int mip = 0; mip < num_mips; ++mip) {
+    src_levels[mip] = src;
+    src += _texture_cache_level_size(width, height, mip);
+  }
+  // a damaged file is verified before it gets near the caller's surface
+  hit = hit && _texture_cache_checksum(width, height, num_mips,
+                                       src_levels) == header.checksum;
+  if (hit) {
+    for (int mip = 0; mip < num_mips; ++mip) {
+      memcpy(levels[mip], src_levels[mip],
+             _texture_cache_level_size(width, height, mip));
+    }
+  }
+#if defined(_WIN32)
+  UnmapViewOfFile(data);
+#elif TEXTURE_CACHE_FILES
+  munmap((void*)data, file_size);
+#endif
+  return hit;
+}
+
+// Writes the surface in `levels` as the entry for `key`. Failures only
+// cost the next launch a decode.
+static void texture_cache_store(uint64_t key,
+                                int width,
+                                int height,
+                                int num_mips,
+                                uint8_t* const* levels) {
+  if (!_texture_cache.enabled || num_mips > TEXTURE_CACHE_MAX_LEVELS) {
+    return;
+  }
+  _texture_cache_header_t header = {.magic = TEXTURE_CACHE_MAGIC,
+                                    .version = TEXTURE_CACHE_VERSION,
+                                    .key = key,
+                                    .width = (uint32_t)width,
+                                    .height = (uint32_t)height,
+                                    .num_mips = (uint32_t)num_mips};
+  for (int mip = 0; mip < num_mips; ++mip) {
+    header.data_size +=
+        (uint32_t)_texture_cache_level_size(width, height, mip);
+  }
+  header.checksum = _texture_cache_checksum(
+      width, height, num_mips, (const uint8_t* const*)levels);
+  char path[TEXTURE_CACHE_PATH_SIZE];
+  char tmp_path[TEXTURE_CACHE_PATH_SIZE + 48];
+  _texture_cache_path(path, sizeof(path), key);
+  _texture_cache_tmp_path(tmp_path, sizeof(tmp_path), path);
+  FILE* fp = fopen(tmp_path, "wb");
+  if (!fp) {
+    return;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+  for (int mip = 0; ok && mip < num_mips; ++mip) {
+    ok = fwrite(levels[mip], _texture_cache_level_size(width, height, mip), 1,
+                fp) == 1;
+  }
+  ok = fclose(fp) == 0 && ok;
+#if defined(_WIN32)
+  ok = ok && MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING);
+#else
+  ok = ok && rename(tmp_path, path) == 0;
+#endif
+  if (!ok) {
+    remove(tmp_path);
+  }
+}
+
+// Counts a lookup's outcome, main thread only.
+static void texture_cache_count(texture_cache_result result, size_t bytes) {
+  if (result == TEXTURE_CACHE_HIT) {
+    ++_texture_cache.stats.hits;
+    _texture_cache.stats.hit_bytes += bytes;
+  } else if (result == TEXTURE_CACHE_MISS) {
+    ++_texture_cache.stats.misses;
+  }
+}
+
+static texture_cache_stats_t texture_cache_stats(void) {
+  return _texture_cache.stats;
+}
+
+#endif  // TEXTURE_CACHE_H
@@ -0,0 +1,327 @@
+#ifndef TEXTURE_PACK_H
+#define TEXTURE_PACK_H
+
+/*
+  Runtime loader for the cooked texture pack (see texture_pack_format.h and
+  tools/texcooker.c).
+
+  The pack holds pre-decoded, pre-mipmapped surfaces, so images are created
+  straight from the fetched file without any decoding: the ranges of an
+  entry go directly into sg_image_desc.data. Surfaces may be stored in
+  several (block compressed) formats, texture_pack_find() returns the
+  first one sg_query_pixelformat() reports as sampleable.
+
+  Loading happens in two sfetch requests: a small chunked probe reads the
+  header and entry table to learn the file size and is cancelled right
+  after, then the whole file is fetched into a buffer of exactly that size.
+  When the texture pack is stored in the asset pack its size is already
+  known and it's read from there in one go (see asset_io.h).
+  Only one pack can be loading at a time. The pack's memory is released
+  when the loaded callback returns, sg_init_image() copies the data.
+*/
+#include "sokol_gfx.h"
+#include "sokol_fetch.h"
+#include "texture_pack_format.h"
+#include "buffer_pool.h"
+#include "asset_io.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TEXTURE_PACK_PROBE_SIZE \
+  (sizeof(texpack_header_t) + TEXPACK_MAX_ENTRIES * sizeof(texpack_entry_t))
+
+typedef struct texture_pack_t {
+  const uint8_t* data;
+  uint32_t size;
+  const texpack_header_t* header;
+  const texpack_entry_t* entries;
+} texture_pack_t;
+
+typedef struct texture_pack_desc_t {
+  const char* path;
+  uint32_t channel;
+  void (*loaded_cb)(const texture_pack_t* pack);
+  void (*fail_cb)(void);
+} texture_pack_desc_t;
+
+static struct {
+  texture_pack_desc_t desc;
+  bool probed;
+  uint8_t probe[TEXTURE_PACK_PROBE_SIZE];
+  uint8_t* buffer;
+  uint32_t size;
+} _texture_pack;
+
+static bool _texture_pack_check_header(const texpack_header_t* header) {
+  return header->magic == TEXPACK_MAGIC &&
+         header->version == TEXPACK_VERSION &&
+         header->num_entries <= TEXPACK_MAX_ENTRIES &&
+         header->file_size >= sizeof(texpack_header_t) +
+                                  header->num_entries * sizeof(texpack_entry_t);
+}
+
+static bool _texture_pack_check_entry(const texpack_entry_t* entry,
+                                      uint32_t file_size) {
+  switch (entry->type) {
+    case TEXPACK_TYPE_2D:
+      if (entry->num_slices != 1) {
+        return false;
+      }
+      break;
+    case TEXPACK_TYPE_CUBE:
+      if (entry->num_slices != 6 || entry->width != entry->height) {
+        return false;
+      }
+      break;
+    case TEXPACK_TYPE_ARRAY:
+      if (entry->num_slices < 1) {
+        return false;
+      }
+      break;
+    default:
+      return false;
+  }
+  if (entry->format >= TEXPACK_FORMAT_NUM || entry->width == 0 ||
+      entry->height == 0 || entry->num_mips < 1 ||
+      entry->num_mips > TEXPACK_MAX_MIPS || entry->num_mips > SG_MAX_MIPMAPS ||
+      entry->name[TEXPACK_NAME_SIZE - 1] != 0) {
+    return false;
+  }
+  for (uint32_t mip = 0; mip < entry->num_mips; ++mip) {
+    const uint32_t w = entry->width >> mip ? entry->width >> mip : 1;
+    const uint32_t h = entry->height >> mip ? entry->height >> mip : 1;
+    const uint32_t size =
+        texpack_surface_size(entry->format, w, h) * entry->num_slices;
+    if (entry->mip_sizes[mip] != size || entry->mip_offsets[mip] > file_size ||
+        file_size - entry->mip_offsets[mip] < size) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool _texture_pack_validate(texture_pack_t* pack) {
+  if (pack->size < sizeof(texpack_header_t)) {
+    return false;
+  }
+  pack->header = (const texpack_header_t*)pack->data;
+  pack->entries =
+      (const texpack_entry_t*)(pack->data + sizeof(texpack_header_t));
+  if (!_texture_pack_check_header(pack->header) ||
+      pack->header->file_size != pack->size) {
+    return false;
+  }
+  for (uint32_t i = 0; i < pack->header->num_entries; ++i) {
+    if (!_texture_pack_check_entry(&pack->entries[i], pack->size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void _texture_pack_fail(void) {
+  buffer_pool_free(_texture_pack.buffer);
+  _texture_pack.buffer = NULL;
+  if (_texture_pack.desc.fail_cb) {
+    _texture_pack.desc.fail_cb();
+  }
+}
+
+static void _texture_pack_fetch_callback(const sfetch_response_t* response) {
+  if (response->finished) {
+    // the asset pack read allocates the buffer itself
+    _texture_pack.buffer = (uint8_t*)response->buffer_ptr;
+  }
+  if (response->fetched) {
+    texture_pack_t pack = {.data = _texture_pack.buffer,
+                           .size = response->fetched_size};
+    if (!_texture_pack_validate(&pack)) {
+      _texture_pack_fail();
+      return;
+    }
+    _texture_pack.desc.loaded_cb(&pack);
+    buffer_pool_free(_texture_pack.buffer);
+    _texture_pack.buffer = NULL;
+  } else if (response->failed) {
+    _texture_pack_fail();
+  }
+}
+
+static void _texture_pack_probe_callback(const sfetch_response_t* response) {
+  if (response->fetched && !_texture_pack.probed) {
+    _texture_pack.probed = true;
+    sfetch_cancel(response->handle);
+    const texpack_header_t* header =
+        (const texpack_header_t*)response->buffer_ptr;
+    if (response->fetched_size < sizeof(texpack_header_t) ||
+        !_texture_pack_check_header(header)) {
+      _texture_pack_fail();
+      return;
+    }
+    _texture_pack.size = header->file_size;
+    _texture_pack.buffer = (uint8_t*)buffer_pool_alloc(_texture_pack.size);
+    if (!_texture_pack.buffer) {
+      _texture_pack_fail();
+      return;
+    }
+    sfetch_send(&(sfetch_request_t){.channel = _texture_pack.desc.channel,
+                                    .path = _texture_pack.desc.path,
+                                    .callback = _texture_pack_fetch_callback,
+                                    .buffer_ptr = _texture_pack.buffer,
+                                    .buffer_size = _texture_pack.size});
+  } else if (response->failed && !_texture_pack.probed) {
+    // the cancelled probe also ends up here once the header was read
+    _texture_pack.probed = true;
+    _texture_pack_fail();
+  }
+}
+
+// Starts loading the pack, either `loaded_cb` or `fail_cb` is called once
+// from sfetch_dowork().
+static void texture_pack_load(const texture_pack_desc_t* desc) {
+  _texture_pack.desc = *desc;
+  _texture_pack.probed = false;
+  _texture_pack.buffer = NULL;
+  if (asset_io_find(desc->path)) {
+    asset_io_send(&(sfetch_request_t){.channel = desc->channel,
+                                      .path = desc->path,
+                                      .callback = _texture_pack_fetch_callback});
+    return;
+  }
+  sfetch_send(&(sfetch_request_t){.channel = desc->channel,
+                                  .path = desc->path,
+                                  .callback = _texture_pack_probe_callback,
+                                  .buffer_ptr = _texture_pack.probe,
+                                  .buffer_size = sizeof(_texture_pack.probe),
+                                  .chunk_size = sizeof(_texture_pack.probe)});
+}
+
+// Points `pack` at a pack that's already in memory, such as a file fetched
+// through the asset registry. Returns false if it isn't a valid pack.
+static bool texture_pack_parse(texture_pack_t* pack,
+                               const uint8_t* data,
+                               uint32_t size) {
+  *pack = (texture_pack_t){.data = data, .size = size};
+  return _texture_pack_validate(pack);
+}
+
+static sg_pixel_format texture_pack_pixel_format(uint32_t format) {
+  switch (format) {
+    case TEXPACK_FORMAT_BC1:
+      return SG_PIXELFORMAT_BC1_RGBA;
+    case TEXPACK_FORMAT_BC3:
+      return SG_PIXELFORMAT_BC3_RGBA;
+    case TEXPACK_FORMAT_ETC2_RGB8:
+      return SG_PIXELFORMAT_ETC2_RGB8;
+    default:
+      return SG_PIXELFORMAT_RGBA8;
+  }
+}
+
+static const char* texture_pack_format_name(uint32_t format) {
+  switch (format) {
+    case TEXPACK_FORMAT_BC1:
+      return "BC1";
+    case TEXPACK_FORMAT_BC3:
+      return "BC3";
+    case TEXPACK_FORMAT_ETC2_RGB8:
+      return "ETC2";
+    default:
+      return "RGBA8";
+  }
+}
+
+// First entry called `name` in a format the GPU can sample, the cooker
+// stores them in order of preference.
+static const texpack_entry_t* texture_pack_find(const texture_pack_t* pack,
+                                                const char* name) {
+  for (uint32_t i = 0; i < pack->header->num_entries; ++i) {
+    const texpack_entry_t* entry = &pack->entries[i];
+    if (strcmp(entry->name, name) == 0 &&
+        sg_query_pixelformat(texture_pack_pixel_format(entry->format))
+            .sample) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+// GPU memory of the entry's image, all mips included.
+static size_t texture_pack_entry_size(const texpack_entry_t* entry) {
+  size_t size = 0;
+  for (uint32_t mip = 0; mip < entry->num_mips; ++mip) {
+    size += entry->mip_sizes[mip];
+  }
+  return size;
+}
+
+static sg_image_type texture_pack_image_type(const texpack_entry_t* entry) {
+  switch (entry->type) {
+    case TEXPACK_TYPE_CUBE:
+      return SG_IMAGETYPE_CUBE;
+    case TEXPACK_TYPE_ARRAY:
+      return SG_IMAGETYPE_ARRAY;
+    default:
+      return SG_IMAGETYPE_2D;
+  }
+}
+
+// Fills type, size, format, mipmaps, filters and data of `desc` from the
+// entry, the caller sets wrap modes and the label.
+static void texture_pack_image_desc(const texture_pack_t* pack,
+                                    const texpack_entry_t* entry,
+                                    sg_image_desc* desc) {
+  desc->type = texture_pack_image_type(entry);
+  desc->width = (int)entry->width;
+  desc->height = (int)entry->height;
+  if (entry->type == TEXPACK_TYPE_ARRAY) {
+    desc->num_slices = (int)entry->num_slices;
+  }
+  desc->num_mipmaps = (int)entry->num_mips;
+  desc->pixel_format = texture_pack_pixel_format(entry->format);
+  desc->min_filter =
+      entry->num_mips > 1 ? SG_FILTER_LINEAR_MIPMAP_LINEAR : SG_FILTER_LINEAR;
+  desc->mag_filter = SG_FILTER_LINEAR;
+  const int num_faces = entry->type == TEXPACK_TYPE_CUBE ? 6 : 1;
+  for (uint32_t mip = 0; mip < entry->num_mips; ++mip) {
+    const size_t face_size = entry->mip_sizes[mip] / num_faces;
+    for (int face = 0; face < num_faces; ++face) {
+      desc->data.subimage[face][mip] = (sg_range){
+          .ptr = pack->data + entry->mip_offsets[mip] + face * face_size,
+          .size = face_size};
+    }
+  }
+}
+
+// Leaves the top `dropped_mips` levels out of a desc filled by
+// texture_pack_image_desc(), the next level becomes the image's size.
+// Returns the bytes left out.
+static size_t texture_pack_drop_mips(const texpack_entry_t* entry,
+                                     int dropped_mips,
+                                     sg_image_desc* desc) {
+  if (dropped_mips <= 0 || dropped_mips >= (int)entry->num_mips) {
+    return 0;
+  }
+  size_t dropped = 0;
+  for (int mip = 0; mip < dropped_mips; ++mip) {
+    dropped += entry->mip_sizes[mip];
+  }
+  const uint32_t w = entry->width >> dropped_mips;
+  const uint32_t h = entry->height >> dropped_mips;
+  desc->width = w ? (int)w : 1;
+  desc->height = h ? (int)h : 1;
+  desc->num_mipmaps = (int)entry->num_mips - dropped_mips;
+  desc->min_filter = desc->num_mipmaps > 1 ? SG_FILTER_LINEAR_MIPMAP_LINEAR
+                                           : SG_FILTER_LINEAR;
+  for (int face = 0; face < SG_CUBEFACE_NUM; ++face) {
+    for (int mip = 0; mip < SG_MAX_MIPMAPS; ++mip) {
+      const int src = mip + dropped_mips;
+      desc->data.subimage[face][mip] = src < SG_MAX_MIPMAPS
+                                           ? desc->data.subimage[face][src]
+                                           : (sg_range){0};
+    }
+  }
+  return dropped;
+}
+
+#endif  // TEXTURE_PACK_H
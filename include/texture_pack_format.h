@@ -0,0 +1,80 @@
+#ifndef TEXTURE_PACK_FORMAT_H
+#define TEXTURE_PACK_FORMAT_H
+
+/*
+  File format of the cooked texture pack, shared by the texcooker tool and
+  the runtime loader (texture_pack.h).
+
+  Layout:
+    texpack_header_t
+    texpack_entry_t[num_entries]
+    surface data, each mip level 16-byte aligned
+
+  Within a mip level, the faces of a cubemap (in sokol's +X -X +Y -Y +Z -Z
+  order) or the slices of an array texture are stored back to back, so a
+  level is directly usable as sg_image_data.subimage[..][mip]. All offsets
+  are relative to the start of the file, everything is little endian.
+
+  A surface may be stored several times in different formats under the
+  same name, the cooker writes them in order of preference and the runtime
+  picks the first one the GPU can sample.
+*/
+#include <stdint.h>
+
+#define TEXPACK_MAGIC (0x43545848)  // 'HXTC'
+#define TEXPACK_VERSION (1)
+#define TEXPACK_NAME_SIZE (32)
+#define TEXPACK_MAX_MIPS (16)
+#define TEXPACK_MAX_ENTRIES (32)
+#define TEXPACK_ALIGN (16)
+
+typedef enum texpack_type {
+  TEXPACK_TYPE_2D,
+  TEXPACK_TYPE_CUBE,
+  TEXPACK_TYPE_ARRAY,
+} texpack_type;
+
+typedef enum texpack_format {
+  TEXPACK_FORMAT_RGBA8,
+  TEXPACK_FORMAT_BC1,        // 4x4 blocks, 8 bytes, opaque
+  TEXPACK_FORMAT_BC3,        // 4x4 blocks, 16 bytes, with alpha
+  TEXPACK_FORMAT_ETC2_RGB8,  // 4x4 blocks, 8 bytes, ETC1 compatible
+  TEXPACK_FORMAT_NUM
+} texpack_format;
+
+typedef struct texpack_header_t {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_entries;
+  uint32_t file_size;
+} texpack_header_t;
+
+typedef struct texpack_entry_t {
+  char name[TEXPACK_NAME_SIZE];
+  uint32_t type;
+  uint32_t format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t num_slices;  // 6 for cubemaps
+  uint32_t num_mips;
+  uint32_t mip_offsets[TEXPACK_MAX_MIPS];
+  uint32_t mip_sizes[TEXPACK_MAX_MIPS];  // all faces/slices of the level
+} texpack_entry_t;
+
+// Bytes of one face/slice of a mip level, block formats round up to whole
+// 4x4 blocks like sokol-gfx's surface pitch does.
+static uint32_t texpack_surface_size(uint32_t format,
+                                     uint32_t width,
+                                     uint32_t height) {
+  switch (format) {
+    case TEXPACK_FORMAT_BC1:
+    case TEXPACK_FORMAT_ETC2_RGB8:
+      return ((width + 3) / 4) * ((height + 3) / 4) * 8;
+    case TEXPACK_FORMAT_BC3:
+      return ((width + 3) / 4) * ((height + 3) / 4) * 16;
+    default:
+      return width * height * 4;
+  }
+}
+
+#endif  // TEXTURE_PACK_FORMAT_H
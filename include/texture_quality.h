@@ -0,0 +1,106 @@
+#ifndef TEXTURE_QUALITY_H
+#define TEXTURE_QUALITY_H
+
+/*
+  Load-time texture quality: the largest dimension the terrain layers and
+  skybox faces are created with, set with --quality=low|medium|high.
+
+  Surfaces larger than the quality's maximum are scaled down by whole
+  halvings, which are the top levels of their mip chain: the loose files
+  are decoded at full size into scratch memory on the job pool workers and
+  mipgen.h's box filter (SSE2) walks the chain down to the kept levels,
+  cooked pack entries simply skip their top mips. Only the kept levels are
+  cached, uploaded and resident, texture_quality_count() adds up what that
+  saves.
+
+  texture_quality_levels() may be called from workers, the rest is main
+  thread only.
+*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef enum texture_quality {
+  TEXTURE_QUALITY_LOW,
+  TEXTURE_QUALITY_MEDIUM,
+  TEXTURE_QUALITY_HIGH,
+  TEXTURE_QUALITY_NUM,
+} texture_quality;
+
+typedef struct texture_quality_stats_t {
+  uint32_t surfaces;  // surfaces created smaller than their source
+  // bytes of all surfaces at full size, mips included, and the part of it
+  // the quality left out
+  uint64_t full_bytes;
+  uint64_t saved_bytes;
+} texture_quality_stats_t;
+
+static struct {
+  texture_quality quality;
+  texture_quality_stats_t stats;
+} _texture_quality = {.quality = TEXTURE_QUALITY_HIGH};
+
+// largest dimension per quality, 0 keeps the source size
+static const int _texture_quality_max_dims[TEXTURE_QUALITY_NUM] = {256, 1024,
+                                                                   0};
+static const char* _texture_quality_names[TEXTURE_QUALITY_NUM] = {
+    "low", "medium", "high"};
+
+static void texture_quality_setup(texture_quality quality) {
+  memset(&_texture_quality, 0, sizeof(_texture_quality));
+  _texture_quality.quality = quality;
+}
+
+// Parses --quality=low|medium|high, high when it's missing or unknown.
+static texture_quality texture_quality_parse_args(int argc, char* argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--quality=", 10) != 0) {
+      continue;
+    }
+    for (int q = 0; q < TEXTURE_QUALITY_NUM; ++q) {
+      if (strcmp(argv[i] + 10, _texture_quality_names[q]) == 0) {
+        return (texture_quality)q;
+      }
+    }
+  }
+  return TEXTURE_QUALITY_HIGH;
+}
+
+static const char* texture_quality_name(void) {
+  return _texture_quality_names[_texture_quality.quality];
+}
+
+static int texture_quality_max_dim(void) {
+  return _texture_quality_max_dims[_texture_quality.quality];
+}
+
+// Top mip levels of a width x height surface the quality drops, at most
+// `max_levels`, so it keeps at least one level of its chain.
+static int texture_quality_levels(int width, int height, int max_levels) {
+  const int max_dim = texture_quality_max_dim();
+  int levels = 0;
+  while (max_dim > 0 && levels + 1 < max_levels &&
+         (width > max_dim || height > max_dim)) {
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+    ++levels;
+  }
+  return levels;
+}
+
+// Counts a surface created with `bytes` instead of `full_bytes`.
+static void texture_quality_count(size_t full_bytes, size_t bytes) {
+  texture_quality_stats_t* stats = &_texture_quality.stats;
+  stats->full_bytes += full_bytes;
+  if (bytes < full_bytes) {
+    ++stats->surfaces;
+    stats->saved_bytes += full_bytes - bytes;
+  }
+}
+
+static texture_quality_stats_t texture_quality_stats(void) {
+  return _texture_quality.stats;
+}
+
+#endif  // TEXTURE_QUALITY_H
@@ -0,0 +1,195 @@
+#ifndef TEXTURE_RESIDENCY_H
+#define TEXTURE_RESIDENCY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+  Residency of materials in the fixed number of layers ("slots") of an
+  array texture.
+
+  Every frame the caller touches the materials of the visible tiles with
+  texture_residency_touch(), then texture_residency_next_load() hands out
+  slots for the touched materials that aren't resident yet. Free slots go
+  first, then the least recently used resident slot that wasn't touched
+  this frame. Slots that are still loading are never evicted, and a
+  material that finds no slot stays on the placeholder until one frees up.
+  Materials that failed to load stay on the placeholder for good.
+
+  texture_residency_slot() is the remap table from material to layer, the
+  placeholder layer (num_slots) for anything that isn't resident.
+*/
+#define TEXTURE_RESIDENCY_MAX_SLOTS (32)
+#define TEXTURE_RESIDENCY_MAX_MATERIALS (64)
+
+typedef enum texture_residency_state {
+  TEXTURE_RESIDENCY_FREE,
+  TEXTURE_RESIDENCY_LOADING,
+  TEXTURE_RESIDENCY_RESIDENT,
+} texture_residency_state;
+
+typedef struct texture_residency_stats_t {
+  uint32_t loads;      // slots handed out to a material
+  uint32_t evictions;  // of those, slots that held another material
+  uint32_t misses;     // touches of materials that weren't resident
+} texture_residency_stats_t;
+
+typedef struct texture_residency_t {
+  int num_slots;
+  int num_materials;
+  uint32_t frame;
+  // per slot
+  texture_residency_state state[TEXTURE_RESIDENCY_MAX_SLOTS];
+  int slot_material[TEXTURE_RESIDENCY_MAX_SLOTS];
+  uint32_t last_used[TEXTURE_RESIDENCY_MAX_SLOTS];
+  // per material, -1 without a slot
+  int material_slot[TEXTURE_RESIDENCY_MAX_MATERIALS];
+  uint32_t touched[TEXTURE_RESIDENCY_MAX_MATERIALS];
+  bool failed[TEXTURE_RESIDENCY_MAX_MATERIALS];
+  texture_residency_stats_t stats;
+} texture_residency_t;
+
+static void texture_residency_init(texture_residency_t* residency,
+                                   int num_slots,
+                                   int num_materials) {
+  memset(residency, 0, sizeof(*residency));
+  residency->num_slots = num_slots < TEXTURE_RESIDENCY_MAX_SLOTS
+                             ? num_slots
+                             : TEXTURE_RESIDENCY_MAX_SLOTS;
+  residency->num_materials = num_materials < TEXTURE_RESIDENCY_MAX_MATERIALS
+                                 ? num_materials
+                                 : TEXTURE_RESIDENCY_MAX_MATERIALS;
+  for (int i = 0; i < TEXTURE_RESIDENCY_MAX_SLOTS; ++i) {
+    residency->slot_material[i] = -1;
+  }
+  for (int i = 0; i < TEXTURE_RESIDENCY_MAX_MATERIALS; ++i) {
+    residency->material_slot[i] = -1;
+  }
+  // frame 0 is "never touched"
+  residency->frame = 1;
+}
+
+// Starts a new frame, touches from the previous frames age.
+static void texture_residency_begin_frame(texture_residency_t* residency) {
+  ++residency->frame;
+}
+
+// Marks `material` as visible this frame and returns the layer to sample
+// for it.
+static int texture_residency_touch(texture_residency_t* residency,
+                                   int material) {
+  if (material < 0 || material >= residency->num_materials) {
+    return residency->num_slots;
+  }
+  const int slot = residency->material_slot[material];
+  if (residency->touched[material] != residency->frame) {
+    residency->touched[material] = residency->frame;
+    if (slot < 0 || residency->state[slot] != TEXTURE_RESIDENCY_RESIDENT) {
+      ++residency->stats.misses;
+    }
+  }
+  if (slot < 0) {
+    return residency->num_slots;
+  }
+  residency->last_used[slot] = residency->frame;
+  return residency->state[slot] == TEXTURE_RESIDENCY_RESIDENT
+             ? slot
+             : residency->num_slots;
+}
+
+// The remap table: the layer holding `material`, or the placeholder layer.
+static int texture_residency_slot(const texture_residency_t* residency,
+                                  int material) {
+  if (material < 0 || material >= residency->num_materials) {
+    return residency->num_slots;
+  }
+  const int slot = residency->material_slot[material];
+  return slot >= 0 && residency->state[slot] == TEXTURE_RESIDENCY_RESIDENT
+             ? slot
+             : residency->num_slots;
+}
+
+// A free slot, or the least recently used resident one that wasn't
+// touched this frame, -1 if there is none.
+static int _texture_residency_victim(const texture_residency_t* residency) {
+  int victim = -1;
+  for (int i = 0; i < residency->num_slots; ++i) {
+    if (residency->state[i] == TEXTURE_RESIDENCY_FREE) {
+      return i;
+    }
+    if (residency->state[i] == TEXTURE_RESIDENCY_RESIDENT &&
+        residency->last_used[i] != residency->frame &&
+        (victim < 0 ||
+         residency->last_used[i] < residency->last_used[victim])) {
+      victim = i;
+    }
+  }
+  return victim;
+}
+
+// Assigns a slot to the next material touched this frame without one.
+// Returns false when nothing is left to load or no slot can be freed,
+// otherwise the caller loads `*material` into `*slot` and reports back
+// with texture_residency_loaded().
+static bool texture_residency_next_load(texture_residency_t* residency,
+                                        int* material,
+                                        int* slot) {
+  for (int m = 0; m < residency->num_materials; ++m) {
+    if (residency->touched[m] != residency->frame ||
+        residency->material_slot[m] >= 0 || residency->failed[m]) {
+      continue;
+    }
+    const int victim = _texture_residency_victim(residency);
+    if (victim < 0) {
+      return false;
+    }
+    if (residency->slot_material[victim] >= 0) {
+      residency->material_slot[residency->slot_material[victim]] = -1;
+      ++residency->stats.evictions;
+    }
+    residency->state[victim] = TEXTURE_RESIDENCY_LOADING;
+    residency->slot_material[victim] = m;
+    residency->last_used[victim] = residency->frame;
+    residency->material_slot[m] = victim;
+    ++residency->stats.loads;
+    *material = m;
+    *slot = victim;
+    return true;
+  }
+  return false;
+}
+
+// Ends the load of `slot`, a failed load frees the slot again.
+static void texture_residency_loaded(texture_residency_t* residency,
+                                     int slot,
+                                     bool ok) {
+  if (ok) {
+    residency->state[slot] = TEXTURE_RESIDENCY_RESIDENT;
+    return;
+  }
+  residency->failed[residency->slot_material[slot]] = true;
+  residency->material_slot[residency->slot_material[slot]] = -1;
+  residency->slot_material[slot] = -1;
+  residency->state[slot] = TEXTURE_RESIDENCY_FREE;
+}
+
+static int texture_residency_num_resident(
+    const texture_residency_t* residency) {
+  int count = 0;
+  for (int i = 0; i < residency->num_slots; ++i) {
+    count += residency->state[i] == TEXTURE_RESIDENCY_RESIDENT;
+  }
+  return count;
+}
+
+static int texture_residency_num_loading(
+    const texture_residency_t* residency) {
+  int count = 0;
+  for (int i = 0; i < residency->num_slots; ++i) {
+    count += residency->state[i] == TEXTURE_RESIDENCY_LOADING;
+  }
+  return count;
+}
+
+#endif  // TEXTURE_RESIDENCY_H
@@ -3,16 +3,29 @@
 
 #include "sokol_gfx.h"
 #include "sokol_fetch.h"
+#include "texture_residency.h"
+#include "load_group.h"
+#include "texture_cache.h"
+#include "texture_quality.h"
+#include "upload_queue.h"
 
 const int SCREEN_WIDTH = 1280;
 const int SCREEN_HEIGHT = 768;
 const float VELOCITY = 25.0f;
+// terrain materials the cells pick from
 #define ARRAYTEX_COUNT (6)
+// most layers of the array texture that hold materials, see
+// texture_residency.h. At least as many as a frame can show: every cell
+// may pick any material, so all ARRAYTEX_COUNT can be in view at once, and
+// a slot in use is never evicted. One more layer holds the placeholder.
+#define ARRAYTEX_SLOTS (8)
 #define ARRAYTEX_IMAGE_WIDTH (512)
 #define ARRAYTEX_IMAGE_HEIGHT (512)
-#define ARRAYTEX_IMAGE_PIXELS (ARRAYTEX_IMAGE_WIDTH * ARRAYTEX_IMAGE_HEIGHT)
-#define ARRAYTEX_ARRAY_IMAGE_OFFSET (ARRAYTEX_IMAGE_PIXELS)
-#define ARRAYTEX_IMAGE_BUFFER_SIZE (ARRAYTEX_COUNT * ARRAYTEX_IMAGE_PIXELS)
+// full mip chain down to 1x1 of the square, power of two layers, the
+// texture quality may drop the top levels
+#define ARRAYTEX_MIP_COUNT (10)
+// shown in array texture layers until their image is loaded
+#define ARRAYTEX_PLACEHOLDER_COLOR (0xFF6E7F80)
 
 typedef void (*fail_callback_t)();
 typedef void (*cubemap_success_callback_t)();
@@ -23,74 +36,107 @@ typedef struct image_request_t {
   sg_image img_id;
   sg_wrap wrap_u;
   sg_wrap wrap_v;
+  // optional, without a buffer the file goes into an exactly sized buffer
+  // from the pool
   void* buffer_ptr;
   uint32_t buffer_size;
   fail_callback_t fail_callback;
 } image_request_t;
 
 typedef struct arraytex_request_t {
-  const char** paths;
-  uint32_t image_count;
+  const int* assets;  // registry ids, one per material
+  int num_assets;
   sg_image img_id;
-  uint8_t* texture_buffer_ptr;
-  uint8_t* buffer_ptr;
-  uint32_t buffer_offset;
   fail_callback_t fail_callback;
   arraytex_success_callback_t success_callback;
 } arraytex_request_t;
 
+struct _arraytex_request_t;
+
+// What a slot's decode job works on, so workers never read the slot
+// tables the main thread keeps changing.
+typedef struct _arraytex_slot_t {
+  struct _arraytex_request_t* request;
+  int slot;
+} _arraytex_slot_t;
+
 typedef struct _arraytex_request_t {
   sg_image img_id;
+  // CPU copy of all layers and mips for as long as the image lives, a
+  // dynamic image is always updated as a whole
   uint8_t* texture_buffer_ptr;
-  uint8_t* buffer;
-  int buffer_offset;
-  int fetched_sizes[ARRAYTEX_COUNT];
-  int finished_requests;
-  bool failed;
+  // the layer size the texture quality leaves of the 512x512 materials,
+  // their top `dropped_mips` levels are only built while decoding
+  int layer_width;
+  int layer_height;
+  int num_mips;
+  int dropped_mips;
+  // TEXPACK_FORMAT_* of the layers, RGBA8 for the loose files
+  uint32_t format;
+  // the materials' files, their fetch state lives in the asset registry
+  int num_materials;
+  int assets[TEXTURE_RESIDENCY_MAX_MATERIALS];
+  // or, streaming from the cooked pack, a copy of its layers at the kept
+  // levels, level-major like the buffer, copied into the slots
+  uint8_t* pack_layers;
+  // which material is in which layer, off for images that hold every
+  // material (the cooked pack where its layers can't be updated)
+  bool streaming;
+  texture_residency_t residency;
+  // ARRAYTEX_SLOTS, or one per material when there are fewer
+  int num_slots;
+  // one load group per loading slot, its decoder writes straight into the
+  // slot's layer of texture_buffer_ptr, followed by the layer's mip chain.
+  // The buffer is level-major: all layers of mip 0, then of mip 1, ...
+  load_group_t* slot_groups[ARRAYTEX_SLOTS];
+  _arraytex_slot_t slots[ARRAYTEX_SLOTS];
+  // whether the decoder found the layer in the disk cache
+  texture_cache_result slot_cache[ARRAYTEX_SLOTS];
+  // layers are uploaded as they arrive, through the upload queue: one by
+  // one into `gl_texture` where there is direct GL access (gl_texture.h),
+  // otherwise all of them into a dynamic image
+  int loaded_layers;
+  uint32_t gl_texture;
+  uint32_t dirty_layers;  // one bit per layer changed since the upload
+  bool upload_queued;
+  bool finished;
   fail_callback_t fail_callback;
   arraytex_success_callback_t success_callback;
 } _arraytex_request_t;
 
-typedef struct _arraytex_request_instance_t {
-  int index;
-  _arraytex_request_t* request;
-} _arraytex_request_instance_t;
-
 typedef struct cubemap_request_t {
-  const char* path_right;
-  const char* path_left;
-  const char* path_up;
-  const char* path_down;
-  const char* path_front;
-  const char* path_back;
+  const int* assets;  // 6 registry ids, in +X -X +Y -Y +Z -Z order
   sg_image img_id;
-  uint8_t* buffer_ptr;
-  uint32_t buffer_offset;
+  upload_priority upload_priority;
   fail_callback_t fail_callback;
   cubemap_success_callback_t success_callback;
 } cubemap_request_t;
 
 typedef struct _cubemap_request_t {
   sg_image img_id;
-  uint8_t* buffer;
-  int buffer_offset;
-  int fetched_sizes[6];
-  int finished_requests;
-  bool failed;
+  upload_priority upload_priority;
+  // the faces load as one group, each face decodes into its slice of one
+  // staging allocation sized from the first face header, level 0 followed
+  // by the face's mip chain
+  uint8_t* staging;
+  // the files' size, and the size the texture quality leaves of it
+  int source_width;
+  int source_height;
+  int face_width;
+  int face_height;
+  int num_mips;
+  int dropped_mips;
+  texture_cache_result face_cache[6];
   fail_callback_t fail_callback;
   cubemap_success_callback_t success_callback;
 } _cubemap_request_t;
 
-typedef struct _cubemap_request_instance_t {
-  int index;
-  _cubemap_request_t* request;
-} _cubemap_request_instance_t;
-
 typedef struct {
   sg_image img_id;
   sg_wrap wrap_u;
   sg_wrap wrap_v;
   const char* label;
+  bool pool_buffer;
   fail_callback_t fail_callback;
 } image_request_data;
 
@@ -0,0 +1,182 @@
+#ifndef UPLOAD_QUEUE_H
+#define UPLOAD_QUEUE_H
+
+/*
+  Spreads GPU uploads over frames under a bytes-per-frame budget.
+
+  upload_queue_submit() queues an upload whose `upload_cb` does the actual
+  sg_init_image()/sg_update_image()/sg_update_buffer() call, and
+  upload_queue_dowork() runs the queued uploads once per frame, before the
+  frame's passes, in priority order and FIFO within a priority, until the
+  next one doesn't fit into what's left of the budget. The budget is
+  strict in priority order: a big terrain upload holds back the skybox
+  behind it instead of letting it jump the queue. An upload larger than
+  the whole budget runs alone in a frame without other uploads besides
+  the frame's own data, sokol only updates resources as a whole.
+
+  Uploads that can't be deferred, like the frame's instance data or images
+  built from data that is only valid inside a callback, are charged to the
+  frame with upload_queue_account() instead, so the queued ones back off.
+
+  An upload whose `ready_cb` returns false isn't ready yet (its source is
+  still being written), it stays queued without being charged, isn't
+  counted as deferred and doesn't hold back the rest. Readiness is checked
+  before the budget, so a big upload that isn't ready doesn't end the
+  frame's uploads either. Main thread only.
+*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define UPLOAD_QUEUE_MAX_UPLOADS (64)
+
+typedef enum upload_priority {
+  UPLOAD_PRIORITY_FRAME,  // needed for this frame, only accounted
+  UPLOAD_PRIORITY_TERRAIN,
+  UPLOAD_PRIORITY_SKYBOX,
+  UPLOAD_PRIORITY_DECORATIVE,
+  UPLOAD_PRIORITY_NUM,
+} upload_priority;
+
+typedef struct upload_queue_desc_t {
+  size_t frame_budget;  // bytes per frame
+} upload_queue_desc_t;
+
+typedef struct upload_desc_t {
+  upload_priority priority;
+  size_t size;  // bytes charged to the frame that runs it
+  void (*upload_cb)(void* user_data);
+  bool (*ready_cb)(void* user_data);  // optional, ready when NULL
+  void* user_data;
+} upload_desc_t;
+
+typedef struct upload_queue_stats_t {
+  size_t frame_budget;
+  // this frame, per priority and total
+  size_t frame_bytes[UPLOAD_PRIORITY_NUM];
+  size_t frame_total;
+  int frame_uploads;
+  // the frame with the most bytes uploaded
+  size_t peak_frame_bytes;
+  uint64_t total_bytes;
+  uint32_t uploads;
+  // uploads pushed to a later frame by the budget, counted once per frame
+  uint32_t deferrals;
+  int queued;
+  size_t queued_bytes;
+} upload_queue_stats_t;
+
+static struct {
+  upload_queue_desc_t desc;
+  upload_desc_t uploads[UPLOAD_QUEUE_MAX_UPLOADS];
+  // submission order, for FIFO within a priority
+  uint32_t order[UPLOAD_QUEUE_MAX_UPLOADS];
+  bool in_use[UPLOAD_QUEUE_MAX_UPLOADS];
+  uint32_t next_order;
+  upload_queue_stats_t stats;
+} _upload_queue;
+
+static void upload_queue_setup(const upload_queue_desc_t* desc) {
+  memset(&_upload_queue, 0, sizeof(_upload_queue));
+  _upload_queue.desc = *desc;
+  _upload_queue.stats.frame_budget = desc->frame_budget;
+}
+
+// Call once per frame before any upload is run or accounted.
+static void upload_queue_begin_frame(void) {
+  upload_queue_stats_t* stats = &_upload_queue.stats;
+  memset(stats->frame_bytes, 0, sizeof(stats->frame_bytes));
+  stats->frame_total = 0;
+  stats->frame_uploads = 0;
+}
+
+// Charges an upload that already happened to the current frame.
+static void upload_queue_account(upload_priority priority, size_t size) {
+  upload_queue_stats_t* stats = &_upload_queue.stats;
+  if (size == 0) {
+    return;
+  }
+  stats->frame_bytes[priority] += size;
+  stats->frame_total += size;
+  stats->total_bytes += size;
+  ++stats->uploads;
+  ++stats->frame_uploads;
+  if (stats->frame_total > stats->peak_frame_bytes) {
+    stats->peak_frame_bytes = stats->frame_total;
+  }
+}
+
+// Queues an upload, false when the queue is full, in which case the
+// caller should upload right away and account for it.
+static bool upload_queue_submit(const upload_desc_t* desc) {
+  for (int i = 0; i < UPLOAD_QUEUE_MAX_UPLOADS; ++i) {
+    if (!_upload_queue.in_use[i]) {
+      _upload_queue.in_use[i] = true;
+      _upload_queue.uploads[i] = *desc;
+      _upload_queue.order[i] = _upload_queue.next_order++;
+      ++_upload_queue.stats.queued;
+      _upload_queue.stats.queued_bytes += desc->size;
+      return true;
+    }
+  }
+  return false;
+}
+
+// The oldest queued upload of the highest priority, skipping `skip`.
+static int _upload_queue_next(const bool* skip) {
+  int next = -1;
+  for (int i = 0; i < UPLOAD_QUEUE_MAX_UPLOADS; ++i) {
+    if (!_upload_queue.in_use[i] || skip[i]) {
+      continue;
+    }
+    const upload_desc_t* upload = &_upload_queue.uploads[i];
+    if (next < 0 ||
+        upload->priority < _upload_queue.uploads[next].priority ||
+        (upload->priority == _upload_queue.uploads[next].priority &&
+         _upload_queue.order[i] < _upload_queue.order[next])) {
+      next = i;
+    }
+  }
+  return next;
+}
+
+// Runs queued uploads within what's left of the frame's budget.
+static void upload_queue_dowork(void) {
+  upload_queue_stats_t* stats = &_upload_queue.stats;
+  bool skip[UPLOAD_QUEUE_MAX_UPLOADS] = {false};
+  bool ran = false;
+  for (;;) {
+    const int i = _upload_queue_next(skip);
+    if (i < 0) {
+      return;
+    }
+    const upload_desc_t upload = _upload_queue.uploads[i];
+    if (upload.ready_cb && !upload.ready_cb(upload.user_data)) {
+      skip[i] = true;
+      continue;
+    }
+    const size_t budget = _upload_queue.desc.frame_budget;
+    const size_t left =
+        stats->frame_total < budget ? budget - stats->frame_total : 0;
+    const bool oversized =
+        upload.size > budget && !ran &&
+        stats->frame_total == stats->frame_bytes[UPLOAD_PRIORITY_FRAME];
+    if (upload.size > left && !oversized) {
+      ++stats->deferrals;
+      return;
+    }
+    upload.upload_cb(upload.user_data);
+    _upload_queue.in_use[i] = false;
+    --stats->queued;
+    stats->queued_bytes -= upload.size;
+    upload_queue_account(upload.priority, upload.size);
+    ran = true;
+  }
+}
+
+static upload_queue_stats_t upload_queue_stats(void) {
+  return _upload_queue.stats;
+}
+
+#endif  // UPLOAD_QUEUE_H
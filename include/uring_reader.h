@@ -0,0 +1,389 @@
+#ifndef URING_READER_H
+#define URING_READER_H
+
+/*
+  Reads ranges of one file through io_uring, Linux only. The asset pack's
+  optional native backend, see asset_io.h.
+
+  uring_reader_read() queues a read into the caller's buffer, every
+  uring_reader_poll() submits all queued work with one io_uring_enter()
+  and calls back the reads whose data arrived, on the calling thread.
+
+  The file is opened with O_DIRECT where the file system supports it, so
+  large packs stream past the page cache. Direct reads need block aligned
+  offsets, sizes and memory, so reads are split into chunks that go into
+  a fixed set of aligned bounce buffers, registered with the ring to skip
+  the per-read page pinning, and are copied out on completion. Without
+  O_DIRECT or when registering fails (RLIMIT_MEMLOCK) the same path runs
+  on plain reads.
+
+  Talks to the kernel through the raw syscalls and <linux/io_uring.h>,
+  kernel 5.6 or later.
+*/
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// glibc only declares O_DIRECT with _GNU_SOURCE
+#if !defined(O_DIRECT) && defined(__O_DIRECT)
+#define O_DIRECT __O_DIRECT
+#endif
+
+#define URING_READER_QUEUE_DEPTH (64)
+// O_DIRECT alignment of offsets, sizes and buffers
+#define URING_READER_BLOCK_SIZE (4096)
+#define URING_READER_CHUNK_SIZE (256 * 1024)
+#define URING_READER_NUM_CHUNKS (32)
+#define URING_READER_MAX_READS (64)
+
+typedef void (*uring_reader_cb_t)(bool ok, void* user_data);
+
+typedef struct uring_reader_stats_t {
+  bool direct;      // opened with O_DIRECT
+  bool registered;  // bounce buffers registered with the ring
+  uint32_t enters;  // io_uring_enter() calls that submitted work
+  uint32_t chunks;  // chunk reads submitted
+  uint64_t bytes;   // bytes delivered to reads
+} uring_reader_stats_t;
+
+typedef struct _uring_read_t {
+  bool in_use;
+  bool failed;
+  uint8_t* dst;
+  uint64_t offset;
+  uint32_t size;
+  // bytes not yet handed to a chunk
+  uint32_t next;
+  int chunks_in_flight;
+  uring_reader_cb_t cb;
+  void* user_data;
+} _uring_read_t;
+
+typedef struct _uring_chunk_t {
+  _uring_read_t* read;  // NULL when the bounce buffer is free
+  uint32_t dst_offset;
+  // the read's bytes start `skip` bytes into the block aligned span
+  uint32_t skip;
+  uint32_t size;
+} _uring_chunk_t;
+
+static struct {
+  bool valid;
+  int ring_fd;
+  int fd;
+  // submission ring
+  uint32_t* sq_head;
+  uint32_t* sq_tail;
+  uint32_t* sq_mask;
+  uint32_t* sq_array;
+  struct io_uring_sqe* sqes;
+  // completion ring
+  uint32_t* cq_head;
+  uint32_t* cq_tail;
+  uint32_t* cq_mask;
+  struct io_uring_cqe* cqes;
+  void* ring_ptr;
+  size_t ring_size;
+  size_t sqes_size;
+  uint8_t* bounce;
+  uint32_t to_submit;
+  _uring_read_t reads[URING_READER_MAX_READS];
+  _uring_chunk_t chunks[URING_READER_NUM_CHUNKS];
+  uring_reader_stats_t stats;
+} _uring_reader;
+
+static uint32_t _uring_reader_align_up(uint32_t size) {
+  return (size + URING_READER_BLOCK_SIZE - 1) &
+         ~(uint32_t)(URING_READER_BLOCK_SIZE - 1);
+}
+
+static bool _uring_reader_map_rings(const struct io_uring_params* params) {
+  const size_t sq_size =
+      params->sq_off.array + params->sq_entries * sizeof(uint32_t);
+  const size_t cq_size =
+      params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+  // both rings share one mapping on every kernel that has IORING_OP_READ
+  if (!(params->features & IORING_FEAT_SINGLE_MMAP)) {
+    return false;
+  }
+  _uring_reader.ring_size = sq_size > cq_size ? sq_size : cq_size;
+  uint8_t* ring =
+      (uint8_t*)mmap(NULL, _uring_reader.ring_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, _uring_reader.ring_fd,
+                     IORING_OFF_SQ_RING);
+  if (ring == MAP_FAILED) {
+    return false;
+  }
+  _uring_reader.ring_ptr = ring;
+  _uring_reader.sq_head = (uint32_t*)(ring + params->sq_off.head);
+  _uring_reader.sq_tail = (uint32_t*)(ring + params->sq_off.tail);
+  _uring_reader.sq_mask = (uint32_t*)(ring + params->sq_off.ring_mask);
+  _uring_reader.sq_array = (uint32_t*)(ring + params->sq_off.array);
+  _uring_reader.cq_head = (uint32_t*)(ring + params->cq_off.head);
+  _uring_reader.cq_tail = (uint32_t*)(ring + params->cq_off.tail);
+  _uring_reader.cq_mask = (uint32_t*)(ring + params->cq_off.ring_mask);
+  _uring_reader.cqes = (struct io_uring_cqe*)(ring + params->cq_off.cqes);
+
+  _uring_reader.sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+  void* sqes = mmap(NULL, _uring_reader.sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, _uring_reader.ring_fd,
+                    IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return false;
+  }
+  _uring_reader.sqes = (struct io_uring_sqe*)sqes;
+  return true;
+}
+
+static void uring_reader_shutdown(void);
+
+// Opens `path` and sets up the ring, false if io_uring isn't available.
+static bool uring_reader_setup(const char* path) {
+  memset(&_uring_reader, 0, sizeof(_uring_reader));
+  _uring_reader.ring_fd = -1;
+  _uring_reader.fd = open(path, O_RDONLY | O_DIRECT);
+  _uring_reader.stats.direct = _uring_reader.fd >= 0;
+  if (_uring_reader.fd < 0) {
+    _uring_reader.fd = open(path, O_RDONLY);
+  }
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  if (_uring_reader.fd >= 0) {
+    _uring_reader.ring_fd = (int)syscall(
+        __NR_io_uring_setup, URING_READER_QUEUE_DEPTH, &params);
+  }
+  if (_uring_reader.ring_fd < 0 || !_uring_reader_map_rings(&params) ||
+      posix_memalign((void**)&_uring_reader.bounce, URING_READER_BLOCK_SIZE,
+                     (size_t)URING_READER_NUM_CHUNKS *
+                         URING_READER_CHUNK_SIZE) != 0) {
+    _uring_reader.bounce = NULL;
+    uring_reader_shutdown();
+    return false;
+  }
+  struct iovec iovecs[URING_READER_NUM_CHUNKS];
+  for (int i = 0; i < URING_READER_NUM_CHUNKS; ++i) {
+    iovecs[i] = (struct iovec){
+        .iov_base = _uring_reader.bounce + (size_t)i * URING_READER_CHUNK_SIZE,
+        .iov_len = URING_READER_CHUNK_SIZE};
+  }
+  _uring_reader.stats.registered =
+      syscall(__NR_io_uring_register, _uring_reader.ring_fd,
+              IORING_REGISTER_BUFFERS, iovecs, URING_READER_NUM_CHUNKS) == 0;
+  _uring_reader.valid = true;
+  return true;
+}
+
+static bool uring_reader_valid(void) {
+  return _uring_reader.valid;
+}
+
+// Queues a read of `size` bytes at `offset` into `dst`, `cb` is called
+// from uring_reader_poll(). False when too many reads are in flight.
+static bool uring_reader_read(void* dst,
+                              uint64_t offset,
+                              uint32_t size,
+                              uring_reader_cb_t cb,
+                              void* user_data) {
+  for (int i = 0; _uring_reader.valid && i < URING_READER_MAX_READS; ++i) {
+    _uring_read_t* read = &_uring_reader.reads[i];
+    if (!read->in_use) {
+      *read = (_uring_read_t){.in_use = true,
+                              .dst = (uint8_t*)dst,
+                              .offset = offset,
+                              .size = size,
+                              .cb = cb,
+                              .user_data = user_data};
+      return true;
+    }
+  }
+  return false;
+}
+
+// Fills the submission ring with the next chunks of the queued reads,
+// oldest slots first, while bounce buffers and ring entries are free.
+static void _uring_reader_fill(void) {
+  const uint32_t mask = *_uring_reader.sq_mask;
+  uint32_t tail = *_uring_reader.sq_tail;
+  const uint32_t head =
+      __atomic_load_n(_uring_reader.sq_head, __ATOMIC_ACQUIRE);
+  int chunk = 0;
+  for (int i = 0; i < URING_READER_MAX_READS; ++i) {
+    _uring_read_t* read = &_uring_reader.reads[i];
+    while (read->in_use && !read->failed && read->next < read->size) {
+      while (chunk < URING_READER_NUM_CHUNKS &&
+             _uring_reader.chunks[chunk].read) {
+        ++chunk;
+      }
+      if (chunk == URING_READER_NUM_CHUNKS ||
+          tail - head == URING_READER_QUEUE_DEPTH) {
+        __atomic_store_n(_uring_reader.sq_tail, tail, __ATOMIC_RELEASE);
+        return;
+      }
+      const uint64_t pos = read->offset + read->next;
+      const uint64_t start = pos & ~(uint64_t)(URING_READER_BLOCK_SIZE - 1);
+      _uring_chunk_t* c = &_uring_reader.chunks[chunk];
+      c->read = read;
+      c->dst_offset = read->next;
+      c->skip = (uint32_t)(pos - start);
+      c->size = read->size - read->next;
+      if (c->size > URING_READER_CHUNK_SIZE - c->skip) {
+        c->size = URING_READER_CHUNK_SIZE - c->skip;
+      }
+      read->next += c->size;
+      ++read->chunks_in_flight;
+
+      struct io_uring_sqe* sqe = &_uring_reader.sqes[tail & mask];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = _uring_reader.stats.registered ? IORING_OP_READ_FIXED
+                                                   : IORING_OP_READ;
+      sqe->fd = _uring_reader.fd;
+      sqe->off = start;
+      sqe->addr = (uint64_t)(uintptr_t)(_uring_reader.bounce +
+                                        (size_t)chunk *
+                                            URING_READER_CHUNK_SIZE);
+      sqe->len = _uring_reader_align_up(c->skip + c->size);
+      sqe->buf_index = (uint16_t)chunk;
+      sqe->user_data = (uint64_t)chunk;
+      _uring_reader.sq_array[tail & mask] = tail & mask;
+      ++tail;
+      ++_uring_reader.to_submit;
+      ++_uring_reader.stats.chunks;
+    }
+  }
+  __atomic_store_n(_uring_reader.sq_tail, tail, __ATOMIC_RELEASE);
+}
+
+static void _uring_reader_finish(_uring_read_t* read) {
+  read->in_use = false;
+  if (!read->failed) {
+    _uring_reader.stats.bytes += read->size;
+  }
+  read->cb(!read->failed, read->user_data);
+}
+
+// Copies the arrived chunks out of their bounce buffers, returns the
+// number of finished reads.
+static int _uring_reader_reap(void) {
+  int finished = 0;
+  uint32_t head = *_uring_reader.cq_head;
+  const uint32_t tail =
+      __atomic_load_n(_uring_reader.cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != tail; ++head) {
+    const struct io_uring_cqe* cqe =
+        &_uring_reader.cqes[head & *_uring_reader.cq_mask];
+    const int index = (int)cqe->user_data;
+    _uring_chunk_t* c = &_uring_reader.chunks[index];
+    _uring_read_t* read = c->read;
+    // short reads only happen at the end of the file, where the span was
+    // rounded up past it
+    if (cqe->res < 0 || (uint32_t)cqe->res < c->skip + c->size) {
+      read->failed = true;
+    } else {
+      memcpy(read->dst + c->dst_offset,
+             _uring_reader.bounce + (size_t)index * URING_READER_CHUNK_SIZE +
+                 c->skip,
+             c->size);
+    }
+    c->read = NULL;
+    if (--read->chunks_in_flight == 0 &&
+        (read->failed || read->next == read->size)) {
+      _uring_reader_finish(read);
+      ++finished;
+    }
+  }
+  __atomic_store_n(_uring_reader.cq_head, head, __ATOMIC_RELEASE);
+  return finished;
+}
+
+// Submits the queued work and calls back the finished reads. With `wait`
+// it blocks until at least one read finished, unless nothing is in
+// flight. Returns the number of finished reads.
+static int uring_reader_poll(bool wait) {
+  if (!_uring_reader.valid) {
+    return 0;
+  }
+  int finished = 0;
+  for (int i = 0; i < URING_READER_MAX_READS; ++i) {
+    _uring_read_t* read = &_uring_reader.reads[i];
+    // empty reads have no chunk that would finish them
+    if (read->in_use && read->size == 0) {
+      _uring_reader_finish(read);
+      ++finished;
+    }
+  }
+  for (;;) {
+    _uring_reader_fill();
+    bool in_flight = false;
+    for (int i = 0; i < URING_READER_NUM_CHUNKS; ++i) {
+      in_flight |= _uring_reader.chunks[i].read != NULL;
+    }
+    const bool block = wait && finished == 0 && in_flight;
+    if (_uring_reader.to_submit > 0 || block) {
+      const int n = (int)syscall(__NR_io_uring_enter, _uring_reader.ring_fd,
+                                 _uring_reader.to_submit, block ? 1 : 0,
+                                 block ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+      if (n > 0) {
+        _uring_reader.to_submit -= (uint32_t)n;
+        ++_uring_reader.stats.enters;
+      } else if (n < 0 && errno != EINTR && errno != EAGAIN &&
+                 errno != EBUSY) {
+        return finished;
+      }
+    }
+    const int reaped = _uring_reader_reap();
+    finished += reaped;
+    // reaping frees bounce buffers for the chunks still waiting
+    if (reaped == 0 && !block) {
+      return finished;
+    }
+  }
+}
+
+static uring_reader_stats_t uring_reader_stats(void) {
+  return _uring_reader.stats;
+}
+
+// Reads still in flight are waited for without calling them back.
+static void uring_reader_shutdown(void) {
+  for (int i = 0; _uring_reader.valid && i < URING_READER_NUM_CHUNKS; ++i) {
+    while (_uring_reader.chunks[i].read) {
+      syscall(__NR_io_uring_enter, _uring_reader.ring_fd,
+              _uring_reader.to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+      _uring_reader.to_submit = 0;
+      uint32_t head = *_uring_reader.cq_head;
+      const uint32_t tail =
+          __atomic_load_n(_uring_reader.cq_tail, __ATOMIC_ACQUIRE);
+      for (; head != tail; ++head) {
+        const struct io_uring_cqe* cqe =
+            &_uring_reader.cqes[head & *_uring_reader.cq_mask];
+        _uring_reader.chunks[cqe->user_data].read = NULL;
+      }
+      __atomic_store_n(_uring_reader.cq_head, head, __ATOMIC_RELEASE);
+    }
+  }
+  if (_uring_reader.sqes) {
+    munmap(_uring_reader.sqes, _uring_reader.sqes_size);
+  }
+  if (_uring_reader.ring_ptr) {
+    munmap(_uring_reader.ring_ptr, _uring_reader.ring_size);
+  }
+  if (_uring_reader.ring_fd >= 0) {
+    close(_uring_reader.ring_fd);
+  }
+  if (_uring_reader.fd >= 0) {
+    close(_uring_reader.fd);
+  }
+  free(_uring_reader.bounce);
+  memset(&_uring_reader, 0, sizeof(_uring_reader));
+  _uring_reader.ring_fd = _uring_reader.fd = -1;
+}
+
+#endif  // URING_READER_H
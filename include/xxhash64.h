@@ -0,0 +1,96 @@
+#ifndef XXHASH64_H
+#define XXHASH64_H
+
+/*
+  XXH64 (xxHash, 64 bit) with seed 0, for cache keys and checksums: the
+  texture cache keys its entries by the hash of the source file and checks
+  their levels with it, the program cache keys the binaries by the hash of
+  the shader sources and driver strings.
+*/
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define _XXH_PRIME64_1 (0x9E3779B185EBCA87ULL)
+#define _XXH_PRIME64_2 (0xC2B2AE3D27D4EB4FULL)
+#define _XXH_PRIME64_3 (0x165667B19E3779F9ULL)
+#define _XXH_PRIME64_4 (0x85EBCA77C2B2AE63ULL)
+#define _XXH_PRIME64_5 (0x27D4EB2F165667C5ULL)
+
+static uint64_t _xxh_rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t _xxh_read64(const uint8_t* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t _xxh_read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint64_t _xxh_round(uint64_t acc, uint64_t input) {
+  acc += input * _XXH_PRIME64_2;
+  return _xxh_rotl(acc, 31) * _XXH_PRIME64_1;
+}
+
+// Folds `val` into the hash `acc`, as XXH64 merges its lanes. Order
+// matters, merging a, b and b, a give different hashes.
+static uint64_t xxh64_merge(uint64_t acc, uint64_t val) {
+  acc ^= _xxh_round(0, val);
+  return acc * _XXH_PRIME64_1 + _XXH_PRIME64_4;
+}
+
+// XXH64 with seed 0, little endian.
+static uint64_t xxh64(const void* data, size_t size) {
+  const uint8_t* p = (const uint8_t*)data;
+  const uint8_t* end = p + size;
+  uint64_t h;
+  if (size >= 32) {
+    uint64_t v1 = _XXH_PRIME64_1 + _XXH_PRIME64_2;
+    uint64_t v2 = _XXH_PRIME64_2;
+    uint64_t v3 = 0;
+    uint64_t v4 = 0 - _XXH_PRIME64_1;
+    do {
+      v1 = _xxh_round(v1, _xxh_read64(p));
+      v2 = _xxh_round(v2, _xxh_read64(p + 8));
+      v3 = _xxh_round(v3, _xxh_read64(p + 16));
+      v4 = _xxh_round(v4, _xxh_read64(p + 24));
+      p += 32;
+    } while (end - p >= 32);
+    h = _xxh_rotl(v1, 1) + _xxh_rotl(v2, 7) + _xxh_rotl(v3, 12) +
+        _xxh_rotl(v4, 18);
+    h = xxh64_merge(h, v1);
+    h = xxh64_merge(h, v2);
+    h = xxh64_merge(h, v3);
+    h = xxh64_merge(h, v4);
+  } else {
+    h = _XXH_PRIME64_5;
+  }
+  h += (uint64_t)size;
+  for (; end - p >= 8; p += 8) {
+    h ^= _xxh_round(0, _xxh_read64(p));
+    h = _xxh_rotl(h, 27) * _XXH_PRIME64_1 + _XXH_PRIME64_4;
+  }
+  if (end - p >= 4) {
+    h ^= (uint64_t)_xxh_read32(p) * _XXH_PRIME64_1;
+    h = _xxh_rotl(h, 23) * _XXH_PRIME64_2 + _XXH_PRIME64_3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    h ^= (*p) * _XXH_PRIME64_5;
+    h = _xxh_rotl(h, 11) * _XXH_PRIME64_1;
+  }
+  h ^= h >> 33;
+  h *= _XXH_PRIME64_2;
+  h ^= h >> 29;
+  h *= _XXH_PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+#endif  // XXHASH64_H
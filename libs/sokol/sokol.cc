@@ -7,6 +7,9 @@
 #define SOKOL_TRACE_HOOKS
 /* sokol 3D-API defines are provided by build options */
 #include "sokol_app.h"
+/* wraps the GL calls sokol_gfx builds programs with, see program_cache.h */
+#define PROGRAM_CACHE_IMPL
+#include "program_cache.h"
 #include "sokol_gfx.h"
 #include "sokol_time.h"
 #include "sokol_audio.h"
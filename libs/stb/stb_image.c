@@ -1,3 +1,117 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stb_image_into.h"
+
+/*
+    Allocator hooks for stb_image_into.h: every allocation carries a small
+    size header so live/peak bytes can be tracked across decode threads,
+    and the thread-local destination lets one allocation land in caller
+    memory.
+*/
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define _STBI_TLS __declspec(thread)
+#define _stbi_atomic_add(ptr, v) \
+  ((size_t)_InterlockedExchangeAdd64((volatile __int64*)(ptr), (__int64)(v)) + (v))
+#define _stbi_atomic_load(ptr) \
+  ((size_t)_InterlockedCompareExchange64((volatile __int64*)(ptr), 0, 0))
+#define _stbi_atomic_cas(ptr, expected, desired)                         \
+  (_InterlockedCompareExchange64((volatile __int64*)(ptr), (__int64)(desired), \
+                                 (__int64)(expected)) == (__int64)(expected))
+#else
+#define _STBI_TLS __thread
+#define _stbi_atomic_add(ptr, v) __atomic_add_fetch((ptr), (v), __ATOMIC_RELAXED)
+#define _stbi_atomic_load(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define _stbi_atomic_cas(ptr, expected, desired)                          \
+  __atomic_compare_exchange_n((ptr), &(size_t){(expected)}, (desired), 0, \
+                              __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#endif
+
+#define _STBI_ALLOC_HEADER (16)
+
+static _STBI_TLS struct {
+  void* ptr;
+  size_t size;
+  int used;
+} _stbi_into_dst;
+
+static volatile size_t _stbi_live_bytes;
+static volatile size_t _stbi_peak_bytes;
+static volatile size_t _stbi_num_copies;
+
+static void _stbi_track(size_t size, int alloc) {
+  if (!alloc) {
+    _stbi_atomic_add(&_stbi_live_bytes, (size_t)0 - size);
+    return;
+  }
+  size_t live = _stbi_atomic_add(&_stbi_live_bytes, size);
+  size_t peak = _stbi_atomic_load(&_stbi_peak_bytes);
+  while (live > peak && !_stbi_atomic_cas(&_stbi_peak_bytes, peak, live)) {
+    peak = _stbi_atomic_load(&_stbi_peak_bytes);
+  }
+}
+
+static void* _stbi_heap_alloc(size_t size) {
+  uint8_t* p = (uint8_t*)malloc(size + _STBI_ALLOC_HEADER);
+  if (!p) {
+    return NULL;
+  }
+  *(size_t*)p = size;
+  _stbi_track(size, 1);
+  return p + _STBI_ALLOC_HEADER;
+}
+
+static void* _stbi_malloc(size_t size) {
+  // the JPEG decoder allocates its output with one byte of slack it never
+  // writes to, so accept that size as well
+  if (_stbi_into_dst.ptr && !_stbi_into_dst.used &&
+      (size == _stbi_into_dst.size || size == _stbi_into_dst.size + 1)) {
+    _stbi_into_dst.used = 1;
+    return _stbi_into_dst.ptr;
+  }
+  return _stbi_heap_alloc(size);
+}
+
+static void _stbi_free(void* ptr) {
+  // the destination buffer is owned by the caller
+  if (!ptr || ptr == _stbi_into_dst.ptr) {
+    return;
+  }
+  uint8_t* p = (uint8_t*)ptr - _STBI_ALLOC_HEADER;
+  _stbi_track(*(size_t*)p, 0);
+  free(p);
+}
+
+static void* _stbi_realloc(void* ptr, size_t size) {
+  // buffers that grow (PNG's compressed data) are never the output
+  if (!ptr) {
+    return _stbi_heap_alloc(size);
+  }
+  if (ptr == _stbi_into_dst.ptr) {
+    // caller memory can't grow, move it to the heap
+    void* moved = _stbi_heap_alloc(size);
+    if (moved) {
+      memcpy(moved, ptr, size < _stbi_into_dst.size ? size : _stbi_into_dst.size);
+    }
+    return moved;
+  }
+  uint8_t* p = (uint8_t*)ptr - _STBI_ALLOC_HEADER;
+  const size_t old_size = *(size_t*)p;
+  uint8_t* np = (uint8_t*)realloc(p, size + _STBI_ALLOC_HEADER);
+  if (!np) {
+    return NULL;
+  }
+  *(size_t*)np = size;
+  _stbi_track(old_size, 0);
+  _stbi_track(size, 1);
+  return np + _STBI_ALLOC_HEADER;
+}
+
+#define STBI_MALLOC(sz) _stbi_malloc(sz)
+#define STBI_REALLOC(p, newsz) _stbi_realloc(p, newsz)
+#define STBI_FREE(p) _stbi_free(p)
+
 #define STB_IMAGE_IMPLEMENTATION
 #if defined(__clang__)
 #pragma clang diagnostic push
@@ -7,3 +121,66 @@
 #if defined(__clang__)
 #pragma clang diagnostic pop
 #endif
+
+/*
+    Whether the first allocation of `dst_size` bytes is the output image.
+    Only when the header says the image is exactly `dst_size` bytes at
+    `req_comp` 8 bit channels: then the allocations of that size are the
+    decoder's output, the palette expansion or the format conversion, and
+    the first of them is the result. 16 bit images are converted from a
+    larger buffer that may have the size, and the inflated PNG scanlines
+    carry a filter byte per row, which only matches for images narrower
+    than 4 pixels.
+*/
+static int _stbi_output_fits(stbi_uc const* buffer,
+                             int len,
+                             size_t dst_size,
+                             int req_comp) {
+  int x, y, comp;
+  if (!stbi_info_from_memory(buffer, len, &x, &y, &comp) ||
+      stbi_is_16_bit_from_memory(buffer, len)) {
+    return 0;
+  }
+  return x >= 4 && (size_t)x * (size_t)y * (size_t)req_comp == dst_size;
+}
+
+int stbi_load_into_from_memory(stbi_uc const* buffer,
+                               int len,
+                               void* dst,
+                               size_t dst_size,
+                               int* x,
+                               int* y,
+                               int* comp,
+                               int req_comp) {
+  // otherwise the image is decoded on the heap and copied
+  if (_stbi_output_fits(buffer, len, dst_size, req_comp)) {
+    _stbi_into_dst.ptr = dst;
+    _stbi_into_dst.size = dst_size;
+  }
+  _stbi_into_dst.used = 0;
+  stbi_uc* result = stbi_load_from_memory(buffer, len, x, y, comp, req_comp);
+  _stbi_into_dst.ptr = NULL;
+  _stbi_into_dst.size = 0;
+  if (!result) {
+    return 0;
+  }
+  if (result == (stbi_uc*)dst) {
+    return 1;
+  }
+  const size_t size = (size_t)*x * (size_t)*y * (size_t)req_comp;
+  const int fits = size == dst_size;
+  if (fits) {
+    memcpy(dst, result, size);
+    _stbi_atomic_add(&_stbi_num_copies, 1);
+  }
+  _stbi_free(result);
+  return fits;
+}
+
+stbi_alloc_stats_t stbi_alloc_stats(void) {
+  stbi_alloc_stats_t stats;
+  stats.live_bytes = _stbi_atomic_load(&_stbi_live_bytes);
+  stats.peak_bytes = _stbi_atomic_load(&_stbi_peak_bytes);
+  stats.num_copies = _stbi_atomic_load(&_stbi_num_copies);
+  return stats;
+}
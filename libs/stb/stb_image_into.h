@@ -0,0 +1,46 @@
+#pragma once
+/*
+    Decode-into extension for stb_image, implemented in stb_image.c.
+
+    stbi_load_into_from_memory() decodes straight into caller-provided
+    memory: when the file's header says the image is `dst_size` bytes,
+    the first allocation stb_image makes with that size (the decoder's
+    output image, or its format conversion) is served from `dst`. The
+    JPEG decoder asks for one unused byte more, that request is served from
+    `dst` too. Growing buffers never are, so `dst` isn't used as scratch
+    memory. If the decoder had to produce its output elsewhere (16 bit
+    files, tiny images), the result is copied into `dst` once and counted
+    in stbi_alloc_stats().num_copies.
+
+    All stb_image heap allocations are tracked, so the decoders' transient
+    memory use can be shown in the memory overlay.
+*/
+#include <stddef.h>
+#include "stb_image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct stbi_alloc_stats_t {
+  size_t live_bytes;
+  size_t peak_bytes;
+  size_t num_copies;
+} stbi_alloc_stats_t;
+
+// Returns 1 and fills x/y/comp on success. Fails if the decoded image
+// (x * y * req_comp bytes) doesn't match dst_size. req_comp must be set.
+extern int stbi_load_into_from_memory(stbi_uc const* buffer,
+                                      int len,
+                                      void* dst,
+                                      size_t dst_size,
+                                      int* x,
+                                      int* y,
+                                      int* comp,
+                                      int req_comp);
+
+extern stbi_alloc_stats_t stbi_alloc_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -18,8 +18,19 @@
 #include "config.h"
 #include "types.h"
 #include "asset_loading.h"
+#include "stream_ring.h"
+#include "draw_order.h"
+#include "overdraw.h"
+#include "headless.h"
+#include "gpu_timer.h"
+#include "render_stats.h"
+#include "asset_io.h"
+#include "asset_registry.h"
+#include "texture_pack.h"
+#include "program_cache.h"
 
 #include "stb/stb_image.h"
+#include "stb/stb_image_into.h"
 
 #include "Camera.h"
 // #include "hex.h"
@@ -27,8 +38,13 @@
 #define NUM_CELLS_WIDE 50
 #define NUM_CELLS_LONG 50
 #define NUM_CELLS (NUM_CELLS_WIDE * NUM_CELLS_LONG)
-
-static uint8_t favicon_buffer[32 * 32 * 4];
+// bounding sphere of one hex cylinder (radius 1.0, height 0.5)
+#define CELL_BOUNDING_RADIUS (1.1f)
+// frames a swapped out skybox image stays alive, the GPU may still be
+// sampling it for the frames in flight
+#define SKYBOX_RETIRE_FRAMES (3)
+// GPU upload bytes per frame, the loads beyond it wait for later frames
+#define UPLOAD_BUDGET_BYTES (16 * 1024 * 1024)
 
 static struct {
   // sg_pipeline cube_pip;
@@ -39,34 +55,129 @@ static struct {
   sg_bindings shape_bind;
   sg_pass_action pass_action;
   sshape_element_range_t shape_elems;
+  stream_ring_t instance_ring;
+  hmm_vec3 shape_pos[NUM_CELLS];
+  float shape_tex_index[NUM_CELLS];
+  draw_order_t draw_order;
+  uint16_t draw_keys[2][NUM_CELLS];
+  uint32_t draw_indices[2][NUM_CELLS];
+  hmm_vec3 visible_pos[NUM_CELLS];
+  float visible_tex_index[NUM_CELLS];
+  int visible_cells;
+  bool sort_front_to_back;
+  struct {
+    bool enabled;
+    overdraw_t target;
+    sg_pipeline pip;
+    sg_bindings bind;
+    float factor_unsorted;
+    float factor_sorted;
+  } overdraw;
   _cubemap_request_t cubemap_req;
   _arraytex_request_t arraytex_req;
-  // uint8_t texture_buffer[1024 * 1024];
-  uint8_t cubemap_buffer[6 * 1024 * 1024];
-  uint8_t shape_texture_buffer[6 * 256 * 1024];
-  uint8_t arraytex_load_buffer[ARRAYTEX_IMAGE_BUFFER_SIZE];
-  uint32_t arraytex_buffer[ARRAYTEX_IMAGE_BUFFER_SIZE];
+  // the terrain's array image, and the single placeholder layer bound in
+  // its place until it's created from the pack or the loose files
+  sg_image arraytex_image;
+  sg_image arraytex_placeholder;
+  // skybox cycling: the next cube manifest is prefetched and decoded into
+  // `back` while the bound image is drawn, K swaps them once it's ready
+  struct {
+    // the initial skybox, the cooked preview is shown until it's complete
+    sg_image image;
+    sg_image preview;
+    int sets[ASSET_REGISTRY_MAX_MANIFESTS];  // manifest indices
+    int num_sets;
+    int current;  // index into sets
+    int next;
+    int failed_prefetches;
+    sg_image back;
+    _cubemap_request_t prefetch_req;
+    bool prefetching;
+    bool prefetch_ready;
+    bool swap_pending;
+    sg_image retired;
+    int retire_frames;
+  } skybox;
+  bool textures_from_pack;
+  // GPU memory of the images created from the pack
+  struct {
+    const char* format;
+    size_t bytes;
+  } pack_arraytex, pack_skybox;
   camera_t cam;
   hmm_vec2 last_mouse;
   bool first_mouse;
   bool show_debug_ui;
   bool show_mem_ui;
+  bool show_asset_ui;
   uint64_t lastFrameTime;
   uint64_t timeToLoadCubemap;
+  // until the preview or the full skybox is shown, and until the latter
+  uint64_t timeToFirstSky;
   uint64_t timeToLoadArrayTextures;
   uint64_t imageLoadStartTime;
   uint64_t renderTime;
+  gpu_timer_t gpu_timer;
   uint64_t initTime;
 } state;
 
+static int app_width(void) {
+  return headless_enabled() ? headless_width() : sapp_width();
+}
+
+static int app_height(void) {
+  return headless_enabled() ? headless_height() : sapp_height();
+}
+
 static void fail_callback() {
   state.pass_action = (sg_pass_action){
       .colors[0] = {.action = SG_ACTION_CLEAR,
                     .value = (sg_color){1.0f, 0.0f, 0.0f, 1.0f}}};
 }
 
+static void prefetch_skybox(void);
+
 static void cube_success_callback() {
   state.timeToLoadCubemap = stm_diff(stm_now(), state.imageLoadStartTime);
+  if (state.timeToFirstSky == 0) {
+    state.timeToFirstSky = state.timeToLoadCubemap;
+  }
+  state.skybox_bind.fs_images[SLOT_skybox_texture] = state.skybox.image;
+  if (state.skybox.preview.id != SG_INVALID_ID) {
+    // nothing was swapped out yet, the cycling starts below
+    state.skybox.retired = state.skybox.preview;
+    state.skybox.retire_frames = SKYBOX_RETIRE_FRAMES;
+    state.skybox.preview.id = SG_INVALID_ID;
+  }
+  prefetch_skybox();
+}
+
+// Shows the skybox's cooked preview until the full resolution skybox is
+// complete, a preview that arrives after it is dropped.
+static void sky_preview_fetched(asset_t* asset, void* user_data) {
+  (void)user_data;
+  if (asset->state != ASSET_STATE_FETCHED) {
+    return;
+  }
+  texture_pack_t pack;
+  const texpack_entry_t* entry =
+      texture_pack_parse(&pack, asset->data, asset->size)
+          ? texture_pack_find(&pack, "skybox")
+          : NULL;
+  const bool ok = entry && entry->type == TEXPACK_TYPE_CUBE;
+  if (ok && state.timeToLoadCubemap == 0) {
+    sg_image_desc desc = {.wrap_u = SG_WRAP_CLAMP_TO_EDGE,
+                          .wrap_v = SG_WRAP_CLAMP_TO_EDGE,
+                          .wrap_w = SG_WRAP_CLAMP_TO_EDGE,
+                          .label = "cubemap-preview-image"};
+    texture_pack_image_desc(&pack, entry, &desc);
+    state.skybox.preview = sg_make_image(&desc);
+    upload_queue_account(UPLOAD_PRIORITY_SKYBOX,
+                         texture_pack_entry_size(entry));
+    state.skybox_bind.fs_images[SLOT_skybox_texture] = state.skybox.preview;
+    state.timeToFirstSky = stm_diff(stm_now(), state.imageLoadStartTime);
+  }
+  asset_registry_done(asset_registry_id(asset), ok);
 }
 static void arraytex_success_callback() {
   state.timeToLoadArrayTextures = stm_diff(stm_now(), state.imageLoadStartTime);
@@ -77,76 +188,331 @@ void load_image(const image_request_t* request, const char* image_label) {
                                  .wrap_u = request->wrap_u,
                                  .wrap_v = request->wrap_v,
                                  .fail_callback = request->fail_callback,
+                                 .pool_buffer = request->buffer_ptr == NULL,
                                  .label = image_label};
 
-  sfetch_send(&(sfetch_request_t){.path = request->path,
-                                  .callback = image_fetch_callback,
-                                  .buffer_ptr = request->buffer_ptr,
-                                  .buffer_size = request->buffer_size,
-                                  .user_data_ptr = &req_data,
-                                  .user_data_size = sizeof(req_data)});
+  asset_io_send(&(sfetch_request_t){.path = request->path,
+                                    .callback = image_fetch_callback,
+                                    .buffer_ptr = request->buffer_ptr,
+                                    .buffer_size = request->buffer_size,
+                                    .user_data_ptr = &req_data,
+                                    .user_data_size = sizeof(req_data)});
 }
 
+// Bound from the first frame on, every layer index the cells sample
+// clamps to its only layer.
+static void make_arraytex_placeholder(void) {
+  const uint32_t pixel = ARRAYTEX_PLACEHOLDER_COLOR;
+  state.arraytex_placeholder = sg_make_image(&(sg_image_desc){
+      .type = SG_IMAGETYPE_ARRAY,
+      .width = 1,
+      .height = 1,
+      .num_slices = 1,
+      .pixel_format = SG_PIXELFORMAT_RGBA8,
+      .data.subimage[0][0] = SG_RANGE(pixel),
+      .label = "arraytex-placeholder"});
+  state.shape_bind.fs_images[SLOT_shape_arraytex] = state.arraytex_placeholder;
+}
+
+// Replaces the placeholder once the array image is created.
+static void show_arraytex(void) {
+  state.shape_bind.fs_images[SLOT_shape_arraytex] = state.arraytex_image;
+  if (state.arraytex_placeholder.id != SG_INVALID_ID) {
+    sg_destroy_image(state.arraytex_placeholder);
+    state.arraytex_placeholder.id = SG_INVALID_ID;
+  }
+}
+
+// Creates the array texture with every slot on the placeholder, the
+// materials are streamed into the slots once they come into view.
 void load_array_texture(arraytex_request_t* request) {
-  state.arraytex_req =
-      (_arraytex_request_t){.img_id = request->img_id,
-                            .buffer = request->buffer_ptr,
-                            .texture_buffer_ptr = request->texture_buffer_ptr,
-                            .buffer_offset = request->buffer_offset,
-                            .fail_callback = request->fail_callback,
-                            .success_callback = request->success_callback};
-
-  for (int i = 0; i < ARRAYTEX_COUNT; ++i) {
-    _arraytex_request_instance_t req_inst = {.index = i,
-                                             .request = &state.arraytex_req};
-    sfetch_send(&(sfetch_request_t){
-        .path = request->paths[i],
-        .callback = arraytex_fetch_callback,
-        .buffer_ptr = request->buffer_ptr + (i * request->buffer_offset),
-        .buffer_size = request->buffer_offset,
-        .user_data_ptr = &req_inst,
-        .user_data_size = sizeof(req_inst)});
+  state.arraytex_req = (_arraytex_request_t){
+      .img_id = request->img_id,
+      .num_materials = request->num_assets < TEXTURE_RESIDENCY_MAX_MATERIALS
+                           ? request->num_assets
+                           : TEXTURE_RESIDENCY_MAX_MATERIALS,
+      .format = TEXPACK_FORMAT_RGBA8,
+      .streaming = true,
+      .fail_callback = request->fail_callback,
+      .success_callback = request->success_callback};
+  _arraytex_init_size(&state.arraytex_req);
+  if (!_arraytex_start(&state.arraytex_req)) {
+    request->fail_callback();
+    return;
+  }
+  show_arraytex();
+
+  for (int i = 0; i < state.arraytex_req.num_materials; ++i) {
+    state.arraytex_req.assets[i] = request->assets[i];
+  }
+}
+
+// `target` holds the request's state until it finishes, the initial
+// skybox uses state.cubemap_req and the prefetches state.skybox's own.
+void load_cubemap(_cubemap_request_t* target, cubemap_request_t* request) {
+  *target = (_cubemap_request_t){.img_id = request->img_id,
+                                 .upload_priority = request->upload_priority,
+                                 .fail_callback = request->fail_callback,
+                                 .success_callback = request->success_callback};
+  if (!load_group_start(&(load_group_desc_t){
+          .assets = request->assets,
+          .num_assets = 6,
+          .check_cb = _cubemap_check_face,
+          .decode_cb = _decode_cubemap_face,
+          .done_cb = _cubemap_loaded,
+          .user_data = target})) {
+    request->fail_callback();
+  }
+}
+
+// The files of both surfaces come from the cook sections of the manifests.
+static void load_loose_arraytex(void) {
+  const asset_manifest_t* manifest = asset_registry_find_manifest("arraytex");
+  if (!manifest || manifest->num_assets == 0) {
+    fail_callback();
+    return;
+  }
+  load_array_texture(&(arraytex_request_t){
+      .img_id = state.arraytex_image,
+      .assets = manifest->assets,
+      .num_assets = manifest->num_assets,
+      .fail_callback = fail_callback,
+      .success_callback = arraytex_success_callback});
+}
+
+static void load_loose_cubemap(void) {
+  const asset_manifest_t* manifest = asset_registry_find_manifest("skybox");
+  if (!manifest || manifest->num_assets != 6) {
+    fail_callback();
+    return;
+  }
+  load_cubemap(&state.cubemap_req,
+               &(cubemap_request_t){
+                   .img_id = state.skybox.image,
+                   .assets = manifest->assets,
+                   .upload_priority = UPLOAD_PRIORITY_SKYBOX,
+                   .fail_callback = fail_callback,
+                   .success_callback = cube_success_callback});
+}
+
+static const asset_manifest_t* skybox_set(int index) {
+  return asset_registry_manifest(state.skybox.sets[index]);
+}
+
+static void skybox_prefetched(void) {
+  state.skybox.prefetching = false;
+  state.skybox.prefetch_ready = true;
+  state.skybox.failed_prefetches = 0;
+}
+
+// Skips sets that can't be loaded, until none is left to try.
+static void skybox_prefetch_failed(void) {
+  state.skybox.prefetching = false;
+  // the image stays in the alloc state when the faces failed, but
+  // sg_init_image may have left it failed
+  if (sg_query_image_state(state.skybox.back) != SG_RESOURCESTATE_ALLOC) {
+    sg_destroy_image(state.skybox.back);
+    state.skybox.back = sg_alloc_image();
+  }
+  if (++state.skybox.failed_prefetches < state.skybox.num_sets - 1) {
+    state.skybox.next = (state.skybox.next + 1) % state.skybox.num_sets;
+    if (state.skybox.next == state.skybox.current) {
+      state.skybox.next = (state.skybox.next + 1) % state.skybox.num_sets;
+    }
+    prefetch_skybox();
+  } else {
+    state.skybox.swap_pending = false;
+  }
+}
+
+// Loads the next skybox set into the back image, in the background at the
+// set's priority and decoded on the job pool.
+static void prefetch_skybox(void) {
+  if (state.skybox.num_sets < 2 || state.skybox.prefetching ||
+      state.skybox.prefetch_ready) {
+    return;
+  }
+  if (state.skybox.back.id == SG_INVALID_ID) {
+    state.skybox.back = sg_alloc_image();
   }
+  state.skybox.prefetching = true;
+  load_cubemap(&state.skybox.prefetch_req,
+               &(cubemap_request_t){
+                   .img_id = state.skybox.back,
+                   .assets = skybox_set(state.skybox.next)->assets,
+                   .upload_priority = UPLOAD_PRIORITY_DECORATIVE,
+                   .fail_callback = skybox_prefetch_failed,
+                   .success_callback = skybox_prefetched});
 }
 
-void load_cubemap(cubemap_request_t* request) {
-  state.cubemap_req =
-      (_cubemap_request_t){.img_id = request->img_id,
-                           .buffer = request->buffer_ptr,
-                           .buffer_offset = request->buffer_offset,
-                           .fail_callback = request->fail_callback,
-                           .success_callback = request->success_callback};
-
-  const char* cubemap[6] = {request->path_right, request->path_left,
-                            request->path_up,    request->path_down,
-                            request->path_front, request->path_back};
-
-  for (int i = 0; i < 6; ++i) {
-    _cubemap_request_instance_t req_instance = {.index = i,
-                                                .request = &state.cubemap_req};
-    sfetch_send(&(sfetch_request_t){
-        .path = cubemap[i],
-        .callback = cubemap_fetch_callback,
-        .buffer_ptr = request->buffer_ptr + (i * request->buffer_offset),
-        .buffer_size = request->buffer_offset,
-        .user_data_ptr = &req_instance,
-        .user_data_size = sizeof(req_instance)});
+// Swaps in the prefetched skybox once it's ready and the last swapped out
+// image is released, then starts on the one after it.
+static void skybox_update(void) {
+  if (state.skybox.retired.id != SG_INVALID_ID &&
+      --state.skybox.retire_frames <= 0) {
+    sg_destroy_image(state.skybox.retired);
+    state.skybox.retired.id = SG_INVALID_ID;
   }
+  if (!state.skybox.swap_pending || !state.skybox.prefetch_ready ||
+      state.skybox.retired.id != SG_INVALID_ID) {
+    return;
+  }
+  state.skybox.retired = state.skybox_bind.fs_images[SLOT_skybox_texture];
+  state.skybox.retire_frames = SKYBOX_RETIRE_FRAMES;
+  state.skybox_bind.fs_images[SLOT_skybox_texture] = state.skybox.back;
+  state.skybox.back.id = SG_INVALID_ID;
+  // the bound skybox doesn't come from the texture pack anymore
+  state.pack_skybox.format = NULL;
+  state.skybox.current = state.skybox.next;
+  state.skybox.next = (state.skybox.current + 1) % state.skybox.num_sets;
+  state.skybox.prefetch_ready = false;
+  state.skybox.swap_pending = false;
+  prefetch_skybox();
+}
+
+// The cube manifests that can be cycled through, the initial skybox first.
+static void find_skybox_sets(void) {
+  state.skybox.num_sets = 0;
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int i = 0; i < asset_registry_num_manifests(); ++i) {
+      const asset_manifest_t* manifest = asset_registry_manifest(i);
+      const bool initial = strcmp(manifest->name, "skybox") == 0;
+      if (strcmp(manifest->type, "cube") == 0 && manifest->num_assets == 6 &&
+          initial == (pass == 0)) {
+        state.skybox.sets[state.skybox.num_sets++] = i;
+      }
+    }
+  }
+  state.skybox.current = 0;
+  state.skybox.next = state.skybox.num_sets > 1 ? 1 : 0;
+}
+
+static void load_loose_textures(void) {
+  load_loose_arraytex();
+  load_loose_cubemap();
+}
+
+// Creates the images straight from the cooked texture pack, surfaces that
+// are missing from it are loaded from the loose files instead.
+static void texture_pack_loaded(const texture_pack_t* pack) {
+  state.textures_from_pack = true;
+  const texpack_entry_t* arraytex = texture_pack_find(pack, "arraytex");
+  if (arraytex && arraytex->type == TEXPACK_TYPE_ARRAY &&
+      arraytex->num_slices == ARRAYTEX_COUNT) {
+    sg_image_desc desc = {.label = "arraytex-image"};
+    texture_pack_image_desc(pack, arraytex, &desc);
+    const size_t full_bytes = texture_pack_entry_size(arraytex);
+    const size_t kept_bytes =
+        full_bytes - texture_pack_drop_mips(
+                         arraytex,
+                         texture_quality_levels((int)arraytex->width,
+                                                (int)arraytex->height,
+                                                (int)arraytex->num_mips),
+                         &desc);
+    texture_quality_count(full_bytes, kept_bytes);
+    state.pack_arraytex.format = texture_pack_format_name(arraytex->format);
+    state.arraytex_req = (_arraytex_request_t){
+        .img_id = state.arraytex_image,
+        .fail_callback = fail_callback,
+        .success_callback = arraytex_success_callback};
+    if (arraytex_load_pack(&state.arraytex_req, pack, arraytex)) {
+      // the materials in view are streamed into the slots
+      state.pack_arraytex.bytes = arraytex_buffer_size(&state.arraytex_req);
+    } else {
+      state.pack_arraytex.bytes = kept_bytes;
+      sg_init_image(state.arraytex_image, &desc);
+      // the pack's data is gone after this callback, it can't wait
+      upload_queue_account(UPLOAD_PRIORITY_TERRAIN, kept_bytes);
+      state.arraytex_req.loaded_layers = ARRAYTEX_COUNT;
+      arraytex_success_callback();
+    }
+    show_arraytex();
+  } else {
+    load_loose_arraytex();
+  }
+  const texpack_entry_t* skybox = texture_pack_find(pack, "skybox");
+  if (skybox && skybox->type == TEXPACK_TYPE_CUBE) {
+    sg_image_desc desc = {.wrap_u = SG_WRAP_CLAMP_TO_EDGE,
+                          .wrap_v = SG_WRAP_CLAMP_TO_EDGE,
+                          .wrap_w = SG_WRAP_CLAMP_TO_EDGE,
+                          .label = "cubemap-image"};
+    texture_pack_image_desc(pack, skybox, &desc);
+    const size_t full_bytes = texture_pack_entry_size(skybox);
+    state.pack_skybox.bytes =
+        full_bytes - texture_pack_drop_mips(
+                         skybox,
+                         texture_quality_levels((int)skybox->width,
+                                                (int)skybox->height,
+                                                (int)skybox->num_mips),
+                         &desc);
+    texture_quality_count(full_bytes, state.pack_skybox.bytes);
+    sg_init_image(state.skybox.image, &desc);
+    state.pack_skybox.format = texture_pack_format_name(skybox->format);
+    upload_queue_account(UPLOAD_PRIORITY_SKYBOX, state.pack_skybox.bytes);
+    cube_success_callback();
+  } else {
+    load_loose_cubemap();
+  }
+}
+
+static void manifests_loaded(void) {
+  find_skybox_sets();
+  // tiny and in the way of the first correct frame, it goes first
+  asset_registry_fetch(
+      asset_registry_add("previews.hxtc", ASSET_PRIORITY_TERRAIN),
+      sky_preview_fetched, NULL);
+  texture_pack_load(&(texture_pack_desc_t){.path = "textures.hxtc",
+                                            .loaded_cb = texture_pack_loaded,
+                                            .fail_cb = load_loose_textures});
+  asset_registry_fetch(
+      asset_registry_add("favicon-32x32.png", ASSET_PRIORITY_DECORATIVE),
+      icon_fetched, NULL);
+}
+
+// Everything is requested through asset_io, from the asset pack when it's
+// there and as loose files otherwise. The manifests come first, they say
+// which files make up the surfaces and with which priority they load.
+static void load_assets(void) {
+  // the alternative skyboxes are only in the asset pack
+  const char* manifests[] = {
+      "texture_assets.yml",        "skybox_assets.yml",
+      "skybox_evening_assets.yml", "skybox_meadow_assets.yml",
+      "skybox_placid_assets.yml",  "skybox_terragen_assets.yml"};
+  asset_registry_load_manifests(
+      manifests, (int)(sizeof(manifests) / sizeof(manifests[0])),
+      manifests_loaded);
 }
 
 void init(void) {
-  sg_setup(&(sg_desc){.context = sapp_sgcontext()});
-  sfetch_setup(
-      &(sfetch_desc_t){.max_requests = 16, .num_channels = 4, .num_lanes = 4});
+  sg_setup(&(sg_desc){.context = headless_enabled() ? headless_sgcontext()
+                                                    : sapp_sgcontext()});
+  if (headless_enabled()) {
+    headless_setup_pass();
+  }
+  // registry fetches plus the loose images fetched directly
+  sfetch_setup(&(sfetch_desc_t){
+      .max_requests = ASSET_REGISTRY_MAX_IN_FLIGHT + 16,
+      .num_channels = 4,
+      .num_lanes = 8});
+  job_pool_setup(&(job_pool_desc_t){0});
+  // decoded loose images, for faster launches without the cooked packs
+  texture_cache_setup("hex_cache");
+  upload_queue_setup(
+      &(upload_queue_desc_t){.frame_budget = UPLOAD_BUDGET_BYTES});
   stm_setup();
+  // linked GL programs, every shader below is made through it
+  program_cache_setup("hex_cache");
   uint64_t initStartTime = stm_now();
   state.show_debug_ui = false;
   state.show_mem_ui = false;
+  state.show_asset_ui = false;
+  state.sort_front_to_back = true;
   state.lastFrameTime = stm_now();
   state.renderTime = 0;
   state.initTime = 0;
   state.imageLoadStartTime = 0;
   state.timeToLoadCubemap = 0;
+  state.timeToFirstSky = 0;
   state.timeToLoadArrayTextures = 0;
   state.pass_action =
       (sg_pass_action){.colors[0] = {.action = SG_ACTION_CLEAR,
@@ -154,7 +520,11 @@ void init(void) {
   sdtx_setup(&(sdtx_desc_t){
       .fonts[0] = sdtx_font_oric(),
   });
-  __cdbgui_setup(sapp_sample_count());
+  gpu_timer_init(&state.gpu_timer);
+  if (!headless_enabled()) {
+    __cdbgui_setup(sapp_sample_count());
+  }
+  render_stats_install();
 
   /*
     float vertices[] = {
@@ -227,12 +597,13 @@ void init(void) {
   state.skybox_bind.vertex_buffers[0] = skybox_buffer;
   sg_image skybox_img_id = sg_alloc_image();
   state.skybox_bind.fs_images[SLOT_skybox_texture] = skybox_img_id;
+  state.skybox.image = skybox_img_id;
   // sg_image cube_img_id = sg_alloc_image();
   // state.cube_bind.fs_images[SLOT_cube_texture] = cube_img_id;
   // sg_image shape_img_id = sg_alloc_image();
   // state.shape_bind.fs_images[SLOT_shape_texture] = shape_img_id;
-  sg_image arraytex_img_id = sg_alloc_image();
-  state.shape_bind.fs_images[SLOT_shape_arraytex] = arraytex_img_id;
+  state.arraytex_image = sg_alloc_image();
+  make_arraytex_placeholder();
 
   state.skybox_pip = sg_make_pipeline(&(sg_pipeline_desc){
       .shader = sg_make_shader(skybox_shader_desc(sg_query_backend())),
@@ -251,18 +622,17 @@ void init(void) {
 
   // SHAPES
 
-  hmm_vec3 shape_pos[NUM_CELLS];
-  float shape_tex_index[NUM_CELLS];
-  srand((unsigned int)time(NULL));
+  // benchmark runs need the same terrain every time
+  srand(headless_enabled() ? 0 : (unsigned int)time(NULL));
   for (int z = 0; z < NUM_CELLS_LONG; ++z) {
     for (int x = 0; x < NUM_CELLS_WIDE; ++x) {
       float i = ((float)x + z * 0.5f - z / 2) * (2.0f * 0.866025404f);
       float j = (float)z * 1.5f;
       int iZ = abs((int)j % ARRAYTEX_COUNT);
-      shape_tex_index[NUM_CELLS_WIDE * z + x] =
+      state.shape_tex_index[NUM_CELLS_WIDE * z + x] =
           (float)(rand() % ARRAYTEX_COUNT);
       float y = ((float)(rand()) / (float)(RAND_MAX)) / 5.0f;  // 0.0f;
-      shape_pos[NUM_CELLS_WIDE * z + x] = HMM_Vec3(
+      state.shape_pos[NUM_CELLS_WIDE * z + x] = HMM_Vec3(
           (float)(i - NUM_CELLS_WIDE / 2), y, (float)(j - NUM_CELLS_LONG / 2));
     }
   }
@@ -307,15 +677,51 @@ void init(void) {
   vbuf_desc.label = "shape-vertices";
   sg_buffer_desc ibuf_desc = sshape_index_buffer_desc(&buf);
   ibuf_desc.label = "shape-indices";
-  sg_buffer_desc instbuf_desc =
-      (sg_buffer_desc){.data = SG_RANGE(shape_pos), .label = "instance-data"};
-  sg_buffer_desc texbuf_desc = (sg_buffer_desc){
-      .data = SG_RANGE(shape_tex_index), .label = "texture-index-data"};
   state.shape_bind.vertex_buffers[0] = sg_make_buffer(&vbuf_desc);
-  state.shape_bind.vertex_buffers[1] = sg_make_buffer(&instbuf_desc);
-  state.shape_bind.vertex_buffers[2] = sg_make_buffer(&texbuf_desc);
+  // per-instance position and texture index are streamed every frame, up to
+  // three times when the overdraw measurement draws both orderings
+  stream_ring_init(&state.instance_ring,
+                   &(stream_ring_desc_t){
+                       .frame_size = 3 * (sizeof(state.shape_pos) +
+                                          sizeof(state.shape_tex_index)),
+                       .label = "instance-ring"});
+  state.draw_order = (draw_order_t){.keys = state.draw_keys[0],
+                                    .scratch_keys = state.draw_keys[1],
+                                    .indices = state.draw_indices[0],
+                                    .scratch_indices = state.draw_indices[1],
+                                    .capacity = NUM_CELLS};
   state.shape_bind.index_buffer = sg_make_buffer(&ibuf_desc);
 
+  state.overdraw.pip = sg_make_pipeline(&(sg_pipeline_desc){
+      .shader = sg_make_shader(overdraw_shader_desc(sg_query_backend())),
+      .layout = {.buffers[0] = sshape_buffer_layout_desc(),
+                 .buffers[1].step_func = SG_VERTEXSTEP_PER_INSTANCE,
+                 .buffers[2].step_func = SG_VERTEXSTEP_PER_INSTANCE,
+                 .attrs = {[0] = sshape_position_attr_desc(),
+                           [1] = sshape_normal_attr_desc(),
+                           [2] = sshape_texcoord_attr_desc(),
+                           [3] = sshape_color_attr_desc(),
+                           [4] = {.format = SG_VERTEXFORMAT_FLOAT3,
+                                  .buffer_index = 1},
+                           [5] = {.format = SG_VERTEXFORMAT_FLOAT,
+                                  .buffer_index = 2}}},
+      .index_type = SG_INDEXTYPE_UINT16,
+      .cull_mode = SG_CULLMODE_NONE,
+      .depth = {.pixel_format = OVERDRAW_DEPTH_FORMAT,
+                .compare = SG_COMPAREFUNC_LESS_EQUAL,
+                .write_enabled = true},
+      .colors[0] = {.pixel_format = OVERDRAW_COLOR_FORMAT,
+                    .blend = {.enabled = true,
+                              .src_factor_rgb = SG_BLENDFACTOR_ONE,
+                              .dst_factor_rgb = SG_BLENDFACTOR_ONE,
+                              .src_factor_alpha = SG_BLENDFACTOR_ONE,
+                              .dst_factor_alpha = SG_BLENDFACTOR_ONE}},
+      .sample_count = 1,
+      .label = "overdraw-pipeline",
+  });
+  state.overdraw.bind = state.shape_bind;
+  state.overdraw.bind.fs_images[SLOT_shape_arraytex] = (sg_image){0};
+
   camera_set_up(&state.cam, HMM_Vec3(0.0f, 2.5f, 6.0f),
                 (&(cam_desc_t){
                     // .constrain_movement = true,
@@ -328,15 +734,9 @@ void init(void) {
                 }));
 
   state.imageLoadStartTime = stm_now();
-  sfetch_send(&(sfetch_request_t){.path = "favicon-32x32.png",
-                                  .callback = icon_fetch_callback,
-                                  .buffer_ptr = favicon_buffer,
-                                  .buffer_size = sizeof(favicon_buffer)});
 
   // load_image(&(image_request_t){.img_id = cube_img_id,
   //                               .path = "container2.png",
-  //                               .buffer_ptr = state.texture_buffer,
-  //                               .buffer_size = sizeof(state.texture_buffer),
   //                               .wrap_u = SG_WRAP_CLAMP_TO_EDGE,
   //                               .wrap_v = SG_WRAP_CLAMP_TO_EDGE},
   //            "cube-image");
@@ -344,50 +744,85 @@ void init(void) {
   // load_image(
   //     &(image_request_t){.img_id = shape_img_id,
   //                        .path = "sand.png",
-  //                        .buffer_ptr = state.shape_texture_buffer,
-  //                        .buffer_size = sizeof(state.shape_texture_buffer),
   //                        .wrap_u = SG_WRAP_REPEAT,
   //                        .wrap_v = SG_WRAP_REPEAT},
   //     "shape-texture");
 
-  const char* arraytex_paths[ARRAYTEX_COUNT] = {
-      "grass.png", "mud.png", "rock.png", "sand.png", "snow.png", "stone.png",
-  };
+  asset_io_setup(&(asset_io_desc_t){.pack_path = "assets.hxap",
+                                    .uring = true,
+                                    .ready_cb = load_assets});
+  state.initTime = stm_diff(stm_now(), initStartTime);
+}
 
-  load_array_texture(&(arraytex_request_t){
-      .img_id = arraytex_img_id,
-      .paths = arraytex_paths,
-      .image_count = ARRAYTEX_COUNT,
-      .buffer_ptr = state.arraytex_load_buffer,
-      .texture_buffer_ptr = (uint8_t*)state.arraytex_buffer,
-      .buffer_offset = ARRAYTEX_ARRAY_IMAGE_OFFSET,
-      .fail_callback = fail_callback,
-      .success_callback = arraytex_success_callback});
+// Culls and orders the cells, then streams the visible instances into the
+// ring and points `bind` at them. Returns the number of instances to draw.
+static int emit_cell_instances(sg_bindings* bind,
+                               hmm_mat4 viewproj,
+                               bool front_to_back) {
+  const int visible = draw_order_build(
+      &state.draw_order, state.shape_pos, NUM_CELLS, CELL_BOUNDING_RADIUS,
+      viewproj, camera_get_position(&state.cam),
+      camera_get_direction(&state.cam), front_to_back);
+  for (int i = 0; i < visible; ++i) {
+    const uint32_t cell = state.draw_order.indices[i];
+    state.visible_pos[i] = state.shape_pos[cell];
+    state.visible_tex_index[i] = (float)arraytex_layer(
+        &state.arraytex_req, (int)state.shape_tex_index[cell]);
+  }
+  if (visible == 0) {
+    return 0;
+  }
 
-  load_cubemap(&(cubemap_request_t){.img_id = skybox_img_id,
-                                    .path_right = "right.jpg",
-                                    .path_left = "left.jpg",
-                                    .path_up = "up.jpg",
-                                    .path_down = "down.jpg",
-                                    .path_front = "front.jpg",
-                                    .path_back = "back.jpg",
-                                    .buffer_ptr = state.cubemap_buffer,
-                                    .buffer_offset = 1024 * 1024,
-                                    .fail_callback = fail_callback,
-                                    .success_callback = cube_success_callback});
-  state.initTime = stm_diff(stm_now(), initStartTime);
+  const int pos_offset = stream_ring_push(
+      &state.instance_ring,
+      (sg_range){state.visible_pos, visible * sizeof(hmm_vec3)});
+  const int tex_index_offset = stream_ring_push(
+      &state.instance_ring,
+      (sg_range){state.visible_tex_index, visible * sizeof(float)});
+  if (pos_offset < 0 || tex_index_offset < 0) {
+    return 0;
+  }
+  bind->vertex_buffers[1] = stream_ring_buffer(&state.instance_ring);
+  bind->vertex_buffer_offsets[1] = pos_offset;
+  bind->vertex_buffers[2] = stream_ring_buffer(&state.instance_ring);
+  bind->vertex_buffer_offsets[2] = tex_index_offset;
+  return visible;
+}
+
+static float measure_overdraw(hmm_mat4 viewproj, bool front_to_back) {
+  const int num_instances =
+      emit_cell_instances(&state.overdraw.bind, viewproj, front_to_back);
+  textured_shape_vs_params_t params = {.model = HMM_Mat4d(1.0f),
+                                       .viewproj = viewproj};
+  overdraw_begin(&state.overdraw.target);
+  if (num_instances > 0) {
+    sg_apply_pipeline(state.overdraw.pip);
+    sg_apply_bindings(&state.overdraw.bind);
+    sg_apply_uniforms(SG_SHADERSTAGE_VS, SLOT_textured_shape_vs_params,
+                      &SG_RANGE(params));
+    sg_draw(state.shape_elems.base_element, state.shape_elems.num_elements,
+            num_instances);
+  }
+  return overdraw_end(&state.overdraw.target);
 }
 
 void frame(void) {
+  // first, the callbacks below may upload images that can't wait
+  upload_queue_begin_frame();
+  asset_registry_dowork();
   sfetch_dowork();
+  asset_io_dowork();
+  job_pool_dowork();
 
   uint64_t currTime = stm_now();
 
-  float deltaTime = (float)stm_sec(stm_diff(currTime, state.lastFrameTime));
+  float deltaTime = headless_enabled()
+                        ? (1.0f / 60.0f)
+                        : (float)stm_sec(stm_diff(currTime, state.lastFrameTime));
   state.lastFrameTime = currTime;
 
-  const int w = sapp_width();
-  const int h = sapp_height();
+  const int w = app_width();
+  const int h = app_height();
 
   const float aspect = (float)w / (float)h;
 
@@ -405,38 +840,225 @@ void frame(void) {
     sdtx_move_y(1);
     sdtx_printf("Init Time: %.2f\n", (float)stm_ms(state.initTime));
   }
-  if (state.timeToLoadCubemap > 0) {
+  sdtx_move_y(1);
+  sdtx_printf("Decode Threads: %d\n", job_pool_num_threads());
+  sdtx_move_y(1);
+  sdtx_printf("Textures: %s\n",
+              state.textures_from_pack ? "cooked pack" : "loose files");
+  if (state.pack_arraytex.format) {
+    sdtx_printf("  Arraytex: %s, %.1f MB\n", state.pack_arraytex.format,
+                (float)state.pack_arraytex.bytes / (1024.0f * 1024.0f));
+  }
+  if (state.pack_skybox.format) {
+    sdtx_printf("  Skybox: %s, %.1f MB\n", state.pack_skybox.format,
+                (float)state.pack_skybox.bytes / (1024.0f * 1024.0f));
+  }
+  const asset_io_stats_t io_stats = asset_io_stats();
+  if (io_stats.pack_open) {
+    sdtx_printf("Asset Pack: %u files, %u reads, %.1f MB, %u loose\n",
+                io_stats.pack_entries, io_stats.pack_reads,
+                (float)io_stats.pack_bytes / (1024.0f * 1024.0f),
+                io_stats.loose_reads);
+    if (io_stats.uring) {
+      sdtx_printf("  io_uring: %u batches\n", io_stats.uring_batches);
+    }
+  } else {
+    sdtx_printf("Asset Pack: missing, %u loose reads\n",
+                io_stats.loose_reads);
+  }
+  const texture_quality_stats_t quality_stats = texture_quality_stats();
+  sdtx_printf("Texture Quality: %s, %u scaled, %.1f/%.1f MB saved\n",
+              texture_quality_name(), quality_stats.surfaces,
+              (float)quality_stats.saved_bytes / (1024.0f * 1024.0f),
+              (float)quality_stats.full_bytes / (1024.0f * 1024.0f));
+  if (texture_cache_enabled()) {
+    const texture_cache_stats_t cache_stats = texture_cache_stats();
+    sdtx_printf("Texture Cache: %u hits, %u misses, %.1f MB mapped\n",
+                cache_stats.hits, cache_stats.misses,
+                (float)cache_stats.hit_bytes / (1024.0f * 1024.0f));
+  }
+  if (program_cache_enabled()) {
+    const program_cache_stats_t program_stats = program_cache_stats();
+    sdtx_printf("Program Cache: %u hits, %u misses, %.1f ms saved\n",
+                program_stats.hits, program_stats.misses,
+                program_stats.saved_ms);
+    if (program_stats.misses > 0 || program_stats.rejected > 0) {
+      sdtx_printf("  Compiled: %.1f ms, %u rejected\n",
+                  program_stats.compile_ms, program_stats.rejected);
+    }
+  }
+  const upload_queue_stats_t upload_stats = upload_queue_stats();
+  sdtx_printf("Uploads: %.1f/%.1f MB, peak %.1f MB, %d queued, %u deferred\n",
+              (float)upload_stats.frame_total / (1024.0f * 1024.0f),
+              (float)upload_stats.frame_budget / (1024.0f * 1024.0f),
+              (float)upload_stats.peak_frame_bytes / (1024.0f * 1024.0f),
+              upload_stats.queued, upload_stats.deferrals);
+  if (state.timeToFirstSky > 0) {
     sdtx_move_y(1);
-    sdtx_printf("Cubemap Load Time: %.2f\n",
-                (float)stm_ms(state.timeToLoadCubemap));
+    if (state.timeToLoadCubemap > 0) {
+      sdtx_printf("Cubemap Load Time: %.2f\n",
+                  (float)stm_ms(state.timeToLoadCubemap));
+      sdtx_printf("  First Sky: %.2f  Full Sky: %.2f\n",
+                  (float)stm_ms(state.timeToFirstSky),
+                  (float)stm_ms(state.timeToLoadCubemap));
+    } else {
+      sdtx_puts("Cubemap Load Time: loading\n");
+      sdtx_printf("  First Sky: %.2f  Full Sky: loading\n",
+                  (float)stm_ms(state.timeToFirstSky));
+    }
+  }
+  if (state.skybox.num_sets > 1) {
+    sdtx_printf("Skybox: %s (K: next%s)\n",
+                skybox_set(state.skybox.current)->name,
+                state.skybox.prefetching ? ", prefetching" : "");
   }
   if (state.timeToLoadArrayTextures > 0) {
     sdtx_move_y(1);
     sdtx_printf("Arraytex Load Time: %.2f\n",
                 (float)stm_ms(state.timeToLoadArrayTextures));
+  } else if (!state.arraytex_req.streaming) {
+    sdtx_move_y(1);
+    sdtx_printf("Arraytex Layers: %d/%d\n", state.arraytex_req.loaded_layers,
+                ARRAYTEX_COUNT);
+  }
+  if (state.arraytex_req.streaming) {
+    // the VRAM of the array texture is fixed by the slot count
+    const texture_residency_t* residency = &state.arraytex_req.residency;
+    sdtx_printf("Arraytex Residency: %d/%d slots, %d materials, %.1f MB\n",
+                texture_residency_num_resident(residency),
+                state.arraytex_req.num_slots,
+                residency->num_materials,
+                (float)arraytex_buffer_size(&state.arraytex_req) /
+                    (1024.0f * 1024.0f));
+    sdtx_printf("  Loads: %u  Evictions: %u  Misses: %u\n",
+                residency->stats.loads, residency->stats.evictions,
+                residency->stats.misses);
   }
   if (state.renderTime > 0) {
     sdtx_move_y(1);
     sdtx_printf("Render Time: %.2f\n", (float)stm_ms(state.renderTime));
+    for (int i = 0; i < GPU_TIMER_NUM; ++i) {
+      if (state.gpu_timer.supported) {
+        sdtx_printf("  %-8s CPU %.3f  GPU %.3f\n",
+                    gpu_timer_section_name((gpu_timer_section)i),
+                    state.gpu_timer.cpu_ms[i], state.gpu_timer.gpu_ms[i]);
+      } else {
+        sdtx_printf("  %-8s CPU %.3f  GPU n/a\n",
+                    gpu_timer_section_name((gpu_timer_section)i),
+                    state.gpu_timer.cpu_ms[i]);
+      }
+    }
+    if (state.gpu_timer.supported) {
+      sdtx_printf("  GPU readback stalls: %u\n", state.gpu_timer.stalls);
+    }
   }
   sdtx_move_y(2);
   sdtx_printf("Frame Time: %.2f (%d FPS)\n",
               (float)stm_ms(stm_diff(currTime, state.lastFrameTime)),
               (int)(1 / deltaTime));
+  sdtx_printf("Visible Cells: %d / %d (%s)\n", state.visible_cells,
+              NUM_CELLS,
+              state.sort_front_to_back ? "front-to-back" : "unsorted");
+  const render_stats_counters_t stats = render_stats_last();
+  sdtx_printf("Draws: %u  Instances: %u  Tris: %llu\n", stats.draws,
+              stats.instances, (unsigned long long)stats.triangles);
+  sdtx_printf("Pipelines: %u  Bindings: %u  Uniforms: %u\n",
+              stats.pipelines, stats.bindings, stats.uniforms);
+  sdtx_printf("Updates: %u buf, %u img, %llu bytes\n", stats.buffer_updates,
+              stats.image_updates, (unsigned long long)stats.upload_bytes);
+  if (state.overdraw.enabled) {
+    if (state.overdraw.factor_sorted < 0.0f) {
+      sdtx_puts("Overdraw: readback not supported\n");
+    } else {
+      sdtx_printf("Overdraw: %.2f unsorted, %.2f front-to-back\n",
+                  state.overdraw.factor_unsorted,
+                  state.overdraw.factor_sorted);
+    }
+  }
 
   if (state.show_mem_ui) {
     sdtx_move_y(2);
     sdtx_puts("Sokol Header Allocations:\n\n");
     sdtx_printf("  Num: %d\n", smemtrack_info().num_allocs);
     sdtx_printf("  Allocs: %d bytes\n", smemtrack_info().num_bytes);
+    sdtx_move_y(1);
+    const stbi_alloc_stats_t stbi_stats = stbi_alloc_stats();
+    sdtx_puts("Image Decoder Allocations:\n\n");
+    sdtx_printf("  Live: %zu bytes\n", stbi_stats.live_bytes);
+    sdtx_printf("  Peak: %zu bytes\n", stbi_stats.peak_bytes);
+    sdtx_printf("  Copies: %zu\n", stbi_stats.num_copies);
+    sdtx_move_y(1);
+    const buffer_pool_stats_t pool_stats = buffer_pool_stats();
+    sdtx_puts("Asset Buffer Pool:\n\n");
+    sdtx_printf("  Live: %zu bytes\n", pool_stats.live_bytes);
+    sdtx_printf("  Peak: %zu bytes\n", pool_stats.peak_bytes);
+    sdtx_printf("  Cached: %zu bytes\n", pool_stats.cached_bytes);
+    sdtx_printf("  Hits: %u  Misses: %u\n", pool_stats.hits,
+                pool_stats.misses);
+    sdtx_move_y(1);
+    sdtx_puts("Instance Stream Ring:\n\n");
+    sdtx_printf("  Frame: %u / %d bytes\n", state.instance_ring.frame_bytes,
+                state.instance_ring.frame_size);
+    sdtx_printf("  Peak: %u bytes\n", state.instance_ring.peak_frame_bytes);
+    sdtx_printf("  Wraps: %u  Near full: %u  Overflows: %u\n",
+                state.instance_ring.wraps, state.instance_ring.full_frames,
+                state.instance_ring.overflows);
+  }
+
+  if (state.show_asset_ui) {
+    // fetch: sent until in memory, total: requested until decoded
+    sdtx_move_y(2);
+    sdtx_puts("Assets:\n\n");
+    for (int i = 0; i < asset_registry_num_assets(); ++i) {
+      const asset_t* asset = asset_registry_get(i);
+      const float fetch_ms =
+          asset->fetched_time > 0
+              ? (float)stm_ms(stm_diff(asset->fetched_time, asset->sent_time))
+              : 0.0f;
+      const float total_ms =
+          asset->done_time > 0
+              ? (float)stm_ms(stm_diff(asset->done_time, asset->queued_time))
+              : 0.0f;
+      sdtx_printf("  %-20s %-10s %-8s %7.2f %7.2f\n", asset->name,
+                  asset_priority_name(asset->priority),
+                  asset_state_name(asset->state), fetch_ms, total_ms);
+    }
   }
 
   hmm_mat4 view = camera_get_view_matrix(&state.cam);
   hmm_mat4 projection =
       HMM_Perspective(camera_get_fov(&state.cam), aspect, 0.1f, 1000.0f);
 
+  const hmm_mat4 viewproj = HMM_MultiplyMat4(projection, view);
+
   uint64_t renderStartTime = stm_now();
-  sg_begin_default_pass(&state.pass_action, sapp_width(), sapp_height());
+  arraytex_update(&state.arraytex_req);
+  arraytex_begin_frame(&state.arraytex_req);
+  skybox_update();
+  // the pooled buffers aren't needed anymore once everything is uploaded
+  if (state.timeToLoadCubemap > 0 && state.timeToLoadArrayTextures > 0 &&
+      buffer_pool_stats().live_bytes == 0) {
+    buffer_pool_trim();
+  }
+  gpu_timer_begin_frame(&state.gpu_timer);
+  stream_ring_begin_frame(&state.instance_ring);
+  if (state.overdraw.enabled) {
+    state.overdraw.factor_unsorted = measure_overdraw(viewproj, false);
+    state.overdraw.factor_sorted = measure_overdraw(viewproj, true);
+  }
+  state.visible_cells = emit_cell_instances(&state.shape_bind, viewproj,
+                                            state.sort_front_to_back);
+  upload_queue_account(UPLOAD_PRIORITY_FRAME,
+                       state.instance_ring.frame_bytes);
+  arraytex_stream(&state.arraytex_req);
+  // after this frame's own data, the rest of the budget goes to the loads
+  upload_queue_dowork();
+
+  if (headless_enabled()) {
+    headless_begin_pass(&state.pass_action);
+  } else {
+    sg_begin_default_pass(&state.pass_action, w, h);
+  }
 
   // DRAW CUBE
   // vs_params_t vs_params;
@@ -449,17 +1071,22 @@ void frame(void) {
   // &SG_RANGE(vs_params)); sg_draw(0, 36, 1);
 
   // DRAW SHAPES
-  textured_shape_vs_params_t shape_params;
-  sg_apply_pipeline(state.shape_pip);
-  sg_apply_bindings(&state.shape_bind);
-  shape_params.viewproj = HMM_MultiplyMat4(projection, view);
-  shape_params.model = HMM_Mat4d(1.0);
-  sg_apply_uniforms(SG_SHADERSTAGE_VS, SLOT_shape_vs_params,
-                    &SG_RANGE(shape_params));
-  sg_draw(state.shape_elems.base_element, state.shape_elems.num_elements,
-          NUM_CELLS);
+  gpu_timer_begin(&state.gpu_timer, GPU_TIMER_TERRAIN);
+  if (state.visible_cells > 0) {
+    textured_shape_vs_params_t shape_params;
+    sg_apply_pipeline(state.shape_pip);
+    sg_apply_bindings(&state.shape_bind);
+    shape_params.viewproj = viewproj;
+    shape_params.model = HMM_Mat4d(1.0);
+    sg_apply_uniforms(SG_SHADERSTAGE_VS, SLOT_shape_vs_params,
+                      &SG_RANGE(shape_params));
+    sg_draw(state.shape_elems.base_element, state.shape_elems.num_elements,
+            state.visible_cells);
+  }
+  gpu_timer_end(&state.gpu_timer, GPU_TIMER_TERRAIN);
 
   // DRAW SKYBOX
+  gpu_timer_begin(&state.gpu_timer, GPU_TIMER_SKYBOX);
   view.Elements[3][0] = 0.0f;
   view.Elements[3][1] = 0.0f;
   view.Elements[3][2] = 0.0f;
@@ -473,13 +1100,19 @@ void frame(void) {
   sg_apply_uniforms(SG_SHADERSTAGE_VS, SLOT_skybox_vs_params,
                     &SG_RANGE(skybox_params));
   sg_draw(0, 36, 1);
+  gpu_timer_end(&state.gpu_timer, GPU_TIMER_SKYBOX);
 
+  gpu_timer_begin(&state.gpu_timer, GPU_TIMER_UI);
   // if (state.show_mem_ui) {
   sdtx_draw();
   // }
   if (state.show_debug_ui) {
     __cdbgui_draw();
   }
+  gpu_timer_end(&state.gpu_timer, GPU_TIMER_UI);
+  if (headless_enabled()) {
+    headless_capture();
+  }
   sg_end_pass();
   sg_commit();
   state.renderTime = stm_diff(stm_now(), renderStartTime);
@@ -499,6 +1132,22 @@ void event(const sapp_event* e) {
     if (e->key_code == SAPP_KEYCODE_N) {
       state.show_mem_ui = !state.show_mem_ui;
     }
+    if (e->key_code == SAPP_KEYCODE_L) {
+      state.show_asset_ui = !state.show_asset_ui;
+    }
+    if (e->key_code == SAPP_KEYCODE_K) {
+      state.skybox.swap_pending = state.skybox.num_sets > 1;
+    }
+    if (e->key_code == SAPP_KEYCODE_F) {
+      state.sort_front_to_back = !state.sort_front_to_back;
+    }
+    if (e->key_code == SAPP_KEYCODE_O) {
+      state.overdraw.enabled = !state.overdraw.enabled;
+      if (state.overdraw.enabled && !state.overdraw.target.pixels) {
+        overdraw_init(&state.overdraw.target, SCREEN_WIDTH / 2,
+                      SCREEN_HEIGHT / 2);
+      }
+    }
   }
   hmm_vec2 mouse_offset = HMM_Vec2(0.0f, 0.0f);
   if (e->type == SAPP_EVENTTYPE_MOUSE_MOVE) {
@@ -515,15 +1164,65 @@ void event(const sapp_event* e) {
 }
 
 void cleanup(void) {
-  __cdbgui_shutdown();
+  gpu_timer_shutdown(&state.gpu_timer);
+  overdraw_shutdown(&state.overdraw.target);
+  stream_ring_shutdown(&state.instance_ring);
+  if (!headless_enabled()) {
+    __cdbgui_shutdown();
+  }
   sdtx_shutdown();
+  job_pool_shutdown();
+  asset_io_shutdown();
   sfetch_shutdown();
+  arraytex_shutdown(&state.arraytex_req);
+  buffer_pool_trim();
   sg_shutdown();
 }
 
+static void write_bench_columns(FILE* csv, bool header) {
+  if (header) {
+    fputs(",render_ms,visible_cells,passes,draws,instances,triangles,"
+          "pipelines,bindings,uniforms,buffer_updates,image_updates,"
+          "upload_bytes,ring_bytes,ring_wraps,ring_full_frames,"
+          "ring_overflows,terrain_cpu_ms,terrain_gpu_ms,skybox_cpu_ms,"
+          "skybox_gpu_ms,ui_cpu_ms,ui_gpu_ms,gpu_stalls",
+          csv);
+  } else {
+    const render_stats_counters_t stats = render_stats_last();
+    const stream_ring_t* ring = &state.instance_ring;
+    fprintf(csv, ",%.4f,%d,%u,%u,%u,%llu,%u,%u,%u,%u,%u,%llu,%u,%u,%u,%u",
+            stm_ms(state.renderTime), state.visible_cells, stats.passes,
+            stats.draws, stats.instances, (unsigned long long)stats.triangles,
+            stats.pipelines, stats.bindings, stats.uniforms,
+            stats.buffer_updates, stats.image_updates,
+            (unsigned long long)stats.upload_bytes, ring->frame_bytes,
+            ring->wraps, ring->full_frames, ring->overflows);
+    // the GPU columns stay empty where there are no timer queries
+    const gpu_timer_t* timer = &state.gpu_timer;
+    for (int i = 0; i < GPU_TIMER_NUM; ++i) {
+      if (timer->supported) {
+        fprintf(csv, ",%.4f,%.4f", timer->cpu_ms[i], timer->gpu_ms[i]);
+      } else {
+        fprintf(csv, ",%.4f,", timer->cpu_ms[i]);
+      }
+    }
+    if (timer->supported) {
+      fprintf(csv, ",%u", timer->stalls);
+    } else {
+      fputc(',', csv);
+    }
+  }
+}
+
 sapp_desc sokol_main(int argc, char* argv[]) {
-  (void)argc;
-  (void)argv;
+  headless_desc_t headless_desc = {.init_cb = init,
+                                   .frame_cb = frame,
+                                   .cleanup_cb = cleanup,
+                                   .csv_cb = write_bench_columns};
+  texture_quality_setup(texture_quality_parse_args(argc, argv));
+  if (headless_parse_args(argc, argv, &headless_desc)) {
+    exit(headless_run(&headless_desc));
+  }
   // char app_title[21];
   // sprintf(app_title, "App Version %s.%s.%s", PROJECT_VERSION_MAJOR,
   //         PROJECT_VERSION_MINOR, PROJECT_VERSION_PATCH);
@@ -142,6 +142,15 @@ void main() {
 }
 @end
 
+@fs overdraw_fs
+out vec4 frag_color;
+
+void main() {
+    // one count per shaded fragment, accumulated with additive blending
+    frag_color = vec4(1.0 / 255.0, 0.0, 0.0, 1.0);
+}
+@end
+
 @vs vs_skybox
 in vec3 a_pos;
 
@@ -175,4 +184,5 @@ void main() {
 @program cube vs fs
 @program textured_cube textured_vs textured_fs
 @program shape shape_vs shape_fs
-@program textured_shape textured_shape_vs textured_shape_fs
\ No newline at end of file
+@program textured_shape textured_shape_vs textured_shape_fs
+@program overdraw textured_shape_vs overdraw_fs
\ No newline at end of file
@@ -0,0 +1,191 @@
+/*
+  Packs the runtime's files into one asset pack (see asset_pack_format.h).
+
+  usage: assetpacker -o <pack> [-a <file>]... <assets.yml>...
+
+  The data/..._assets.yml manifests and every file listed under their
+  `files:` are stored under their base name, the latter behind the
+  manifest's `prefix` option. -a adds single files such as the cooked
+  texture pack. The runtime reads them back as ranges of the pack through
+  asset_io.h and falls back to loose files for anything not packed.
+*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "asset_pack_format.h"
+#include "asset_yml.h"
+
+#define MAX_PATH_SIZE (1024)
+
+typedef struct pack_file_t {
+  char path[MAX_PATH_SIZE];
+  asset_pack_entry_t entry;
+} pack_file_t;
+
+static pack_file_t files[ASSET_PACK_MAX_ENTRIES];
+static int num_files;
+
+static const char* base_name(const char* path) {
+  const char* name = path;
+  for (const char* c = path; *c; ++c) {
+    if (*c == '/' || *c == '\\') {
+      name = c + 1;
+    }
+  }
+  return name;
+}
+
+static bool add_file(const char* path, const char* prefix) {
+  char name[ASSET_PACK_NAME_SIZE + 1];
+  snprintf(name, sizeof(name), "%s%s", prefix, base_name(path));
+  if (strlen(name) >= ASSET_PACK_NAME_SIZE) {
+    fprintf(stderr, "%s: name longer than %d characters\n", path,
+            ASSET_PACK_NAME_SIZE - 1);
+    return false;
+  }
+  for (int i = 0; i < num_files; ++i) {
+    if (strcmp(files[i].entry.name, name) == 0) {
+      fprintf(stderr, "%s: '%s' is already packed from %s\n", path, name,
+              files[i].path);
+      return false;
+    }
+  }
+  if (num_files == ASSET_PACK_MAX_ENTRIES) {
+    fprintf(stderr, "%s: more than %d files\n", path, ASSET_PACK_MAX_ENTRIES);
+    return false;
+  }
+  pack_file_t* file = &files[num_files++];
+  snprintf(file->path, sizeof(file->path), "%s", path);
+  memset(&file->entry, 0, sizeof(file->entry));
+  strcpy(file->entry.name, name);
+  return true;
+}
+
+static bool add_yml(const char* yml_path) {
+  asset_yml_t yml;
+  // the runtime reads the manifests too
+  if (!asset_yml_load(&yml, yml_path) || !add_file(yml_path, "")) {
+    return false;
+  }
+  for (int i = 0; i < yml.num_files; ++i) {
+    char path[MAX_PATH_SIZE];
+    asset_yml_source_path(path, sizeof(path), yml_path, &yml, yml.files[i]);
+    if (!add_file(path, yml.prefix)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static uint32_t align_up(uint32_t offset) {
+  return (offset + ASSET_PACK_ALIGN - 1) & ~(uint32_t)(ASSET_PACK_ALIGN - 1);
+}
+
+static long file_size(FILE* fp) {
+  if (fseek(fp, 0, SEEK_END) != 0) {
+    return -1;
+  }
+  const long size = ftell(fp);
+  return fseek(fp, 0, SEEK_SET) == 0 ? size : -1;
+}
+
+// Copies `size` bytes from `src` to `dst`.
+static bool copy_file(FILE* dst, FILE* src, uint32_t size) {
+  static uint8_t chunk[64 * 1024];
+  while (size > 0) {
+    const size_t n = size < sizeof(chunk) ? size : sizeof(chunk);
+    if (fread(chunk, n, 1, src) != 1 || fwrite(chunk, n, 1, dst) != 1) {
+      return false;
+    }
+    size -= (uint32_t)n;
+  }
+  return true;
+}
+
+static bool write_pack(const char* path) {
+  asset_pack_header_t header = {.magic = ASSET_PACK_MAGIC,
+                                .version = ASSET_PACK_VERSION,
+                                .num_entries = (uint32_t)num_files};
+  uint64_t offset = asset_pack_toc_size((uint32_t)num_files);
+  for (int i = 0; i < num_files; ++i) {
+    FILE* fp = fopen(files[i].path, "rb");
+    const long size = fp ? file_size(fp) : -1;
+    if (fp) {
+      fclose(fp);
+    }
+    if (size < 0) {
+      fprintf(stderr, "%s: can't read\n", files[i].path);
+      return false;
+    }
+    offset = align_up((uint32_t)offset);
+    files[i].entry.offset = (uint32_t)offset;
+    files[i].entry.size = (uint32_t)size;
+    offset += (uint64_t)size;
+    if (offset > UINT32_MAX - ASSET_PACK_ALIGN) {
+      fprintf(stderr, "%s: pack larger than 4 GB\n", path);
+      return false;
+    }
+  }
+  header.file_size = (uint32_t)offset;
+
+  FILE* fp = fopen(path, "wb");
+  if (!fp) {
+    fprintf(stderr, "%s: can't open for writing\n", path);
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+  for (int i = 0; ok && i < num_files; ++i) {
+    ok = fwrite(&files[i].entry, sizeof(asset_pack_entry_t), 1, fp) == 1;
+  }
+  static const uint8_t zeros[ASSET_PACK_ALIGN] = {0};
+  for (int i = 0; ok && i < num_files; ++i) {
+    const long pad = (long)files[i].entry.offset - ftell(fp);
+    FILE* src = fopen(files[i].path, "rb");
+    ok = src && (pad == 0 || fwrite(zeros, (size_t)pad, 1, fp) == 1) &&
+         copy_file(fp, src, files[i].entry.size);
+    if (src) {
+      fclose(src);
+    }
+    if (!ok) {
+      fprintf(stderr, "%s: copy failed\n", files[i].path);
+    }
+  }
+  ok = fclose(fp) == 0 && ok;
+  if (!ok) {
+    fprintf(stderr, "%s: write failed\n", path);
+  }
+  return ok;
+}
+
+int main(int argc, char* argv[]) {
+  const char* out_path = NULL;
+  bool ok = true;
+  int num_inputs = 0;
+  for (int i = 1; ok && i < argc; ++i) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      out_path = argv[++i];
+    } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+      ok = add_file(argv[++i], "");
+      ++num_inputs;
+    } else {
+      ok = add_yml(argv[i]);
+      ++num_inputs;
+    }
+  }
+  if (!out_path || num_inputs == 0) {
+    fprintf(stderr,
+            "usage: assetpacker -o <pack> [-a <file>]... <assets.yml>...\n");
+    return 1;
+  }
+  ok = ok && write_pack(out_path);
+  if (ok) {
+    for (int i = 0; i < num_files; ++i) {
+      printf("%s: %u bytes at %u\n", files[i].entry.name, files[i].entry.size,
+             files[i].entry.offset);
+    }
+  }
+  return ok ? 0 : 1;
+}
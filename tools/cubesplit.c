@@ -0,0 +1,328 @@
+/*
+  cubesplit: cooks a cubemap laid out as a 4x3 horizontal cross straight
+  into a texture pack (see texture_pack_format.h), without going through
+  six loose face files that would have to be decoded again.
+
+  usage: cubesplit -o <pack> [-n <name>] [-s <face size>] [-f <formats>]
+                   <cross image>
+
+          +Y
+      -X  +Z  +X  -Z
+          -Y
+
+  The source file is memory mapped and decoded once, then the six faces
+  are cut out, downsampled and mipmapped in parallel on the job pool. The
+  cells of the cross are width / 4 by height / 3 texels, the faces are
+  the centered square of a cell with the smaller of both sides, brought
+  down to -s if that asks for less. Skyboxes are
+  opaque, alpha is dropped so the cross's transparent background bleeding
+  into the seams doesn't force a format with alpha. -n names the surface
+  (default "skybox"), -f works like texcooker's.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stb/stb_image.h"
+#define SOKOL_TIME_IMPL
+#include "sokol_time.h"
+#include "texcook.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+typedef struct mapped_file_t {
+  const uint8_t* data;
+  size_t size;
+#if defined(_WIN32)
+  HANDLE file;
+  HANDLE mapping;
+#endif
+} mapped_file_t;
+
+typedef struct face_job_t {
+  const uint8_t* cross;
+  int cross_width;
+  // cell of the face in the cross
+  int x;
+  int y;
+  int cell_width;
+  int cell_height;
+  int face;
+  cook_surface_t* surface;
+  bool ok;
+} face_job_t;
+
+// Cell of each face in the cross, in sokol's +X -X +Y -Y +Z -Z order.
+static const int face_cells[6][2] = {{2, 1}, {0, 1}, {1, 0},
+                                     {1, 2}, {1, 1}, {3, 1}};
+
+static bool map_file(mapped_file_t* file, const char* path) {
+  memset(file, 0, sizeof(*file));
+#if defined(_WIN32)
+  file->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  LARGE_INTEGER size;
+  if (file->file == INVALID_HANDLE_VALUE ||
+      !GetFileSizeEx(file->file, &size) || size.QuadPart == 0) {
+    return false;
+  }
+  file->mapping = CreateFileMappingA(file->file, NULL, PAGE_READONLY, 0, 0,
+                                     NULL);
+  if (!file->mapping) {
+    return false;
+  }
+  file->data =
+      (const uint8_t*)MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0);
+  file->size = (size_t)size.QuadPart;
+#else
+  const int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+  void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping stays valid without the descriptor
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  // the decoder reads the file front to back
+  madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+  file->data = (const uint8_t*)data;
+  file->size = (size_t)st.st_size;
+#endif
+  return file->data != NULL;
+}
+
+static void unmap_file(mapped_file_t* file) {
+#if defined(_WIN32)
+  if (file->data) {
+    UnmapViewOfFile(file->data);
+  }
+  if (file->mapping) {
+    CloseHandle(file->mapping);
+  }
+  if (file->file && file->file != INVALID_HANDLE_VALUE) {
+    CloseHandle(file->file);
+  }
+#else
+  if (file->data) {
+    munmap((void*)file->data, file->size);
+  }
+#endif
+  memset(file, 0, sizeof(*file));
+}
+
+// Box filters `src` down to a square of `dst_size`, for the last step
+// between two powers of two where each destination texel covers one to two
+// source texels per axis.
+static void resample_face(const uint8_t* src,
+                          int src_w,
+                          int src_h,
+                          uint8_t* dst,
+                          int dst_size) {
+  for (int y = 0; y < dst_size; ++y) {
+    const int y0 = y * src_h / dst_size;
+    int y1 = (y + 1) * src_h / dst_size;
+    y1 = y1 > y0 ? y1 : y0 + 1;
+    for (int x = 0; x < dst_size; ++x) {
+      const int x0 = x * src_w / dst_size;
+      int x1 = (x + 1) * src_w / dst_size;
+      x1 = x1 > x0 ? x1 : x0 + 1;
+      const int count = (y1 - y0) * (x1 - x0);
+      for (int c = 0; c < 4; ++c) {
+        int sum = 0;
+        for (int sy = y0; sy < y1; ++sy) {
+          for (int sx = x0; sx < x1; ++sx) {
+            sum += src[((size_t)sy * src_w + sx) * 4 + c];
+          }
+        }
+        dst[((size_t)y * dst_size + x) * 4 + c] =
+            (uint8_t)((sum + count / 2) / count);
+      }
+    }
+  }
+}
+
+// Cuts one face out of the cross, brings it to the surface's size and
+// builds its mip chain straight into the face's slice of every level.
+// Cells that aren't square are cropped to their centered square, scaling
+// them would stretch the face.
+static void face_job(void* data) {
+  face_job_t* job = (face_job_t*)data;
+  const texpack_entry_t* entry = &job->surface->entry;
+  const int dst_size = (int)entry->width;
+  int w = job->cell_width < job->cell_height ? job->cell_width
+                                             : job->cell_height;
+  int h = w;
+  const int x0 = job->x + (job->cell_width - w) / 2;
+  const int y0 = job->y + (job->cell_height - h) / 2;
+  uint8_t* face = (uint8_t*)malloc((size_t)w * h * 4);
+  uint8_t* scratch = (uint8_t*)malloc((size_t)(w / 2 + 1) * (h / 2 + 1) * 4);
+  if (!face || !scratch) {
+    free(face);
+    free(scratch);
+    return;
+  }
+  const size_t row_size = (size_t)w * 4;
+  for (int row = 0; row < h; ++row) {
+    uint8_t* dst = face + row * row_size;
+    memcpy(dst,
+           job->cross + ((size_t)(y0 + row) * job->cross_width + x0) * 4,
+           row_size);
+    for (size_t i = 3; i < row_size; i += 4) {
+      dst[i] = 255;
+    }
+  }
+  // halve while that doesn't go below the target, then filter the rest
+  while (w / 2 >= dst_size && h / 2 >= dst_size) {
+    mipgen_downsample(face, w, h, scratch);
+    w /= 2;
+    h /= 2;
+    memcpy(face, scratch, (size_t)w * h * 4);
+  }
+
+  uint8_t* levels[TEXPACK_MAX_MIPS];
+  for (uint32_t mip = 0; mip < entry->num_mips; ++mip) {
+    levels[mip] = job->surface->levels[mip] +
+                  job->face * mipgen_level_size(dst_size, dst_size, (int)mip);
+  }
+  if (w == dst_size && h == dst_size) {
+    memcpy(levels[0], face, (size_t)w * h * 4);
+  } else {
+    resample_face(face, w, h, levels[0], dst_size);
+  }
+  free(face);
+  free(scratch);
+  mipgen_build_chain(levels, dst_size, dst_size, (int)entry->num_mips);
+  job->ok = true;
+}
+
+// Decodes the cross and fills `surface` with its six faces.
+static bool split_cross(cook_surface_t* surface,
+                        const char* path,
+                        int face_size) {
+  mapped_file_t file;
+  if (!map_file(&file, path)) {
+    fprintf(stderr, "%s: can't map\n", path);
+    unmap_file(&file);
+    return false;
+  }
+  uint64_t start = stm_now();
+  int w, h, comp;
+  stbi_uc* cross = stbi_load_from_memory(file.data, (int)file.size, &w, &h,
+                                         &comp, 4);
+  unmap_file(&file);
+  if (!cross) {
+    fprintf(stderr, "%s: %s\n", path, stbi_failure_reason());
+    return false;
+  }
+  const int cell_width = w / 4;
+  const int cell_height = h / 3;
+  const int src_size = cell_width < cell_height ? cell_width : cell_height;
+  printf("%s: %dx%d, %dx%d cells, decoded in %.1f ms\n", path, w, h,
+         cell_width, cell_height, stm_ms(stm_since(start)));
+  if (src_size == 0 || face_size > src_size) {
+    fprintf(stderr, "%s: %dx%d cells can't make %d texel faces\n", path,
+            cell_width, cell_height, face_size);
+    stbi_image_free(cross);
+    return false;
+  }
+
+  texpack_entry_t* entry = &surface->entry;
+  entry->type = TEXPACK_TYPE_CUBE;
+  entry->format = TEXPACK_FORMAT_RGBA8;
+  entry->num_slices = 6;
+  entry->width = entry->height = (uint32_t)(face_size ? face_size : src_size);
+  entry->num_mips =
+      (uint32_t)mipgen_num_levels((int)entry->width, (int)entry->height);
+  bool ok = true;
+  for (uint32_t mip = 0; mip < entry->num_mips; ++mip) {
+    surface->levels[mip] = (uint8_t*)malloc(
+        mipgen_level_size((int)entry->width, (int)entry->height, (int)mip) *
+        6);
+    ok = ok && surface->levels[mip];
+  }
+
+  start = stm_now();
+  face_job_t jobs[6];
+  for (int i = 0; ok && i < 6; ++i) {
+    jobs[i] = (face_job_t){.cross = cross,
+                           .cross_width = w,
+                           .x = face_cells[i][0] * cell_width,
+                           .y = face_cells[i][1] * cell_height,
+                           .cell_width = cell_width,
+                           .cell_height = cell_height,
+                           .face = i,
+                           .surface = surface};
+    job_pool_submit(face_job, NULL, &jobs[i]);
+  }
+  if (ok) {
+    job_pool_wait_all();
+    for (int i = 0; i < 6; ++i) {
+      ok = ok && jobs[i].ok;
+    }
+  }
+  stbi_image_free(cross);
+  if (!ok) {
+    fprintf(stderr, "%s: out of memory\n", path);
+    return false;
+  }
+  printf("%s: %ux%u x6, %u mips, split in %.1f ms\n", entry->name,
+         entry->width, entry->height, entry->num_mips,
+         stm_ms(stm_since(start)));
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  const char* out_path = NULL;
+  const char* name = "skybox";
+  const char* format_list = "bc,etc2";
+  const char* src_path = NULL;
+  int face_size = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      out_path = argv[++i];
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      name = argv[++i];
+    } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      face_size = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      format_list = argv[++i];
+    } else {
+      src_path = argv[i];
+    }
+  }
+  const char* formats[MAX_FORMATS];
+  const int num_formats = parse_formats(format_list, formats);
+  if (!out_path || !src_path || num_formats == 0 || face_size < 0 ||
+      strlen(name) >= TEXPACK_NAME_SIZE) {
+    fprintf(stderr,
+            "usage: cubesplit -o <pack> [-n <name>] [-s <face size>] "
+            "[-f bc,etc2,rgba8] <cross image>\n");
+    return 1;
+  }
+  stm_setup();
+  job_pool_setup(&(job_pool_desc_t){0});
+
+  static cook_surface_t source;
+  static cook_surface_t surfaces[TEXPACK_MAX_ENTRIES];
+  int num_surfaces = 0;
+  strcpy(source.entry.name, name);
+  bool ok = split_cross(&source, src_path, face_size) &&
+            cook_formats(&source, formats, num_formats, surfaces,
+                         &num_surfaces) &&
+            write_pack(out_path, surfaces, num_surfaces);
+  job_pool_shutdown();
+  free_surfaces(surfaces, num_surfaces);
+  free_surfaces(&source, 1);
+  return ok ? 0 : 1;
+}
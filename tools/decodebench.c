@@ -0,0 +1,183 @@
+/*
+  decodebench: measures the image decoders of image_decoder.h.
+
+  usage: decodebench [-r <rounds>] <image>...
+
+  Loads the images into memory, then decodes each of them `rounds` times
+  (default 5) with every decoder that takes it, stb_image always and
+  libjpeg-turbo/libpng when built with IMAGE_DECODER_TURBO. Prints the
+  compressed MB/s and decoded megapixels/s per decoder, split by file
+  type, and whether the decoders' output matches stb_image's.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SOKOL_TIME_IMPL
+#include "sokol_time.h"
+#include "image_decoder.h"
+
+typedef struct {
+  const char* path;
+  uint8_t* data;
+  size_t size;
+  int width, height;
+} image_t;
+
+typedef struct {
+  int files;
+  uint64_t in_bytes;
+  uint64_t pixels;
+  uint64_t ticks;
+  int failed;
+  int mismatched;
+} result_t;
+
+static bool load_file(const char* path, image_t* image) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
+  fseek(f, 0, SEEK_END);
+  const long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  image->path = path;
+  image->size = size > 0 ? (size_t)size : 0;
+  image->data = (uint8_t*)malloc(image->size ? image->size : 1);
+  const bool ok = fread(image->data, 1, image->size, f) == image->size;
+  fclose(f);
+  return ok && image_decode_info(image->data, image->size, &image->width,
+                                 &image->height);
+}
+
+static const char* type_names[] = {"jpeg", "png", "other"};
+#define NUM_TYPES (3)
+
+static int type_index(const image_t* image) {
+  if (_image_is_jpeg(image->data, image->size)) {
+    return 0;
+  }
+  if (_image_is_png(image->data, image->size)) {
+    return 1;
+  }
+  return 2;
+}
+
+// Largest difference of any channel, lossy decoders round differently.
+static int max_difference(const uint8_t* a, const uint8_t* b, size_t size) {
+  int max_diff = 0;
+  for (size_t i = 0; i < size; ++i) {
+    const int diff = abs((int)a[i] - (int)b[i]);
+    if (diff > max_diff) {
+      max_diff = diff;
+    }
+  }
+  return max_diff;
+}
+
+int main(int argc, char** argv) {
+  int rounds = 5;
+  int first = 1;
+  if (argc > 2 && strcmp(argv[1], "-r") == 0) {
+    rounds = atoi(argv[2]);
+    first = 3;
+  }
+  const int num_images = argc - first;
+  if (num_images < 1 || rounds < 1) {
+    fprintf(stderr, "usage: decodebench [-r <rounds>] <image>...\n");
+    return 1;
+  }
+  stm_setup();
+
+  image_t* images = (image_t*)calloc((size_t)num_images, sizeof(image_t));
+  size_t max_pixels = 0;
+  for (int i = 0; i < num_images; ++i) {
+    if (!load_file(argv[first + i], &images[i])) {
+      fprintf(stderr, "%s: can't load\n", argv[first + i]);
+      return 1;
+    }
+    const size_t pixels = (size_t)images[i].width * (size_t)images[i].height;
+    if (pixels > max_pixels) {
+      max_pixels = pixels;
+    }
+  }
+  uint8_t* reference = (uint8_t*)malloc(max_pixels * 4);
+  uint8_t* decoded = (uint8_t*)malloc(max_pixels * 4);
+
+  result_t results[IMAGE_NUM_DECODERS][NUM_TYPES];
+  memset(results, 0, sizeof(results));
+  for (int i = 0; i < num_images; ++i) {
+    const image_t* image = &images[i];
+    const size_t dst_size = (size_t)image->width * image->height * 4;
+    const int type = type_index(image);
+    int w, h;
+    // stb_image is last and always there
+    const bool have_reference = image_decoders[IMAGE_NUM_DECODERS - 1]
+                                    .decode_into(image->data, image->size,
+                                                 reference, dst_size, &w, &h);
+    for (int d = 0; d < IMAGE_NUM_DECODERS; ++d) {
+      const image_decoder_t* decoder = &image_decoders[d];
+      result_t* result = &results[d][type];
+      if (!decoder->probe(image->data, image->size)) {
+        continue;
+      }
+      bool ok = true;
+      const uint64_t start = stm_now();
+      for (int r = 0; r < rounds && ok; ++r) {
+        ok = decoder->decode_into(image->data, image->size, decoded, dst_size,
+                                  &w, &h);
+      }
+      if (!ok) {
+        fprintf(stderr, "%s: %s failed\n", image->path, decoder->name);
+        ++result->failed;
+        continue;
+      }
+      result->ticks += stm_since(start);
+      ++result->files;
+      result->in_bytes += (uint64_t)image->size * rounds;
+      result->pixels += (uint64_t)image->width * image->height * rounds;
+      if (have_reference) {
+        const int diff = max_difference(reference, decoded, dst_size);
+        // JPEG IDCTs and upsamplers may round differently by a few steps
+        if (diff > 0) {
+          ++result->mismatched;
+          if (diff > 8) {
+            fprintf(stderr, "%s: %s differs from stb_image by up to %d\n",
+                    image->path, decoder->name, diff);
+          }
+        }
+      }
+    }
+  }
+
+  printf("%d images, %d rounds\n", num_images, rounds);
+  printf("%-14s %-6s %6s %10s %10s %10s %10s\n", "decoder", "type", "files",
+         "ms", "MB/s", "MP/s", "inexact");
+  for (int d = 0; d < IMAGE_NUM_DECODERS; ++d) {
+    for (int t = 0; t < NUM_TYPES; ++t) {
+      const result_t* result = &results[d][t];
+      if (result->files == 0 && result->failed == 0) {
+        continue;
+      }
+      const double sec = stm_sec(result->ticks);
+      const double mb = (double)result->in_bytes / (1024.0 * 1024.0);
+      const double mp = (double)result->pixels / 1000000.0;
+      printf("%-14s %-6s %6d %10.1f %10.1f %10.1f %10d", image_decoders[d].name,
+             type_names[t], result->files, sec * 1000.0,
+             sec > 0.0 ? mb / sec : 0.0, sec > 0.0 ? mp / sec : 0.0,
+             result->mismatched);
+      if (result->failed) {
+        printf(" (%d failed)", result->failed);
+      }
+      printf("\n");
+    }
+  }
+
+  for (int i = 0; i < num_images; ++i) {
+    free(images[i].data);
+  }
+  free(images);
+  free(reference);
+  free(decoded);
+  return 0;
+}
@@ -0,0 +1,243 @@
+#ifndef TEXCOOK_H
+#define TEXCOOK_H
+
+/*
+  Shared back end of the texture tools (texcooker, cubesplit): block
+  compression of RGBA8 surfaces on the job pool and writing them into a
+  texture pack (see texture_pack_format.h).
+
+  A surface is cooked once as RGBA8 with its full mip chain, then stored
+  once per requested format with cook_formats().
+*/
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sokol_time.h"
+#include "mipgen.h"
+#include "texcomp.h"
+#include "texture_pack_format.h"
+#include "job_pool.h"
+
+// block rows per compression job
+#define COMPRESS_BAND_ROWS (16)
+#define MAX_FORMATS (4)
+
+typedef struct cook_surface_t {
+  texpack_entry_t entry;
+  // level-major: all slices of a level back to back
+  uint8_t* levels[TEXPACK_MAX_MIPS];
+  // the RGBA8 variant and the preview share their levels with the source
+  // surface
+  bool shared_levels;
+  bool has_alpha;
+  // largest dimension of the preview, 0 for none
+  int preview_size;
+} cook_surface_t;
+
+typedef struct compress_job_t {
+  uint32_t format;
+  const uint8_t* src;
+  int width;
+  int height;
+  uint8_t* dst;
+  int row_begin;
+  int row_end;
+} compress_job_t;
+
+static uint32_t align_up(uint32_t offset) {
+  return (offset + TEXPACK_ALIGN - 1) & ~(uint32_t)(TEXPACK_ALIGN - 1);
+}
+
+static bool write_pack(const char* path,
+                       cook_surface_t* surfaces,
+                       int num_surfaces) {
+  texpack_header_t header = {.magic = TEXPACK_MAGIC,
+                             .version = TEXPACK_VERSION,
+                             .num_entries = (uint32_t)num_surfaces};
+  uint32_t offset = (uint32_t)(sizeof(texpack_header_t) +
+                               num_surfaces * sizeof(texpack_entry_t));
+  for (int i = 0; i < num_surfaces; ++i) {
+    texpack_entry_t* entry = &surfaces[i].entry;
+    for (uint32_t mip = 0; mip < entry->num_mips; ++mip) {
+      const uint32_t w = entry->width >> mip ? entry->width >> mip : 1;
+      const uint32_t h = entry->height >> mip ? entry->height >> mip : 1;
+      offset = align_up(offset);
+      entry->mip_offsets[mip] = offset;
+      entry->mip_sizes[mip] =
+          texpack_surface_size(entry->format, w, h) * entry->num_slices;
+      offset += entry->mip_sizes[mip];
+    }
+  }
+  header.file_size = offset;
+
+  FILE* fp = fopen(path, "wb");
+  if (!fp) {
+    fprintf(stderr, "%s: can't open for writing\n", path);
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+  for (int i = 0; ok && i < num_surfaces; ++i) {
+    ok = fwrite(&surfaces[i].entry, sizeof(texpack_entry_t), 1, fp) == 1;
+  }
+  static const uint8_t zeros[TEXPACK_ALIGN] = {0};
+  for (int i = 0; ok && i < num_surfaces; ++i) {
+    const texpack_entry_t* entry = &surfaces[i].entry;
+    for (uint32_t mip = 0; ok && mip < entry->num_mips; ++mip) {
+      const long pad = (long)entry->mip_offsets[mip] - ftell(fp);
+      ok = (pad == 0 || fwrite(zeros, (size_t)pad, 1, fp) == 1) &&
+           fwrite(surfaces[i].levels[mip], entry->mip_sizes[mip], 1, fp) == 1;
+    }
+  }
+  ok = fclose(fp) == 0 && ok;
+  if (!ok) {
+    fprintf(stderr, "%s: write failed\n", path);
+  }
+  return ok;
+}
+
+static const char* format_name(uint32_t format) {
+  switch (format) {
+    case TEXPACK_FORMAT_BC1:
+      return "bc1";
+    case TEXPACK_FORMAT_BC3:
+      return "bc3";
+    case TEXPACK_FORMAT_ETC2_RGB8:
+      return "etc2";
+    default:
+      return "rgba8";
+  }
+}
+
+// Formats of the -f list, "bc" is resolved per surface.
+static int parse_formats(const char* list, const char* formats[MAX_FORMATS]) {
+  static char buf[256];
+  snprintf(buf, sizeof(buf), "%s", list);
+  int num = 0;
+  for (char* tok = strtok(buf, ","); tok && num < MAX_FORMATS;
+       tok = strtok(NULL, ",")) {
+    if (strcmp(tok, "bc") != 0 && strcmp(tok, "etc2") != 0 &&
+        strcmp(tok, "rgba8") != 0) {
+      fprintf(stderr, "unknown format '%s'\n", tok);
+      return 0;
+    }
+    formats[num++] = tok;
+  }
+  return num;
+}
+
+static void compress_job(void* data) {
+  compress_job_t* job = (compress_job_t*)data;
+  texcomp_encode_rows(job->format, job->src, job->width, job->height,
+                      job->dst, job->row_begin, job->row_end);
+}
+
+// Compresses every level and slice of `source` into `variant`, in bands of
+// block rows spread over the job pool.
+static void compress_surface(const cook_surface_t* source,
+                             cook_surface_t* variant,
+                             uint32_t format) {
+  const texpack_entry_t* src = &source->entry;
+  variant->entry = *src;
+  variant->entry.format = format;
+  variant->shared_levels = false;
+
+  int num_jobs = 0;
+  for (uint32_t mip = 0; mip < src->num_mips; ++mip) {
+    const int h = mipgen_level_dim((int)src->height, (int)mip);
+    const int bands =
+        (texcomp_block_rows(h) + COMPRESS_BAND_ROWS - 1) / COMPRESS_BAND_ROWS;
+    num_jobs += bands * (int)src->num_slices;
+  }
+  compress_job_t* jobs =
+      (compress_job_t*)calloc((size_t)num_jobs, sizeof(compress_job_t));
+  int job_index = 0;
+  for (uint32_t mip = 0; mip < src->num_mips; ++mip) {
+    const int w = mipgen_level_dim((int)src->width, (int)mip);
+    const int h = mipgen_level_dim((int)src->height, (int)mip);
+    const size_t src_size = mipgen_level_size((int)src->width,
+                                              (int)src->height, (int)mip);
+    const uint32_t dst_size =
+        texpack_surface_size(format, (uint32_t)w, (uint32_t)h);
+    variant->levels[mip] = (uint8_t*)malloc(dst_size * src->num_slices);
+    for (uint32_t slice = 0; slice < src->num_slices; ++slice) {
+      for (int row = 0; row < texcomp_block_rows(h);
+           row += COMPRESS_BAND_ROWS) {
+        compress_job_t* job = &jobs[job_index++];
+        *job = (compress_job_t){
+            .format = format,
+            .src = source->levels[mip] + slice * src_size,
+            .width = w,
+            .height = h,
+            .dst = variant->levels[mip] + slice * dst_size,
+            .row_begin = row,
+            .row_end = row + COMPRESS_BAND_ROWS < texcomp_block_rows(h)
+                           ? row + COMPRESS_BAND_ROWS
+                           : texcomp_block_rows(h)};
+        job_pool_submit(compress_job, NULL, job);
+      }
+    }
+  }
+  job_pool_wait_all();
+  free(jobs);
+}
+
+static uint32_t entry_size(const texpack_entry_t* entry) {
+  uint32_t size = 0;
+  for (uint32_t mip = 0; mip < entry->num_mips; ++mip) {
+    const uint32_t w = entry->width >> mip ? entry->width >> mip : 1;
+    const uint32_t h = entry->height >> mip ? entry->height >> mip : 1;
+    size += texpack_surface_size(entry->format, w, h) * entry->num_slices;
+  }
+  return size;
+}
+
+// Stores `source` once per format of `formats` into `surfaces`, starting
+// at `*num_surfaces`. Returns false if `surfaces` is full.
+static bool cook_formats(cook_surface_t* source,
+                         const char* formats[],
+                         int num_formats,
+                         cook_surface_t* surfaces,
+                         int* num_surfaces) {
+  for (int f = 0; f < num_formats; ++f) {
+    if (*num_surfaces == TEXPACK_MAX_ENTRIES) {
+      fprintf(stderr, "%s: more than %d surfaces\n", source->entry.name,
+              TEXPACK_MAX_ENTRIES);
+      return false;
+    }
+    cook_surface_t* variant = &surfaces[*num_surfaces];
+    const uint64_t start = stm_now();
+    if (strcmp(formats[f], "rgba8") == 0) {
+      *variant = *source;
+      variant->shared_levels = true;
+    } else if (strcmp(formats[f], "bc") == 0) {
+      compress_surface(source, variant,
+                       source->has_alpha ? TEXPACK_FORMAT_BC3
+                                         : TEXPACK_FORMAT_BC1);
+    } else if (!source->has_alpha) {
+      compress_surface(source, variant, TEXPACK_FORMAT_ETC2_RGB8);
+    } else {
+      printf("  etc2: skipped, ETC2 RGB8 has no alpha\n");
+      continue;
+    }
+    ++*num_surfaces;
+    printf("  %s: %.2f MB, %.1f ms\n", format_name(variant->entry.format),
+           entry_size(&variant->entry) / (1024.0 * 1024.0),
+           stm_ms(stm_since(start)));
+  }
+  return true;
+}
+
+// Frees the levels of the cooked variants and of their sources.
+static void free_surfaces(cook_surface_t* surfaces, int num_surfaces) {
+  for (int i = 0; i < num_surfaces; ++i) {
+    for (int mip = 0; !surfaces[i].shared_levels && mip < TEXPACK_MAX_MIPS;
+         ++mip) {
+      free(surfaces[i].levels[mip]);
+      surfaces[i].levels[mip] = NULL;
+    }
+  }
+}
+
+#endif  // TEXCOOK_H
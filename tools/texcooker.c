@@ -0,0 +1,229 @@
+/*
+  texcooker: cooks the `cook:` surfaces of data/..._assets.yml files into
+  a single texture pack (see texture_pack_format.h) that the app loads
+  without any image decoding.
+
+  usage: texcooker -o <pack> [-p <preview pack>] [-f <formats>]
+                   <assets.yml>...
+
+  <formats> is a comma separated list in order of preference, each surface
+  is stored once per format: bc (BC1, or BC3 for surfaces with alpha),
+  etc2 (opaque surfaces only) and rgba8. Defaults to bc,etc2, the app
+  decodes the loose files if the GPU supports neither.
+
+  Surfaces with a `preview:` size also go into the preview pack, as RGBA8
+  from the first mip level that fits. The app shows them while the full
+  surfaces load.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stb/stb_image.h"
+#define SOKOL_TIME_IMPL
+#include "sokol_time.h"
+#include "asset_yml.h"
+#include "texcook.h"
+
+static bool parse_type(const char* str, uint32_t* type) {
+  if (strcmp(str, "2d") == 0) {
+    *type = TEXPACK_TYPE_2D;
+  } else if (strcmp(str, "cube") == 0) {
+    *type = TEXPACK_TYPE_CUBE;
+  } else if (strcmp(str, "array") == 0) {
+    *type = TEXPACK_TYPE_ARRAY;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static bool check_slice_count(const texpack_entry_t* entry) {
+  switch (entry->type) {
+    case TEXPACK_TYPE_2D:
+      return entry->num_slices == 1;
+    case TEXPACK_TYPE_CUBE:
+      return entry->num_slices == 6;
+    default:
+      return entry->num_slices >= 1;
+  }
+}
+
+// Builds the mip chain of one slice in `chain` and scatters its levels
+// into the surface.
+static void add_slice(cook_surface_t* surface,
+                      int slice,
+                      stbi_uc* pixels,
+                      uint8_t** chain) {
+  const texpack_entry_t* entry = &surface->entry;
+  const int w = (int)entry->width;
+  const int h = (int)entry->height;
+  for (size_t i = 3; i < (size_t)w * h * 4; i += 4) {
+    if (pixels[i] != 255) {
+      surface->has_alpha = true;
+      break;
+    }
+  }
+  chain[0] = pixels;
+  mipgen_build_chain(chain, w, h, (int)entry->num_mips);
+  for (uint32_t mip = 0; mip < entry->num_mips; ++mip) {
+    const size_t size = mipgen_level_size(w, h, (int)mip);
+    memcpy(surface->levels[mip] + slice * size, chain[mip], size);
+  }
+}
+
+static bool cook_surface(cook_surface_t* surface, const char* yml_path) {
+  asset_yml_t yml;
+  if (!asset_yml_load(&yml, yml_path)) {
+    return false;
+  }
+  texpack_entry_t* entry = &surface->entry;
+  if (yml.cook_name[0] == 0 || yml.num_cook_files == 0) {
+    fprintf(stderr, "%s: no cook section\n", yml_path);
+    return false;
+  }
+  if (strlen(yml.cook_name) >= TEXPACK_NAME_SIZE) {
+    fprintf(stderr, "%s: name '%s' too long\n", yml_path, yml.cook_name);
+    return false;
+  }
+  if (!parse_type(yml.cook_type, &entry->type)) {
+    fprintf(stderr, "%s: unknown type '%s'\n", yml_path, yml.cook_type);
+    return false;
+  }
+  strcpy(entry->name, yml.cook_name);
+  surface->preview_size = yml.cook_preview;
+  entry->format = TEXPACK_FORMAT_RGBA8;
+  entry->num_slices = (uint32_t)yml.num_cook_files;
+  if (!check_slice_count(entry)) {
+    fprintf(stderr, "%s: wrong number of files for '%s'\n", yml_path,
+            yml.cook_type);
+    return false;
+  }
+
+  uint8_t* chain[TEXPACK_MAX_MIPS] = {0};
+  bool ok = true;
+  for (int i = 0; ok && i < yml.num_cook_files; ++i) {
+    char path[1024];
+    asset_yml_source_path(path, sizeof(path), yml_path, &yml,
+                          yml.cook_files[i]);
+    int w, h, comp;
+    stbi_uc* pixels = stbi_load(path, &w, &h, &comp, 4);
+    if (!pixels) {
+      fprintf(stderr, "%s: %s\n", path, stbi_failure_reason());
+      ok = false;
+      break;
+    }
+    if (i == 0) {
+      entry->width = (uint32_t)w;
+      entry->height = (uint32_t)h;
+      entry->num_mips = (uint32_t)mipgen_num_levels(w, h);
+      for (uint32_t mip = 0; mip < entry->num_mips; ++mip) {
+        const size_t size = mipgen_level_size(w, h, (int)mip);
+        surface->levels[mip] = (uint8_t*)malloc(size * entry->num_slices);
+        if (mip > 0) {
+          chain[mip] = (uint8_t*)malloc(size);
+        }
+      }
+    }
+    if ((uint32_t)w != entry->width || (uint32_t)h != entry->height ||
+        (entry->type == TEXPACK_TYPE_CUBE && w != h)) {
+      fprintf(stderr, "%s: %dx%d doesn't match %ux%u\n", path, w, h,
+              entry->width, entry->height);
+      ok = false;
+    } else {
+      add_slice(surface, i, pixels, chain);
+    }
+    stbi_image_free(pixels);
+  }
+  for (int mip = 1; mip < TEXPACK_MAX_MIPS; ++mip) {
+    free(chain[mip]);
+  }
+  return ok;
+}
+
+// The preview shares the source's levels, starting at the first one that
+// fits into the preview size.
+static void make_preview(const cook_surface_t* source,
+                         cook_surface_t* preview) {
+  const texpack_entry_t* src = &source->entry;
+  const int size = source->preview_size;
+  uint32_t first = 0;
+  while (first + 1 < src->num_mips &&
+         (mipgen_level_dim((int)src->width, (int)first) > size ||
+          mipgen_level_dim((int)src->height, (int)first) > size)) {
+    ++first;
+  }
+  memset(preview, 0, sizeof(*preview));
+  preview->entry = *src;
+  preview->entry.width =
+      (uint32_t)mipgen_level_dim((int)src->width, (int)first);
+  preview->entry.height =
+      (uint32_t)mipgen_level_dim((int)src->height, (int)first);
+  preview->entry.num_mips = src->num_mips - first;
+  for (uint32_t mip = 0; mip < preview->entry.num_mips; ++mip) {
+    preview->levels[mip] = source->levels[first + mip];
+  }
+  preview->shared_levels = true;
+  printf("  preview: %ux%u, %u mips\n", preview->entry.width,
+         preview->entry.height, preview->entry.num_mips);
+}
+
+int main(int argc, char* argv[]) {
+  const char* out_path = NULL;
+  const char* preview_path = NULL;
+  const char* format_list = "bc,etc2";
+  const char* yml_paths[TEXPACK_MAX_ENTRIES];
+  int num_ymls = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      out_path = argv[++i];
+    } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+      preview_path = argv[++i];
+    } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      format_list = argv[++i];
+    } else if (num_ymls < TEXPACK_MAX_ENTRIES) {
+      yml_paths[num_ymls++] = argv[i];
+    } else {
+      fprintf(stderr, "%s: more than %d inputs\n", argv[i],
+              TEXPACK_MAX_ENTRIES);
+      return 1;
+    }
+  }
+  const char* formats[MAX_FORMATS];
+  const int num_formats = parse_formats(format_list, formats);
+  if (!out_path || num_ymls == 0 || num_formats == 0) {
+    fprintf(stderr,
+            "usage: texcooker -o <pack> [-p <preview pack>] "
+            "[-f bc,etc2,rgba8] <assets.yml>...\n");
+    return 1;
+  }
+  stm_setup();
+  job_pool_setup(&(job_pool_desc_t){0});
+
+  static cook_surface_t sources[TEXPACK_MAX_ENTRIES];
+  static cook_surface_t surfaces[TEXPACK_MAX_ENTRIES];
+  static cook_surface_t previews[TEXPACK_MAX_ENTRIES];
+  int num_surfaces = 0;
+  int num_previews = 0;
+  bool ok = true;
+  for (int i = 0; ok && i < num_ymls; ++i) {
+    cook_surface_t* source = &sources[i];
+    ok = cook_surface(source, yml_paths[i]);
+    if (!ok) {
+      break;
+    }
+    const texpack_entry_t* entry = &source->entry;
+    printf("%s: %s %ux%u x%u, %u mips\n", yml_paths[i], entry->name,
+           entry->width, entry->height, entry->num_slices, entry->num_mips);
+    if (preview_path && source->preview_size > 0) {
+      make_preview(source, &previews[num_previews++]);
+    }
+    ok = cook_formats(source, formats, num_formats, surfaces, &num_surfaces);
+  }
+  ok = ok && write_pack(out_path, surfaces, num_surfaces) &&
+       (!preview_path || write_pack(preview_path, previews, num_previews));
+  job_pool_shutdown();
+  free_surfaces(surfaces, num_surfaces);
+  free_surfaces(sources, num_ymls);
+  return ok ? 0 : 1;
+}